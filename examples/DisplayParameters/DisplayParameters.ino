@@ -15,6 +15,7 @@ a small OLED screen.
 #include <SdFat.h> // To communicate with the SD card
 #include <scanModbus.h>
 #include <scanAnapro.h>
+#include <scanDutyCycle.h>  // To sleep until each measurement is finished
 
 // ---------------------------------------------------------------------------
 // Set up the sensor specific information
@@ -25,7 +26,6 @@ a small OLED screen.
 bool startLogger = true;  // if you want to use this program to start logging
 uint32_t logging_interval_minutes = 2L;
 uint16_t logging_interval_seconds = round(logging_interval_minutes*60);
-uint32_t delay_ms = 1000L*60L*logging_interval_minutes;
 
 
 // Define the cleaning parameters
@@ -49,6 +49,11 @@ byte specModbusAddress = 0x04;
 scan spectro;
 // Construct the "ana::pro" instance for printing formatted strings
 anapro spectroPr(&spectro);
+// Construct the tracker that learns when each measurement finishes, and the
+// duty cycle that sleeps until then (give it your board's sleep function in
+// place of delay to save power)
+scanMeasurementTracker tracker(spectro);
+scanDutyCycle dutyCycle(tracker, delay);
 bool isSpec;  // as opposed to a controller with ana::gate
 
 // Set up the OLED display
@@ -213,8 +218,7 @@ void setup()
         delay(500);
     }
 
-    if (spectro.getModelType() == 0x0603) isSpec = false;
-    else isSpec = true;
+    isSpec = !spectro.isAnaGate();
 
     if (isSpec && startLogger)
     {
@@ -308,14 +312,10 @@ void setup()
         spectro.setLoggingMode(0);
         display.display();
         delay(2000);
-
-        display.clearDisplay();
-        display.setCursor(0,0);
-        display.println("Waiting for spectro::lyser to be ready after measurement.");
-        display.display();
-        delay(55000);
     }
-    else while (spectro.getParameterTime() == 0){};
+
+    // Start learning when measurements finish; the loop waits for each one
+    dutyCycle.begin();
 }
 
 // ---------------------------------------------------------------------------
@@ -323,8 +323,8 @@ void setup()
 // ---------------------------------------------------------------------------
 void loop()
 {
-    // Track how long the loop takes
-    uint32_t startLoop = millis();
+    // Sleep until the spectro::lyzer has finished its next measurement
+    dutyCycle.waitForMeasurement();
 
     // Initialise the SD card
     if (sd.begin(SDCardPin, SPI_FULL_SPEED))
@@ -352,7 +352,4 @@ void loop()
         display.display();
     }
 
-    // Wait
-    delay(delay_ms - (millis() - startLoop));
-
 }
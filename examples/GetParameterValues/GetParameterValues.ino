@@ -89,8 +89,7 @@ void setup()
         delay(500);
     }
 
-    if (spectro.getModelType() == 0x0603) isSpec = false;
-    else isSpec = true;
+    isSpec = !spectro.isAnaGate();
 
     // Print out the device setup
     spectro.printSetup(Serial);
@@ -6,12 +6,15 @@ data) to an SD card in formats set to match the files that would otherwise be
 created by ana::lyte or ana::pro.
 
 This does NOT set up the logging for the spectro::lyzer itself, it only requests
-data from the spec at periodic intervals and records that data to a file.
+data from the spec right after each of its measurements finishes and records
+that data to a file.
 You should set up the spectro::lyzer and start it logging using S::CAN's
 ana::pro software.
 
-At present, this example does NOT put the datalogger board to sleep between
-readings.  It also relies on the spectro::lyzer itself to report the clock time
+Between readings it waits with scanDutyCycle, which turns off the RS485
+adapter (if it has a power pin) and calls a sleep function.  At present that
+function is just delay(), so the datalogger board does NOT sleep; give it one
+that sleeps your board to save power.  It also relies on the spectro::lyzer itself to report the clock time
 rather than using any other internal or external clock.
 *****************************************************************************/
 
@@ -22,6 +25,10 @@ rather than using any other internal or external clock.
 #include <SdFat.h> // To communicate with the SD card
 #include <scanModbus.h>
 #include <scanAnapro.h>
+#include <scanSdSink.h>  // Buffered, preallocated files on the SD card
+#include <scanMeasurementTracker.h>  // To read the results right after each measurement
+#include <scanDutyCycle.h>  // To sleep between measurements
+#include <scanClock.h>  // To keep the probe's time without reading it each time
 
 // ---------------------------------------------------------------------------
 // Set up the sensor specific information
@@ -32,7 +39,6 @@ rather than using any other internal or external clock.
 bool startLogger = false;  // if you want to use this program to start logging
 uint32_t logging_interval_minutes = 2L;
 uint16_t logging_interval_seconds = round(logging_interval_minutes*60);
-uint32_t delay_ms = 1000L*60L*logging_interval_minutes;
 
 
 // Define the cleaning parameters
@@ -47,6 +53,8 @@ const uint8_t buttonPin = 21;
 // Define enable pin
 const int DEREPin = -1;   // The pin controlling Recieve Enable and Driver Enable
                           // on the RS485 adapter, if applicable (else, -1)
+const int RS485PowerPin = -1;  // The pin powering the RS485 adapter, if it can
+                               // be turned off between readings (else, -1)
 
 // Define the spectro::lyzer's modbus address
 byte specModbusAddress = 0x04;
@@ -56,24 +64,30 @@ byte specModbusAddress = 0x04;
 scan spectro;
 // Construct the "ana::pro" instance for printing formatted strings
 anapro spectroPr(&spectro);
+// Construct the tracker that learns when each measurement finishes
+scanMeasurementTracker tracker(spectro);
+// Construct the duty cycle that waits for each measurement
+scanDutyCycle dutyCycle(tracker);
+// Construct the clock that keeps the probe's time between reading it
+scanClock probeClock(spectro);
 bool isSpec;  // as opposed to a controller with ana::gate
 
-// A global variable for the filename
-String fileName;
 static time_t fileStartTime;
 
 // Setting up the SD card
 const int SDCardPin = 12;
 SdFat sd;
-File parFile;
-static char parFileName[25];
-File fpFile0, fpFile1, fpFile2, fpFile3, fpFile4, fpFile5, fpFile6, fpFile7;
-static char fpFileName0[25], fpFileName1[25], fpFileName2[25], fpFileName3[25],
-            fpFileName4[25], fpFileName5[25], fpFileName6[25],fpFileName7[25];
-
-void startFile(File file, String extension, char filenameBuffer[], spectralSource source=fingerprint)
+bool sdReady = false;
+// Each file stays open, and is written a whole sector at a time
+// Every sink holds a 512 byte sector buffer, so only declare the ones that
+// are used; to save another spectral source, add a sink for it here (ie,
+// scanSdSink fpSink2(sd);) and un-comment its lines below.
+scanSdSink parSink(sd);
+scanSdSink fpSink0(sd), fpSink1(sd);
+
+void startFile(scanSdSink &sink, String extension, spectralSource source=fingerprint)
 {
-    time_t currentTime = spectro.getSystemTime();
+    time_t currentTime = probeClock.now();
 
     // Check if the start time is within a minute of the last file, to avoid having
     // many files with nearly-but-not-quite identical file names just a second or two off
@@ -89,96 +103,62 @@ void startFile(File file, String extension, char filenameBuffer[], spectralSourc
     }
     filename += ".";
     filename += extension;
+    char filenameBuffer[25];
     filename.toCharArray(filenameBuffer, 25);
     Serial.print(F("Creating file "));
     Serial.println(filenameBuffer);
 
-    // Create and open the file in write mode
-    file.open(filenameBuffer, O_CREAT | O_WRITE | O_AT_END);
-    // Set creation date time
-    file.timestamp(T_CREATE, year(currentTime),
-                             month(currentTime),
-                             day(currentTime),
-                             hour(currentTime),
-                             minute(currentTime),
-                             second(currentTime));
-    // Set write/modification date time
-    file.timestamp(T_WRITE, year(currentTime),
-                            month(currentTime),
-                            day(currentTime),
-                            hour(currentTime),
-                            minute(currentTime),
-                            second(currentTime));
-    // Set access date time
-    file.timestamp(T_ACCESS, year(currentTime),
-                             month(currentTime),
-                             day(currentTime),
-                             hour(currentTime),
-                             minute(currentTime),
-                             second(currentTime));
+    // Close the last file (if any), then create the new one with all of its
+    // space set aside and set its creation, write, and access times
+    if (!sink.open(filenameBuffer, currentTime))
+    {
+        Serial.println(F("Error: Unable to create the file!"));
+        return;
+    }
 
     // Write the header
     if (extension == "fp")
     {
-        spectroPr.printFingerprintHeader(file, "\t", source);
+        spectroPr.printFingerprintHeader(sink, "\t", source);
         spectroPr.printFingerprintHeader(Serial, "\t", source);
     }
     else
     {
-        spectroPr.printParameterHeader(file);
+        spectroPr.printParameterHeader(sink);
         spectroPr.printParameterHeader(Serial);
     }
 
-    //Close the file to save it
-    file.close();
+    // Make sure the header is on the card
+    sink.sync(currentTime);
     Serial.print(F("   ... Success!\n"));
     Serial.println("=======================");
 }
 
-void writeToFile(File file, String extension, char filenameBuffer[], spectralSource source=fingerprint)
+void writeToFile(scanSdSink &sink, String extension, spectralSource source=fingerprint)
 {
-    // Check if the file already exists, else create a new one
-    if (!sd.exists(filenameBuffer)) startFile(file, extension, filenameBuffer);
-
-    // Check that the file is less than 2MB, else create a new one
-    else if (file.size() > 2000000L) startFile(file, extension, filenameBuffer);
-
-    Serial.print(F("Writing to file "));
-    Serial.println(filenameBuffer);
+    // Start a new file if there isn't one yet or the space set aside for this
+    // one is nearly used
+    if (!sink.isOpen() || sink.full()) startFile(sink, extension, source);
 
-    time_t currentTime = spectro.getSystemTime();
-
-    // Open the file in write mode
-    file.open(filenameBuffer, O_WRITE | O_AT_END);
-    // Set write/modification date time
-    file.timestamp(T_WRITE, year(currentTime),
-                            month(currentTime),
-                            day(currentTime),
-                            hour(currentTime),
-                            minute(currentTime),
-                            second(currentTime));
-    // Set access date time
-    file.timestamp(T_ACCESS, year(currentTime),
-                             month(currentTime),
-                             day(currentTime),
-                             hour(currentTime),
-                             minute(currentTime),
-                             second(currentTime));
+    Serial.print(F("Writing to the "));
+    Serial.print(extension);
+    Serial.println(F(" file"));
 
     // Write the data
     if (extension == "fp")
     {
-        spectroPr.printFingerprintDataRow(file, "\t", source);
+        spectroPr.printFingerprintDataRow(sink, "\t", source);
         spectroPr.printFingerprintDataRow(Serial, "\t", source);
     }
     else
     {
-        spectroPr.printParameterDataRow(file);
+        spectroPr.printParameterDataRow(sink);
         spectroPr.printParameterDataRow(Serial);
     }
 
-    //Close the file to save it
-    file.close();
+    // Write out the partly filled sector (and the modification time) only
+    // once per sync interval; whole sectors are written as they fill
+    sink.syncIfDue(probeClock.now());
     Serial.print(F("   ... Success!\n"));
     Serial.println("=======================");
 }
@@ -189,6 +169,7 @@ void writeToFile(File file, String extension, char filenameBuffer[], spectralSou
 void setup()
 {
     if (DEREPin > 0) pinMode(DEREPin, OUTPUT);
+    dutyCycle.setPowerPin(RS485PowerPin);  // Turns the RS485 adapter on
     if (buttonPin > 0) pinMode(buttonPin, INPUT_PULLUP);
 
     Serial.begin(57600);  // Main serial port for debugging via USB Serial Monitor
@@ -218,8 +199,7 @@ void setup()
         delay(500);
     }
 
-    if (spectro.getModelType() == 0x0603) isSpec = false;
-    else isSpec = true;
+    isSpec = !spectro.isAnaGate();
 
     if (isSpec && startLogger)
     {
@@ -265,6 +245,11 @@ void setup()
     // Print out the device setup
     spectro.printSetup(Serial);
 
+    // Read the probe's clock; from here on its time is kept locally.  If the
+    // logger has a real time clock, probeClock.correct(rtcTime) would keep
+    // the probe's clock set to it.
+    probeClock.sync();
+
     // Initialise the SD card
     if (!sd.begin(SDCardPin, SPI_FULL_SPEED))
     {
@@ -276,24 +261,36 @@ void setup()
         Serial.print(F("Successfully connected to SD Card with card/slave select on pin "));
         Serial.println(SDCardPin);
 
-        startFile(parFile, "par", parFileName);
-        startFile(fpFile0, "fp", fpFileName0, fingerprint);
+        sdReady = true;
+
+        // Cut any files left open by a power loss back to their text; the
+        // new files get new names, so they wouldn't otherwise be closed
+        int trimmed = parSink.trimUnclosed();
+        if (trimmed > 0)
+        {
+            Serial.print(F("Trimmed "));
+            Serial.print(trimmed);
+            Serial.println(F(" file(s) left open by a power loss"));
+        }
+
+        startFile(parSink, "par");
+        startFile(fpSink0, "fp", fingerprint);
         if (isSpec)
         {
-            startFile(fpFile1, "fp", fpFileName1, compensFP);
-            // startFile(fpFile2, "fp", fpFileName2, derivFP);
-            // startFile(fpFile3, "fp", fpFileName3, diff2oldorgFP);
-            // startFile(fpFile4, "fp", fpFileName4, transmission);
-            // startFile(fpFile5, "fp", fpFileName5, derivcompFP);
-            // startFile(fpFile6, "fp", fpFileName6, transmission10);
-            // startFile(fpFile7, "fp", fpFileName7, other);
+            startFile(fpSink1, "fp", compensFP);
+            // startFile(fpSink2, "fp", derivFP);
+            // startFile(fpSink3, "fp", diff2oldorgFP);
+            // startFile(fpSink4, "fp", transmission);
+            // startFile(fpSink5, "fp", derivcompFP);
+            // startFile(fpSink6, "fp", transmission10);
+            // startFile(fpSink7, "fp", other);
         }
     }
 
     if (isSpec && startLogger)
     {
         // Wait for an even interval of the logging interval to start the logging
-        uint32_t now = spectro.getSystemTime();
+        uint32_t now = probeClock.now();
         uint32_t secToWait = logging_interval_seconds - (now % logging_interval_seconds);
         Serial.print("Current time is ");
         Serial.println(anapro::timeToStringDot(now));
@@ -304,10 +301,10 @@ void setup()
 
         Serial.println("Turning on Logging");
         spectro.setLoggingMode(0);
-        Serial.println("Waiting for spectro::lyser to be ready after measurement.");
-        delay(55000);
     }
-    else while (spectro.getParameterTime() == 0){};
+
+    // Start learning when measurements finish; the loop waits for each one
+    dutyCycle.begin();
 }
 
 // ---------------------------------------------------------------------------
@@ -315,11 +312,19 @@ void setup()
 // ---------------------------------------------------------------------------
 void loop()
 {
+    // Wait for the spectro::lyzer to finish its next measurement, only
+    // waking to poll it around when that's expected
+    dutyCycle.waitForMeasurement();
+
+    // Check the probe's clock every few hours, to keep up with its drift
+    if (probeClock.needsSync()) probeClock.sync();
+
     // Track how long the loop takes
     uint32_t startLoop = millis();
 
-    // Initialise the SD card
-    if (!sd.begin(SDCardPin, SPI_FULL_SPEED))
+    // The SD card is set up once, in setup(); starting it again here would
+    // lose the open files
+    if (!sdReady)
     {
         Serial.println(F("Error: SD card failed to initialize or is missing."));
         Serial.println(F("Data will not be saved!."));
@@ -328,17 +333,17 @@ void loop()
     {
 
         spectro.wakeSpec();
-        writeToFile(parFile, "par", parFileName);
-        writeToFile(fpFile0, "fp", fpFileName0, fingerprint);
+        writeToFile(parSink, "par");
+        writeToFile(fpSink0, "fp", fingerprint);
         if (isSpec)  // These fields don't exist in ana::pro
         {
-            writeToFile(fpFile1, "fp", fpFileName1, compensFP);
-            // writeToFile(fpFile2, "fp", fpFileName2, derivFP);
-            // writeToFile(fpFile3, "fp", fpFileName3, diff2oldorgFP);
-            // writeToFile(fpFile4, "fp", fpFileName4, transmission);
-            // writeToFile(fpFile5, "fp", fpFileName5, derivcompFP);
-            // writeToFile(fpFile6, "fp", fpFileName6, transmission10);
-            // writeToFile(fpFile7, "fp", fpFileName7, other);
+            writeToFile(fpSink1, "fp", compensFP);
+            // writeToFile(fpSink2, "fp", derivFP);
+            // writeToFile(fpSink3, "fp", diff2oldorgFP);
+            // writeToFile(fpSink4, "fp", transmission);
+            // writeToFile(fpSink5, "fp", derivcompFP);
+            // writeToFile(fpSink6, "fp", transmission10);
+            // writeToFile(fpSink7, "fp", other);
         }
     }
 
@@ -346,9 +351,4 @@ void loop()
     Serial.print(F("Writing to the SD card took "));
     Serial.print(millis() - startLoop);
     Serial.println("ms");
-
-
-    // Wait
-    delay(delay_ms - (millis() - startLoop));
-
 }
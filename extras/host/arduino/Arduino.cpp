@@ -0,0 +1,409 @@
+/*
+ *Arduino.cpp
+*/
+
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+
+
+//----------------------------------------------------------------------------
+//                              TIMING AND PINS
+//----------------------------------------------------------------------------
+
+static struct timespec monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+// This returns the monotonic time in microseconds since the program started
+// (or, really, since the first time it was asked for)
+static uint64_t elapsedMicros(void)
+{
+    static const struct timespec start = monotonicNow();
+    struct timespec now = monotonicNow();
+    return (uint64_t)(now.tv_sec - start.tv_sec)*1000000 +
+           (now.tv_nsec - start.tv_nsec)/1000;
+}
+
+// Like on a board, these roll over (after ~50 days and ~70 minutes)
+unsigned long millis(void) {return (uint32_t)(elapsedMicros()/1000);}
+unsigned long micros(void) {return (uint32_t)elapsedMicros();}
+
+void delay(unsigned long ms)
+{
+    struct timespec wait = {(time_t)(ms/1000), (long)(ms % 1000)*1000000L};
+    while (nanosleep(&wait, &wait) != 0) {}
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    struct timespec wait = {(time_t)(us/1000000), (long)(us % 1000000)*1000L};
+    while (nanosleep(&wait, &wait) != 0) {}
+}
+
+void yield(void) {sched_yield();}
+
+// The last values written to each pin
+static uint8_t pinValues[256];
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t val) {pinValues[pin] = val;}
+int digitalRead(uint8_t pin) {return pinValues[pin];}
+
+
+//----------------------------------------------------------------------------
+//                                  STRING
+//----------------------------------------------------------------------------
+
+String::String(const char *cstr) : _buffer(NULL), _capacity(0), _len(0)
+{
+    if (cstr == NULL) cstr = "";
+    append(cstr, strlen(cstr));
+}
+
+String::String(const String &str) : _buffer(NULL), _capacity(0), _len(0)
+{append(str._buffer, str._len);}
+
+String::String(char c) : _buffer(NULL), _capacity(0), _len(0)
+{append(&c, 1);}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long)value, base) {}
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) : _buffer(NULL), _capacity(0), _len(0)
+{
+    if (value < 0 && base == 10)
+    {
+        append("-", 1);
+        concat(String((unsigned long)-value, base));
+    }
+    else concat(String((unsigned long)value, base));
+}
+
+String::String(unsigned long value, unsigned char base) : _buffer(NULL), _capacity(0), _len(0)
+{
+    char buf[8*sizeof(unsigned long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2) base = 10;
+    do
+    {
+        unsigned long digit = value % base;
+        value /= base;
+        *--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    } while (value);
+    append(str, strlen(str));
+}
+
+String::String(float value, unsigned char decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned char decimalPlaces) : _buffer(NULL), _capacity(0), _len(0)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    append(buf, strlen(buf));
+}
+
+String::~String(void) {free(_buffer);}
+
+String &String::operator=(const String &rhs)
+{
+    if (this == &rhs) return *this;
+    _len = 0;
+    append(rhs._buffer, rhs._len);
+    return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr == NULL) cstr = "";
+    String copy(cstr);  // In case cstr points into this string
+    return *this = copy;
+}
+
+bool String::reserve(unsigned int size)
+{
+    if (_buffer != NULL && _capacity >= size) return true;
+    char *newBuffer = (char *)realloc(_buffer, size + 1);
+    if (newBuffer == NULL) return false;
+    if (_buffer == NULL) newBuffer[0] = '\0';
+    _buffer = newBuffer;
+    _capacity = size;
+    return true;
+}
+
+bool String::append(const char *cstr, unsigned int length)
+{
+    if (!reserve(_len + length)) return false;
+    memmove(_buffer + _len, cstr, length);
+    _len += length;
+    _buffer[_len] = '\0';
+    return true;
+}
+
+bool String::concat(const String &str)
+{
+    if (&str == this)
+    {
+        String copy(str);
+        return append(copy._buffer, copy._len);
+    }
+    return append(str._buffer, str._len);
+}
+bool String::concat(const char *cstr) {return cstr ? append(cstr, strlen(cstr)) : false;}
+bool String::concat(char c) {return append(&c, 1);}
+bool String::concat(unsigned char num) {return concat(String(num));}
+bool String::concat(int num) {return concat(String(num));}
+bool String::concat(unsigned int num) {return concat(String(num));}
+bool String::concat(long num) {return concat(String(num));}
+bool String::concat(unsigned long num) {return concat(String(num));}
+bool String::concat(float num) {return concat(String(num));}
+bool String::concat(double num) {return concat(String(num));}
+
+int String::compareTo(const String &s) const {return strcmp(_buffer, s._buffer);}
+
+bool String::startsWith(const String &prefix) const
+{return prefix._len <= _len && strncmp(_buffer, prefix._buffer, prefix._len) == 0;}
+
+bool String::endsWith(const String &suffix) const
+{return suffix._len <= _len && strcmp(_buffer + _len - suffix._len, suffix._buffer) == 0;}
+
+char String::charAt(unsigned int index) const
+{return index < _len ? _buffer[index] : 0;}
+
+void String::setCharAt(unsigned int index, char c)
+{if (index < _len) _buffer[index] = c;}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const
+{
+    if (bufsize == 0 || buf == NULL) return;
+    if (index >= _len)
+    {
+        buf[0] = 0;
+        return;
+    }
+    unsigned int n = bufsize - 1;
+    if (n > _len - index) n = _len - index;
+    memcpy(buf, _buffer + index, n);
+    buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+    if (fromIndex >= _len) return -1;
+    const char *found = strchr(_buffer + fromIndex, ch);
+    return found ? found - _buffer : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    if (fromIndex >= _len) return -1;
+    const char *found = strstr(_buffer + fromIndex, str._buffer);
+    return found ? found - _buffer : -1;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        unsigned int swap = endIndex;
+        endIndex = beginIndex;
+        beginIndex = swap;
+    }
+    String out;
+    if (beginIndex >= _len) return out;
+    if (endIndex > _len) endIndex = _len;
+    out.append(_buffer + beginIndex, endIndex - beginIndex);
+    return out;
+}
+
+void String::replace(char find, char replace)
+{for (unsigned int i = 0; i < _len; i++) if (_buffer[i] == find) _buffer[i] = replace;}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index >= _len) return;
+    if (count > _len - index) count = _len - index;
+    memmove(_buffer + index, _buffer + index + count, _len - index - count + 1);
+    _len -= count;
+}
+
+void String::toLowerCase(void)
+{for (unsigned int i = 0; i < _len; i++) _buffer[i] = tolower(_buffer[i]);}
+
+void String::toUpperCase(void)
+{for (unsigned int i = 0; i < _len; i++) _buffer[i] = toupper(_buffer[i]);}
+
+void String::trim(void)
+{
+    unsigned int begin = 0;
+    while (begin < _len && isspace(_buffer[begin])) begin++;
+    unsigned int end = _len;
+    while (end > begin && isspace(_buffer[end - 1])) end--;
+    memmove(_buffer, _buffer + begin, end - begin);
+    _len = end - begin;
+    _buffer[_len] = '\0';
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+
+//----------------------------------------------------------------------------
+//                              PRINT AND STREAM
+//----------------------------------------------------------------------------
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        if (write(*buffer++)) n++;
+        else break;
+    }
+    return n;
+}
+
+size_t Print::print(long n, int base)
+{
+    if (base == 0) return write((uint8_t)n);
+    if (base == 10 && n < 0) return print('-') + printNumber((unsigned long)-n, 10);
+    return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    if (base == 0) return write((uint8_t)n);
+    return printNumber(n, base);
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{return print(String(n, base));}
+
+// This prints a float the same way the Arduino core does
+size_t Print::printFloat(double number, uint8_t digits)
+{
+    if (isnan(number)) return print("nan");
+    if (isinf(number)) return print("inf");
+    if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+    return print(String(number, digits));
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = timedRead();
+        if (c < 0) break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+String Stream::readString(void)
+{
+    String out;
+    int c = timedRead();
+    while (c >= 0)
+    {
+        out += (char)c;
+        c = timedRead();
+    }
+    return out;
+}
+
+int Stream::timedRead(void)
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0) return c;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+int Stream::timedPeek(void)
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = peek();
+        if (c >= 0) return c;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+
+//----------------------------------------------------------------------------
+//                                 CONSOLE
+//----------------------------------------------------------------------------
+
+consoleStream Serial;
+
+int consoleStream::available(void)
+{
+    int waiting = 0;
+    if (ioctl(STDIN_FILENO, FIONREAD, &waiting) < 0) waiting = 0;
+    return waiting + (_peeked >= 0 ? 1 : 0);
+}
+
+int consoleStream::read(void)
+{
+    if (_peeked >= 0)
+    {
+        int c = _peeked;
+        _peeked = -1;
+        return c;
+    }
+    struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&input, 1, 0) <= 0) return -1;
+    unsigned char c;
+    if (::read(STDIN_FILENO, &c, 1) != 1) return -1;
+    return c;
+}
+
+int consoleStream::peek(void)
+{
+    if (_peeked < 0) _peeked = read();
+    return _peeked;
+}
+
+size_t consoleStream::write(uint8_t c) {return fwrite(&c, 1, 1, stdout);}
+
+size_t consoleStream::write(const uint8_t *buffer, size_t size)
+{return fwrite(buffer, 1, size, stdout);}
+
+void consoleStream::flush(void) {fflush(stdout);}
@@ -0,0 +1,258 @@
+/*
+ *Arduino.h
+ *
+ *This is a thin stand-in for the Arduino core so the library (and the
+ *SensorModbusMaster and Time libraries it depends on) can be built and run
+ *on a Linux computer.  It only has the parts of the Arduino API that those
+ *libraries and the examples use:  Print, Stream, String, timing, and pins.
+ *
+ *Pins don't exist on a computer, so pinMode and digitalWrite only remember
+ *the last value written.  Use an enable pin of -1 with the library and let
+ *the serial port (see posixSerial.h) handle RS-485 direction control.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Serial port configurations, with the same values as the AVR core
+#define SERIAL_8N1 0x06
+#define SERIAL_8N2 0x0E
+#define SERIAL_8E1 0x26
+#define SERIAL_8E2 0x2E
+#define SERIAL_8O1 0x36
+#define SERIAL_8O2 0x3E
+
+// There is no flash memory to put strings in on a computer
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#define F(string_literal) (string_literal)
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bit(b) (1UL << (b))
+
+// These are templates rather than the usual macros so they don't clash with
+// the C++ standard library
+template<class T, class U> inline T min(T a, U b) {return (b < a) ? b : a;}
+template<class T, class U> inline T max(T a, U b) {return (a < b) ? b : a;}
+template<class T> inline T constrain(T x, T low, T high)
+{return x < low ? low : (x > high ? high : x);}
+template<class T> inline T sq(T x) {return x*x;}
+
+inline uint16_t word(uint16_t w) {return w;}
+inline uint16_t word(uint8_t h, uint8_t l) {return ((uint16_t)h << 8) | l;}
+
+// Timing, counted from when the program started
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+// Pins only remember the last value written to them
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+
+//----------------------------------------------------------------------------
+//                                  STRING
+//----------------------------------------------------------------------------
+class String
+{
+public:
+    String(const char *cstr = "");
+    String(const String &str);
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(float value, unsigned char decimalPlaces = 2);
+    explicit String(double value, unsigned char decimalPlaces = 2);
+    ~String(void);
+
+    String &operator=(const String &rhs);
+    String &operator=(const char *cstr);
+
+    bool reserve(unsigned int size);
+    unsigned int length(void) const {return _len;}
+    const char *c_str(void) const {return _buffer;}
+
+    bool concat(const String &str);
+    bool concat(const char *cstr);
+    bool concat(char c);
+    bool concat(unsigned char num);
+    bool concat(int num);
+    bool concat(unsigned int num);
+    bool concat(long num);
+    bool concat(unsigned long num);
+    bool concat(float num);
+    bool concat(double num);
+    template<class T> String &operator+=(T rhs) {concat(rhs); return *this;}
+
+    int compareTo(const String &s) const;
+    bool equals(const String &s) const {return compareTo(s) == 0;}
+    bool equals(const char *cstr) const {return strcmp(_buffer, cstr ? cstr : "") == 0;}
+    bool operator==(const String &rhs) const {return equals(rhs);}
+    bool operator==(const char *cstr) const {return equals(cstr);}
+    bool operator!=(const String &rhs) const {return !equals(rhs);}
+    bool operator!=(const char *cstr) const {return !equals(cstr);}
+    bool operator<(const String &rhs) const {return compareTo(rhs) < 0;}
+    bool startsWith(const String &prefix) const;
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char c);
+    char operator[](unsigned int index) const {return charAt(index);}
+    void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const;
+    void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const
+    {getBytes((unsigned char *)buf, bufsize, index);}
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String &str, unsigned int fromIndex = 0) const;
+    String substring(unsigned int beginIndex) const {return substring(beginIndex, _len);}
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(char find, char replace);
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+    void toLowerCase(void);
+    void toUpperCase(void);
+    void trim(void);
+
+    long toInt(void) const {return atol(_buffer);}
+    float toFloat(void) const {return (float)atof(_buffer);}
+    double toDouble(void) const {return atof(_buffer);}
+
+private:
+    char *_buffer;
+    unsigned int _capacity;
+    unsigned int _len;
+    bool append(const char *cstr, unsigned int length);
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+
+
+//----------------------------------------------------------------------------
+//                              PRINT AND STREAM
+//----------------------------------------------------------------------------
+class Print
+{
+public:
+    virtual ~Print(void) {}
+
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) {return str ? write((const uint8_t *)str, strlen(str)) : 0;}
+    size_t write(const char *buffer, size_t size) {return write((const uint8_t *)buffer, size);}
+    virtual void flush(void) {}
+
+    size_t print(const String &s) {return write(s.c_str(), s.length());}
+    size_t print(const char str[]) {return write(str);}
+    size_t print(char c) {return write((uint8_t)c);}
+    size_t print(unsigned char n, int base = DEC) {return print((unsigned long)n, base);}
+    size_t print(int n, int base = DEC) {return print((long)n, base);}
+    size_t print(unsigned int n, int base = DEC) {return print((unsigned long)n, base);}
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2) {return printFloat(n, digits);}
+
+    size_t println(void) {return write("\r\n");}
+    template<class T> size_t println(T value) {size_t n = print(value); return n + println();}
+    template<class T> size_t println(T value, int format)
+    {size_t n = print(value, format); return n + println();}
+
+    int getWriteError(void) {return _writeError;}
+    void clearWriteError(void) {_writeError = 0;}
+
+protected:
+    void setWriteError(int error = 1) {_writeError = error;}
+
+private:
+    size_t printNumber(unsigned long n, uint8_t base);
+    size_t printFloat(double number, uint8_t digits);
+
+    int _writeError = 0;
+};
+
+class Stream : public Print
+{
+public:
+    Stream(void) : _timeout(1000) {}
+
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+
+    // This sets the longest time to wait for each character in readBytes()
+    void setTimeout(unsigned long timeout) {_timeout = timeout;}
+    unsigned long getTimeout(void) {return _timeout;}
+
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) {return readBytes((char *)buffer, length);}
+    String readString(void);
+
+protected:
+    // These wait up to the timeout for a character
+    // Streams that can wait without spinning (like posixSerial) replace them.
+    virtual int timedRead(void);
+    virtual int timedPeek(void);
+
+    unsigned long _timeout;
+};
+
+
+//----------------------------------------------------------------------------
+//                                 CONSOLE
+//----------------------------------------------------------------------------
+// "Serial" is the terminal the program was started from
+class consoleStream : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end(void) {}
+    operator bool(void) {return true;}
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush(void);
+
+private:
+    int _peeked = -1;
+};
+
+extern consoleStream Serial;
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *Client.h
+ *
+ *The Arduino network client interface, as implemented by EthernetClient,
+ *WiFiClient, and (on a computer) posixClient
+*/
+
+#ifndef Client_h
+#define Client_h
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+class Client : public Stream
+{
+public:
+    // These return 1 when connected
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int read(uint8_t *buf, size_t size) = 0;
+    virtual int peek(void) = 0;
+    virtual void flush(void) = 0;
+    virtual void stop(void) = 0;
+    virtual uint8_t connected(void) = 0;
+    virtual operator bool(void) = 0;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ *IPAddress.h
+ *
+ *The Arduino IPv4 address, for the Client stand-in
+*/
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+
+class IPAddress
+{
+public:
+    IPAddress(void) {_address.dword = 0;}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+    {
+        _address.bytes[0] = first;
+        _address.bytes[1] = second;
+        _address.bytes[2] = third;
+        _address.bytes[3] = fourth;
+    }
+    // The address in network byte order, as in a sockaddr_in
+    IPAddress(uint32_t address) {_address.dword = address;}
+
+    operator uint32_t(void) const {return _address.dword;}
+    uint8_t operator[](int index) const {return _address.bytes[index];}
+    uint8_t &operator[](int index) {return _address.bytes[index];}
+    bool operator==(const IPAddress &addr) const {return _address.dword == addr._address.dword;}
+
+private:
+    union
+    {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } _address;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*****************************************************************************
+decodePayload.cpp
+
+This unpacks the compact payloads made by scanPayloadEncoder, one per line
+of hex on standard input, and prints each as a tab separated row of the
+time, the device status, and the value and status of every parameter.
+
+The precision and lower limit of each parameter must be the same as the
+logger used; give them in order as precision:lowerLimit.  Parameters that
+aren't given are kept to 3 decimal places above 0.
+
+Usage:
+    decodePayload [precision:lowerLimit ...] < payloads.txt
+ie:
+    echo 410180e2cfaa060003a8138820ee3a | decodePayload 2:0 1:0 3:-5
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <scanPayload.h>
+
+#include <ctype.h>
+#include <stdio.h>
+
+// This converts a line of hex to bytes; returns the number of bytes
+static int fromHex(const char *line, byte *buffer, int size)
+{
+    int length = 0;
+    int nibbles = 0;
+    byte value = 0;
+    for (; *line; line++)
+    {
+        if (!isxdigit((unsigned char)*line)) continue;
+        value = (value << 4) | (isdigit((unsigned char)*line) ? *line - '0' : (tolower(*line) - 'a' + 10));
+        if (++nibbles % 2 == 0)
+        {
+            if (length == size) return -1;
+            buffer[length++] = value;
+            value = 0;
+        }
+    }
+    return nibbles % 2 == 0 ? length : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    scanPayloadDecoder decoder;
+    for (int i = 1; i < argc; i++)
+    {
+        int precision;
+        float lowerLimit;
+        if (sscanf(argv[i], "%d:%f", &precision, &lowerLimit) != 2)
+        {
+            printf("Usage: %s [precision:lowerLimit ...] < payloads.txt\n", argv[0]);
+            return 1;
+        }
+        decoder.setScale(i, precision, lowerLimit);
+    }
+
+    char line[4*PAYLOAD_MAX_LENGTH];
+    byte payload[PAYLOAD_MAX_LENGTH];
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        int length = fromHex(line, payload, sizeof(payload));
+        if (length <= 0) continue;
+        parameterSnapshot snapshot;
+        if (!decoder.decode(payload, length, snapshot))
+        {
+            printf("Unable to decode %s", line);
+            continue;
+        }
+        printf("%lu\t%u", (unsigned long)snapshot.time, snapshot.deviceStatus);
+        for (int i = 0; i < snapshot.count; i++)
+            printf("\t%g\t%u", snapshot.value[i], snapshot.status[i]);
+        printf("\n");
+    }
+    return 0;
+}
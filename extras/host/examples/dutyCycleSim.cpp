@@ -0,0 +1,164 @@
+/*****************************************************************************
+dutyCycleSim.cpp
+
+This runs scanMeasurementTracker and scanDutyCycle against a pretend
+spectro::lyzer on a simulated clock, so hours of measurements take seconds
+and the polling and sleeping can be checked without a device.
+
+The pretend device starts a measurement every interval, is busy for the
+measurement time, and then shows the new sample time.  Every request it
+answers takes up REQUEST_TIME ms of the simulated clock, and it won't answer
+while the transceiver is powered off.  The sleep function just moves the
+clock forward.  Each measurement is printed with how late it was read and
+how many polls it took, and the duty ratio is printed at the end.
+
+Usage:
+    dutyCycleSim [interval s] [measurement time s] [measurements]
+ie:
+    dutyCycleSim 120 40 30
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <scanDutyCycle.h>
+#include <scanRTU.h>
+
+#include <stdio.h>
+
+#define POWER_PIN 22
+#define REQUEST_TIME 30  // ms of the simulated clock per request
+#define START_TIME 1700000000UL  // The device's clock when the simulation starts
+#define FIRST_START 37  // When the first measurement starts (s)
+
+static unsigned long simulatedTime = 0;  // ms
+static uint32_t measInterval = 120;  // s
+static uint32_t measTime = 40;  // s
+
+static unsigned long simulatedMillis(void) {return simulatedTime;}
+static void simulatedSleep(unsigned long ms) {simulatedTime += ms;}
+
+// This returns when the latest finished measurement started, in simulated
+// seconds, or -1 if none has finished yet; busy is set if one is under way
+static long lastFinished(bool &busy)
+{
+    long now = simulatedTime/1000;
+    busy = false;
+    if (now < FIRST_START) return -1;
+    long start = FIRST_START + (now - FIRST_START)/measInterval*measInterval;
+    if (now - start < (long)measTime)
+    {
+        busy = true;
+        start -= measInterval;
+    }
+    return start < FIRST_START ? -1 : start;
+}
+
+// This is the pretend device, on the other end of the "serial port"
+class simulatedProbe : public Stream
+{
+public:
+    int available(void) {return _replyLength - _replyPosition;}
+    int read(void) {return available() > 0 ? _reply[_replyPosition++] : -1;}
+    int peek(void) {return available() > 0 ? _reply[_replyPosition] : -1;}
+
+    size_t write(uint8_t c)
+    {
+        if (_requestLength == sizeof(_request)) _requestLength = 0;
+        _request[_requestLength++] = c;
+        if (_requestLength == 8) answer();
+        return 1;
+    }
+    using Print::write;
+
+private:
+    // Only reads are answered, and only while the transceiver is on
+    void answer(void)
+    {
+        _requestLength = 0;
+        _replyPosition = 0;
+        _replyLength = 0;
+        if (!scanRTU::checkCRC(_request, 8) || digitalRead(POWER_PIN) != HIGH) return;
+        byte function = _request[1];
+        uint16_t start = word(_request[2], _request[3]);
+        uint16_t count = word(_request[4], _request[5]);
+        if ((function != 0x03 && function != 0x04) || count > 125) return;
+        simulatedTime += REQUEST_TIME;
+
+        _reply[_replyLength++] = _request[0];
+        _reply[_replyLength++] = function;
+        _reply[_replyLength++] = 2*count;
+        for (uint16_t reg = start; reg < start + count; reg++)
+        {
+            uint16_t value = registerValue(function, reg);
+            _reply[_replyLength++] = highByte(value);
+            _reply[_replyLength++] = lowByte(value);
+        }
+        _replyLength = scanRTU::appendCRC(_reply, _replyLength);
+    }
+
+    // Everything not simulated reads as 0
+    uint16_t registerValue(byte function, uint16_t reg)
+    {
+        if (function == 0x03)
+            return reg == holdingReg::uiMeasInterval.at() ? measInterval : 0;
+
+        bool busy;
+        long finished = lastFinished(busy);
+        uint32_t sampleTime = finished < 0 ? 0 : START_TIME + finished;
+        // TAI64N sample time: 2^62 + seconds since 1970, then nanoseconds
+        int offset = reg - inputReg::tSampleTime.at();
+        if (offset == 0) return sampleTime ? 0x4000 : 0;
+        if (offset == 2) return sampleTime >> 16;
+        if (offset == 3) return sampleTime & 0xFFFF;
+        if (reg == inputReg::bmDeviceStatus.at()) return busy ? DEVICE_BUSY : 0;
+        return 0;
+    }
+
+    byte _request[8];
+    int _requestLength = 0;
+    byte _reply[5 + 2*125];
+    int _replyLength = 0;
+    int _replyPosition = 0;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) measInterval = strtoul(argv[1], NULL, 0);
+    if (argc > 2) measTime = strtoul(argv[2], NULL, 0);
+    int measurements = argc > 3 ? atoi(argv[3]) : 30;
+    if (measInterval == 0 || measTime >= measInterval || measurements <= 0)
+    {
+        printf("Usage: %s [interval s] [measurement time s] [measurements]\n", argv[0]);
+        return 1;
+    }
+
+    simulatedProbe probe;
+    scan spectro;
+    scanMeasurementTracker tracker(spectro, simulatedMillis);
+    scanDutyCycle dutyCycle(tracker, simulatedSleep, simulatedMillis);
+    dutyCycle.setPowerPin(POWER_PIN);
+    spectro.begin(0x04, probe, -1);
+    dutyCycle.begin();
+
+    printf("time (s)\tsample time\tlate (ms)\tpolls\tlocked\n");
+    uint32_t lastPolls = 0;
+    for (int i = 0; i < measurements; i++)
+    {
+        if (!dutyCycle.waitForMeasurement(3*measInterval*1000))
+        {
+            printf("No measurement within %lu s\n", 3UL*measInterval);
+            return 1;
+        }
+        // How long since the measurement finished
+        uint32_t finished = (tracker.getParameterTime() - START_TIME + measTime)*1000;
+        printf("%.1f\t%lu\t%lu\t%lu\t%s\n", simulatedTime/1000.0,
+               (unsigned long)tracker.getParameterTime(),
+               (unsigned long)(simulatedTime - finished),
+               (unsigned long)(tracker.getPollCount() - lastPolls),
+               tracker.isLocked() ? "yes" : "no");
+        lastPolls = tracker.getPollCount();
+    }
+    printf("Awake %lu ms, asleep %lu ms, duty ratio %.4f\n",
+           (unsigned long)dutyCycle.getAwakeTime(), (unsigned long)dutyCycle.getAsleepTime(),
+           dutyCycle.getDutyRatio());
+    return 0;
+}
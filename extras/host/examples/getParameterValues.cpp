@@ -0,0 +1,87 @@
+/*****************************************************************************
+getParameterValues.cpp
+
+This is the GetParameterValues example for a Linux computer with a USB
+RS-485 adapter:  it prints the spectro::lyzer setup and then the parameter
+values after every measurement.
+
+Usage:
+    getParameterValues <device> [modbus address] [baud rate]
+ie:
+    getParameterValues /dev/ttyUSB0 4 38400
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <posixSerial.h>
+#include <scanModbus.h>
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <device> [modbus address] [baud rate]\n", argv[0]);
+        return 1;
+    }
+    byte specModbusAddress = argc > 2 ? strtol(argv[2], NULL, 0) : 0x04;
+    unsigned long baud = argc > 3 ? strtoul(argv[3], NULL, 0) : 38400;
+
+    // The default is 38400 baud, 8 data bits, odd parity, 1 stop bit
+    posixSerial port(argv[1]);
+    if (!port.begin(baud, SERIAL_8O1))
+    {
+        printf("Unable to open %s at %lu baud\n", argv[1], baud);
+        return 1;
+    }
+
+    // The adapter (or the kernel) controls the RS-485 direction, so there is
+    // no enable pin
+    scan spectro;
+    spectro.begin(specModbusAddress, port, -1);
+    // spectro.setDebugStream(&Serial);
+
+    Serial.println("S::CAN Spect::lyzer Data Recording");
+    spectro.printSetup(Serial);
+
+    uint32_t lastTime = 0;
+    while (true)
+    {
+        // Wait for a new measurement
+        uint32_t paramTime = spectro.getParameterTime();
+        if (paramTime == 0 || paramTime == lastTime)
+        {
+            delay(1000);
+            continue;
+        }
+        lastTime = paramTime;
+
+        Serial.println("=================");
+        uint16_t status = spectro.getDeviceStatus();
+        Serial.print("Current device status is: ");
+        Serial.println(status, BIN);
+        spectro.printDeviceStatus(status, Serial);
+
+        Serial.print("Last sample was taken at ");
+        Serial.print((unsigned long)paramTime);
+        Serial.println(" seconds past Jan 1, 1970");
+
+        for (int i = 1; i < spectro.getParameterCount()+1; i++)
+        {
+            Serial.println("----");
+            Serial.print("Parameter number ");
+            Serial.print(i);
+            Serial.print(" is: ");
+            Serial.print(spectro.getParameterName(i));
+            Serial.print(" which currently has a value of ");
+            Serial.print(spectro.getParameterValue(i));
+            Serial.print(" ");
+            Serial.print(spectro.getParameterUnits(i));
+            Serial.print(" and status code ");
+            uint16_t parm_status = spectro.getParameterStatus(i);
+            Serial.println(parm_status, BIN);
+            spectro.printParameterStatus(parm_status, Serial);
+        }
+        Serial.flush();
+    }
+}
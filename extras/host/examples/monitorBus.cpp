@@ -0,0 +1,61 @@
+/*****************************************************************************
+monitorBus.cpp
+
+This listens to the traffic between some other modbus master (ie, a
+con::cube or PLC) and the spectro::lyzer, without sending anything, and
+prints a tab separated row of the time, the device status, and the value
+and status of every parameter each time the master reads a measurement.
+
+Usage:
+    monitorBus <device> [modbus address] [baud rate]
+ie:
+    monitorBus /dev/ttyUSB0 4 38400
+The modbus address only picks out one device's traffic; leave it out (or
+give 0) for all of them.
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <posixSerial.h>
+#include <scanBusMonitor.h>
+
+#include <stdio.h>
+
+// This prints each snapshot the master reads
+static void printSnapshot(byte slaveID, const parameterSnapshot &snapshot, void *)
+{
+    printf("%u\t%lu\t%u", slaveID, (unsigned long)snapshot.time, snapshot.deviceStatus);
+    for (int i = 0; i < snapshot.count; i++)
+        printf("\t%g\t%u", snapshot.value[i], snapshot.status[i]);
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <device> [modbus address] [baud rate]\n", argv[0]);
+        return 1;
+    }
+    byte specModbusAddress = argc > 2 ? strtol(argv[2], NULL, 0) : 0;
+    unsigned long baud = argc > 3 ? strtoul(argv[3], NULL, 0) : 38400;
+
+    // The default is 38400 baud, 8 data bits, odd parity, 1 stop bit
+    posixSerial port(argv[1]);
+    if (!port.begin(baud, SERIAL_8O1))
+    {
+        printf("Unable to open %s at %lu baud\n", argv[1], baud);
+        return 1;
+    }
+
+    scanBusMonitor monitor(port, baud);
+    monitor.setSlaveID(specModbusAddress);
+    monitor.setSnapshotCallback(printSnapshot);
+
+    // Check the port often enough to see the gaps between frames
+    while (true)
+    {
+        monitor.task();
+        delayMicroseconds(200);
+    }
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+pollPorts.cpp
+
+This polls any number of spectro::lyzers on any number of serial ports and
+prints every new measurement as a line of comma separated values:
+    received time, port, modbus address, sample time, device status, values...
+
+Usage:
+    pollPorts [-b baud] [-i seconds] <device>[:address,address...] ...
+ie:
+    pollPorts -i 10 /dev/ttyUSB0:4,5 /dev/ttyUSB1
+The address defaults to 4.
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <scanPoller.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopping = 0;
+static void onSignal(int) {stopping = 1;}
+
+int main(int argc, char *argv[])
+{
+    unsigned long baud = 38400;
+    uint32_t intervalSeconds = 5;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:i:")) != -1)
+    {
+        if (opt == 'b') baud = strtoul(optarg, NULL, 0);
+        else if (opt == 'i') intervalSeconds = strtoul(optarg, NULL, 0);
+        else
+        {
+            printf("Usage: %s [-b baud] [-i seconds] <device>[:address,address...] ...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        printf("Usage: %s [-b baud] [-i seconds] <device>[:address,address...] ...\n", argv[0]);
+        return 1;
+    }
+
+    static scanPoller poller;  // This is big, so it doesn't go on the stack
+    poller.setPollInterval(intervalSeconds*1000);
+    for (int a = optind; a < argc; a++)
+    {
+        char device[64];
+        strncpy(device, argv[a], sizeof(device) - 1);
+        device[sizeof(device) - 1] = '\0';
+        char *addresses = strchr(device, ':');
+        if (addresses != NULL) *addresses++ = '\0';
+
+        int port = poller.addPort(device, baud, SERIAL_8O1);
+        if (port < 0)
+        {
+            printf("Too many ports\n");
+            return 1;
+        }
+        if (addresses == NULL) poller.addDevice(port, 0x04);
+        else
+        {
+            for (char *id = strtok(addresses, ","); id != NULL; id = strtok(NULL, ","))
+                poller.addDevice(port, strtol(id, NULL, 0));
+        }
+    }
+
+    if (!poller.start())
+    {
+        printf("Unable to open the serial ports\n");
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    measurementRecord record;
+    while (!stopping)
+    {
+        if (!poller.waitForRecord(record, 500)) continue;
+        printf("%lu,%d,%d,%lu,%u", (unsigned long)record.receivedAt, record.port,
+               record.slaveID, (unsigned long)record.snapshot.time, record.snapshot.deviceStatus);
+        for (int i = 0; i < record.snapshot.count; i++) printf(",%g", record.snapshot.value[i]);
+        printf("\n");
+        fflush(stdout);
+    }
+    poller.stop();
+    return 0;
+}
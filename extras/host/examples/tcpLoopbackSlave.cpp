@@ -0,0 +1,259 @@
+/*****************************************************************************
+tcpLoopbackSlave.cpp
+
+This is a pretend spectro::lyzer on a Modbus TCP port, for trying out (and
+timing) scanModbusTCP without a real device.  It answers reads of holding
+and input registers and writes of holding registers.  The fingerprint
+registers of all 8 spectral sources hold smooth made-up spectra, and the
+model, serial number, and sample time are filled in.
+
+Any number of requests can be waiting at once.  Each reply is held back by
+the given latency (to act like a slow network or gateway) without holding
+up the requests behind it, the same as a real Modbus TCP gateway.
+
+Usage:
+    tcpLoopbackSlave [-p port] [-l latency ms] [-u unit ID]
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <scanRegisterMap.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define MAX_CLIENTS 8
+#define MAX_WAITING 32  // Replies being held back, per client
+#define MAX_FRAME 260
+
+static uint16_t holding[65536];
+static uint16_t input[65536];
+
+struct heldReply
+{
+    uint32_t sendAt;
+    int length;
+    uint8_t frame[MAX_FRAME];
+};
+
+struct connection
+{
+    int fd;
+    uint8_t rx[MAX_FRAME];
+    int rxLength;
+    heldReply waiting[MAX_WAITING];
+    int waitingCount;
+};
+
+static void putString(uint16_t *regs, const scanRegister &reg, const char *text)
+{
+    for (int i = 0; i < reg.length; i++)
+    {
+        char hi = text[0] ? *text++ : 0;
+        char lo = text[0] ? *text++ : 0;
+        regs[reg.at() + i] = ((uint8_t)hi << 8) | (uint8_t)lo;
+    }
+}
+
+static void putFloat(uint16_t *regs, int reg, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    regs[reg] = bits >> 16;
+    regs[reg + 1] = bits & 0xFFFF;
+}
+
+// This makes up a spectro::lyzer's worth of register values
+static void fillRegisters(void)
+{
+    input[inputReg::eModel.at()] = 0x0101;
+    putString(input, inputReg::abModel, "spectro::lyser V3");
+    putString(input, inputReg::abSerialNumber, "12345678");
+    // TAI64N sample time: 2^62 + seconds since 1970
+    uint32_t now = 1700000000UL;
+    input[inputReg::tSampleTime.at()] = 0x4000;
+    input[inputReg::tSampleTime.at() + 2] = now >> 16;
+    input[inputReg::tSampleTime.at() + 3] = now & 0xFFFF;
+    const scanRegister &fp = inputReg::fFingerprintData;
+    for (int source = 0; source < 8; source++)
+        for (int i = 0; i < fp.count(); i++)
+            putFloat(input, fp.at(source) + i*fp.width(), (10 + source)*exp(-i/60.0));
+}
+
+// This builds the reply to one request (the part after the MBAP header)
+// Returns the length of the PDU.
+static int answer(uint8_t unitID, const uint8_t *request, uint8_t myUnitID, uint8_t *reply)
+{
+    uint8_t function = request[0];
+    uint16_t start = (request[1] << 8) | request[2];
+    uint16_t count = (request[3] << 8) | request[4];
+    if (unitID != myUnitID && unitID != 0xFF)
+    {
+        reply[0] = function | 0x80;
+        reply[1] = 0x0B;  // Gateway target device failed to respond
+        return 2;
+    }
+    if ((function == 0x03 || function == 0x04) && count >= 1 && count <= 125)
+    {
+        uint16_t *regs = function == 0x03 ? holding : input;
+        reply[0] = function;
+        reply[1] = 2*count;
+        for (int i = 0; i < count; i++)
+        {
+            uint16_t value = regs[(uint16_t)(start + i)];
+            reply[2 + 2*i] = value >> 8;
+            reply[3 + 2*i] = value & 0xFF;
+        }
+        return 2 + 2*count;
+    }
+    if (function == 0x06)
+    {
+        holding[start] = count;  // For a single write, this is the value
+        memcpy(reply, request, 5);
+        return 5;
+    }
+    if (function == 0x10)
+    {
+        for (int i = 0; i < count; i++)
+            holding[(uint16_t)(start + i)] = (request[6 + 2*i] << 8) | request[7 + 2*i];
+        memcpy(reply, request, 5);
+        return 5;
+    }
+    reply[0] = function | 0x80;
+    reply[1] = 0x01;  // Illegal function
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 5020;
+    uint32_t latency = 0;
+    uint8_t unitID = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:l:u:")) != -1)
+    {
+        if (opt == 'p') port = strtoul(optarg, NULL, 0);
+        else if (opt == 'l') latency = strtoul(optarg, NULL, 0);
+        else if (opt == 'u') unitID = strtoul(optarg, NULL, 0);
+        else
+        {
+            printf("Usage: %s [-p port] [-l latency ms] [-u unit ID]\n", argv[0]);
+            return 1;
+        }
+    }
+    fillRegisters();
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 4) != 0)
+    {
+        printf("Unable to listen on port %u\n", port);
+        return 1;
+    }
+    printf("Listening on 127.0.0.1:%u as unit %u with %lu ms latency\n", port, unitID,
+           (unsigned long)latency);
+    fflush(stdout);
+
+    static connection clients[MAX_CLIENTS];
+    for (int c = 0; c < MAX_CLIENTS; c++) clients[c].fd = -1;
+
+    while (true)
+    {
+        // Wait for something to read or the next held reply to be due
+        struct pollfd fds[MAX_CLIENTS + 1];
+        int timeout = -1;
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (int c = 0; c < MAX_CLIENTS; c++)
+        {
+            fds[c + 1].fd = clients[c].fd;
+            fds[c + 1].events = POLLIN;
+            for (int w = 0; w < clients[c].waitingCount; w++)
+            {
+                int32_t due = (int32_t)(clients[c].waiting[w].sendAt - millis());
+                if (due < 0) due = 0;
+                if (timeout < 0 || due < timeout) timeout = due;
+            }
+        }
+        poll(fds, MAX_CLIENTS + 1, timeout);
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listener, NULL, NULL);
+            int c = 0;
+            while (c < MAX_CLIENTS && clients[c].fd >= 0) c++;
+            if (c == MAX_CLIENTS) close(fd);
+            else if (fd >= 0)
+            {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                clients[c].fd = fd;
+                clients[c].rxLength = 0;
+                clients[c].waitingCount = 0;
+            }
+        }
+
+        for (int c = 0; c < MAX_CLIENTS; c++)
+        {
+            connection &client = clients[c];
+            if (client.fd < 0) continue;
+
+            // Read and answer every whole request
+            if (fds[c + 1].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                ssize_t n = recv(client.fd, client.rx + client.rxLength,
+                                 MAX_FRAME - client.rxLength, 0);
+                if (n <= 0)
+                {
+                    close(client.fd);
+                    client.fd = -1;
+                    continue;
+                }
+                client.rxLength += n;
+            }
+            while (client.rxLength >= 6)
+            {
+                int frameLength = 6 + ((client.rx[4] << 8) | client.rx[5]);
+                if (frameLength > MAX_FRAME || frameLength < 8)
+                {
+                    client.rxLength = 0;  // Garbage
+                    break;
+                }
+                if (client.rxLength < frameLength || client.waitingCount == MAX_WAITING) break;
+                heldReply &reply = client.waiting[client.waitingCount++];
+                memcpy(reply.frame, client.rx, 4);  // Same transaction and protocol IDs
+                reply.frame[6] = client.rx[6];
+                int pduLength = answer(client.rx[6], client.rx + 7, unitID, reply.frame + 7);
+                reply.frame[4] = (pduLength + 1) >> 8;
+                reply.frame[5] = (pduLength + 1) & 0xFF;
+                reply.length = 7 + pduLength;
+                reply.sendAt = millis() + latency;
+                memmove(client.rx, client.rx + frameLength, client.rxLength - frameLength);
+                client.rxLength -= frameLength;
+            }
+
+            // Send the replies that are due, oldest first
+            for (int w = 0; w < client.waitingCount;)
+            {
+                if ((int32_t)(client.waiting[w].sendAt - millis()) > 0)
+                {
+                    w++;
+                    continue;
+                }
+                send(client.fd, client.waiting[w].frame, client.waiting[w].length, MSG_NOSIGNAL);
+                for (int x = w; x < client.waitingCount - 1; x++) client.waiting[x] = client.waiting[x + 1];
+                client.waitingCount--;
+            }
+        }
+    }
+}
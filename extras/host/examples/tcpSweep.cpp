@@ -0,0 +1,87 @@
+/*****************************************************************************
+tcpSweep.cpp
+
+This reads the fingerprints of all 8 spectral sources over Modbus TCP, once
+a request at a time (as over a serial line) and once with several requests
+waiting for replies at once, and prints how long each took.
+
+Try it against the pretend spectro::lyzer with some network latency:
+    tcpLoopbackSlave -l 20 &
+    tcpSweep 127.0.0.1 5020
+
+Usage:
+    tcpSweep <host> [port] [unit ID]
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <posixClient.h>
+#include <scanModbus.h>
+#include <scanModbusTCP.h>
+
+#include <stdio.h>
+
+// These add up the values, to check that both ways get the same thing
+static double sums[8];
+static int counts[8];
+
+static void addValue(int, float, float value, void *context)
+{
+    int source = *(int*)context;
+    sums[source] += value;
+    counts[source]++;
+}
+
+static void addSweepValue(spectralSource source, int, float, float value, void *)
+{
+    sums[source] += value;
+    counts[source]++;
+}
+
+static void printTotals(const char *label, uint32_t ms, uint32_t requests)
+{
+    printf("%-12s %5lu ms  %3lu requests  ", label, (unsigned long)ms, (unsigned long)requests);
+    for (int source = 0; source < 8; source++)
+    {
+        printf(" %d:%.1f", counts[source], sums[source]);
+        sums[source] = 0;
+        counts[source] = 0;
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <host> [port] [unit ID]\n", argv[0]);
+        return 1;
+    }
+    uint16_t port = argc > 2 ? strtoul(argv[2], NULL, 0) : MODBUS_TCP_PORT;
+    byte unitID = argc > 3 ? strtoul(argv[3], NULL, 0) : 0x04;
+
+    posixClient client;
+    scanModbusTCP transport(client);
+    if (!transport.connect(argv[1], port))
+    {
+        printf("Unable to connect to %s:%u\n", argv[1], port);
+        return 1;
+    }
+
+    scan spectro;
+    spectro.begin(unitID, transport);
+    Serial.print("Model: ");
+    Serial.println(spectro.getModel());
+    Serial.flush();
+
+    uint32_t requests = transport.getRequestCount();
+    uint32_t start = millis();
+    for (int source = 0; source < 8; source++)
+        spectro.getFingerprintData(addValue, &source, (spectralSource)source);
+    printTotals("one at a time", millis() - start, transport.getRequestCount() - requests);
+
+    requests = transport.getRequestCount();
+    start = millis();
+    if (!spectro.getFingerprintSweep(transport, addSweepValue)) printf("Sweep failed\n");
+    printTotals("pipelined", millis() - start, transport.getRequestCount() - requests);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*****************************************************************************
+traceSession.cpp
+
+This records a short session with a spectro::lyzer (the parameter values and
+the fingerprints of all 8 spectral sources) to a trace file, and plays it
+back later without the device, getting the same replies every time.
+Playing it back with a time scale of 0 has every reply waiting as soon as
+it's asked for, so the device's own delays drop out of the timing; a scale
+of 1 takes as long as the real device did.
+
+Usage:
+    traceSession record <device> <trace file> [modbus address] [baud rate]
+    traceSession replay <trace file> [time scale] [modbus address]
+ie:
+    traceSession record /dev/ttyUSB0 session.trace 4 38400
+    traceSession replay session.trace 0
+*****************************************************************************/
+
+#include <Arduino.h>
+#include <posixSerial.h>
+#include <scanModbus.h>
+#include <scanTrace.h>
+
+#include <stdio.h>
+
+// A file to write the trace to
+class filePrint : public Print
+{
+public:
+    filePrint(FILE *file) {_file = file;}
+    size_t write(uint8_t c) {return fputc(c, _file) == EOF ? 0 : 1;}
+    size_t write(const uint8_t *buffer, size_t size) {return fwrite(buffer, 1, size, _file);}
+    using Print::write;
+private:
+    FILE *_file;
+};
+
+// A file to read the trace from
+class fileStream : public Stream
+{
+public:
+    fileStream(FILE *file)
+    {
+        _file = file;
+        fseek(_file, 0, SEEK_END);
+        _size = ftell(_file);
+        rewind(_file);
+    }
+    int available(void) {return _size - ftell(_file);}
+    int read(void) {return fgetc(_file);}
+    int peek(void)
+    {
+        int c = fgetc(_file);
+        if (c != EOF) ungetc(c, _file);
+        return c;
+    }
+    size_t write(uint8_t) {return 0;}
+    using Print::write;
+private:
+    FILE *_file;
+    long _size;
+};
+
+// This adds up the fingerprint values, to check the replay got the same thing
+static double fingerprintSum;
+static int fingerprintCount;
+static void addValue(int, float, float value, void *)
+{
+    fingerprintSum += value;
+    fingerprintCount++;
+}
+
+// This is the session that's recorded and replayed
+static void runSession(scan &spectro)
+{
+    uint32_t start = micros();
+    Serial.print("Model: ");
+    Serial.println(spectro.getModel());
+    Serial.print("Last sample was taken at ");
+    Serial.println((unsigned long)spectro.getParameterTime());
+    for (int i = 1; i < spectro.getParameterCount()+1; i++)
+    {
+        Serial.print(spectro.getParameterName(i));
+        Serial.print(" = ");
+        Serial.print(spectro.getParameterValue(i));
+        Serial.print(" ");
+        Serial.println(spectro.getParameterUnits(i));
+    }
+    fingerprintSum = 0;
+    fingerprintCount = 0;
+    for (int source = 0; source < 8; source++)
+        spectro.getFingerprintData(addValue, NULL, (spectralSource)source);
+    Serial.flush();
+    printf("Fingerprint values: %d, adding up to %g\n", fingerprintCount, fingerprintSum);
+    printf("Session took %.1f ms\n", (micros() - start)/1000.0);
+}
+
+static int record(const char *device, const char *traceName, byte address, unsigned long baud)
+{
+    posixSerial port(device);
+    if (!port.begin(baud, SERIAL_8O1))
+    {
+        printf("Unable to open %s at %lu baud\n", device, baud);
+        return 1;
+    }
+    FILE *file = fopen(traceName, "wb");
+    if (file == NULL)
+    {
+        printf("Unable to create %s\n", traceName);
+        return 1;
+    }
+    filePrint trace(file);
+    scanRecorder recorder(port, trace);
+    recorder.begin();
+
+    scan spectro;
+    spectro.begin(address, recorder, -1);
+    runSession(spectro);
+
+    recorder.finish();
+    fclose(file);
+    printf("Wrote %lu records to %s\n", (unsigned long)recorder.getRecordCount(), traceName);
+    return 0;
+}
+
+static int replay(const char *traceName, float timeScale, byte address)
+{
+    FILE *file = fopen(traceName, "rb");
+    if (file == NULL)
+    {
+        printf("Unable to open %s\n", traceName);
+        return 1;
+    }
+    fileStream trace(file);
+    scanReplayer replayer(trace, timeScale);
+    if (!replayer.begin())
+    {
+        printf("%s isn't a trace file\n", traceName);
+        return 1;
+    }
+
+    scan spectro;
+    spectro.begin(address, replayer, -1);
+    runSession(spectro);
+
+    printf("Replayed %lu requests, %lu didn't match the recording%s\n",
+           (unsigned long)replayer.getRequestCount(), (unsigned long)replayer.getMismatchCount(),
+           replayer.finished() ? "" : " (the trace has more)");
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 4 && strcmp(argv[1], "record") == 0)
+    {
+        byte address = argc > 4 ? strtol(argv[4], NULL, 0) : 0x04;
+        unsigned long baud = argc > 5 ? strtoul(argv[5], NULL, 0) : 38400;
+        return record(argv[2], argv[3], address, baud);
+    }
+    if (argc >= 3 && strcmp(argv[1], "replay") == 0)
+    {
+        float timeScale = argc > 3 ? atof(argv[3]) : 1.0;
+        byte address = argc > 4 ? strtol(argv[4], NULL, 0) : 0x04;
+        return replay(argv[2], timeScale, address);
+    }
+    printf("Usage: %s record <device> <trace file> [modbus address] [baud rate]\n", argv[0]);
+    printf("       %s replay <trace file> [time scale] [modbus address]\n", argv[0]);
+    return 1;
+}
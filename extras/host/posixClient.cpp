@@ -0,0 +1,167 @@
+/*
+ *posixClient.cpp
+*/
+
+#include "posixClient.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+
+posixClient::posixClient(void)
+{
+    _fd = -1;
+    _peeked = -1;
+}
+
+posixClient::~posixClient(void) {stop();}
+
+int posixClient::connect(IPAddress ip, uint16_t port)
+{
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+}
+
+// This connects, then turns off Nagle's algorithm so small modbus requests
+// go out right away, and makes the socket non-blocking
+int posixClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) return 0;
+
+    for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next)
+    {
+        _fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (_fd < 0) continue;
+        if (::connect(_fd, address->ai_addr, address->ai_addrlen) == 0) break;
+        close(_fd);
+        _fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (_fd < 0) return 0;
+
+    int on = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    _peeked = -1;
+    return 1;
+}
+
+size_t posixClient::write(const uint8_t *buf, size_t size)
+{
+    if (_fd < 0) return 0;
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t n = send(_fd, buf + written, size - written, MSG_NOSIGNAL);
+        if (n > 0) written += n;
+        else if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            struct pollfd output = {_fd, POLLOUT, 0};
+            poll(&output, 1, 100);
+        }
+        else
+        {
+            stop();
+            break;
+        }
+    }
+    return written;
+}
+
+int posixClient::available(void)
+{
+    if (_fd < 0) return _peeked >= 0 ? 1 : 0;
+    int waiting = 0;
+    if (ioctl(_fd, FIONREAD, &waiting) < 0) waiting = 0;
+    return waiting + (_peeked >= 0 ? 1 : 0);
+}
+
+int posixClient::read(void)
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int posixClient::read(uint8_t *buf, size_t size)
+{
+    if (size == 0) return 0;
+    int got = 0;
+    if (_peeked >= 0)
+    {
+        buf[got++] = _peeked;
+        _peeked = -1;
+        if (size == 1) return got;
+    }
+    if (_fd < 0) return got > 0 ? got : -1;
+    ssize_t n = recv(_fd, buf + got, size - got, 0);
+    if (n > 0) return got + n;
+    if (n == 0) stop();  // The other end hung up
+    return got > 0 ? got : -1;
+}
+
+int posixClient::peek(void)
+{
+    if (_peeked < 0) _peeked = read();
+    return _peeked;
+}
+
+void posixClient::stop(void)
+{
+    if (_fd < 0) return;
+    close(_fd);
+    _fd = -1;
+}
+
+// This stays true until the other end hangs up and everything it sent has
+// been read
+uint8_t posixClient::connected(void)
+{
+    if (_fd < 0) return _peeked >= 0;
+    char c;
+    ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0)
+    {
+        stop();
+        return _peeked >= 0;
+    }
+    return 1;
+}
+
+// This waits up to the given time for something to read
+bool posixClient::waitForData(unsigned long timeoutMs)
+{
+    if (available() > 0) return true;
+    if (_fd < 0) return false;
+    struct pollfd input = {_fd, POLLIN, 0};
+    return poll(&input, 1, timeoutMs) > 0;
+}
+
+int posixClient::timedRead(void)
+{
+    if (!waitForData(_timeout)) return -1;
+    return read();
+}
+
+int posixClient::timedPeek(void)
+{
+    if (!waitForData(_timeout)) return -1;
+    return peek();
+}
@@ -0,0 +1,52 @@
+/*
+ *posixClient.h
+ *
+ *This is a TCP connection on a Linux (or other POSIX) computer that works
+ *like an Arduino EthernetClient, so it can be handed to scanModbusTCP.
+*/
+
+#ifndef posixClient_h
+#define posixClient_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+
+class posixClient : public Client
+{
+
+public:
+    posixClient(void);
+    ~posixClient(void);
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buf, size_t size);
+    using Print::write;
+    int available(void);
+    int read(void);
+    int read(uint8_t *buf, size_t size);
+    int peek(void);
+    void flush(void) {}  // Everything is sent as soon as it's written
+    void stop(void);
+    uint8_t connected(void);
+    operator bool(void) {return _fd >= 0;}
+
+    // This returns the file descriptor of the socket (or -1)
+    int getFD(void) {return _fd;}
+
+protected:
+    // These wait for a character without spinning
+    int timedRead(void);
+    int timedPeek(void);
+
+private:
+    // This waits up to the given time for something to read
+    bool waitForData(unsigned long timeoutMs);
+
+    int _fd;
+    int _peeked;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ *posixSerial.cpp
+*/
+
+#include "posixSerial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+
+//----------------------------------------------------------------------------
+//                          OPENING AND CLOSING THE PORT
+//----------------------------------------------------------------------------
+
+posixSerial::posixSerial(const char *device)
+{
+    strncpy(_device, device, sizeof(_device) - 1);
+    _device[sizeof(_device) - 1] = '\0';
+    _fd = -1;
+    _baud = 0;
+    _charMicros = 0;
+    _rs485Mode = rs485Auto;
+    _delayBeforeSend = 0;
+    _delayAfterSend = 0;
+    _echoCancel = false;
+    _sending = false;
+    _sendStart = 0;
+    _bytesSent = 0;
+    _head = _tail = 0;
+}
+
+posixSerial::~posixSerial(void) {end();}
+
+// This converts a baud rate to a termios speed
+static speed_t baudToSpeed(unsigned long baud)
+{
+    switch (baud)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+#ifdef B460800
+        case 460800: return B460800;
+#endif
+#ifdef B921600
+        case 921600: return B921600;
+#endif
+        default: return 0;
+    }
+}
+
+// This opens the port with the same configurations as an Arduino
+// hardware serial port
+// The configuration bits are the same as the AVR core's: bits 1-2 are the
+// number of data bits - 5, bit 3 is set for 2 stop bits, and bits 4-5 are
+// the parity (0x20 = even, 0x30 = odd).
+bool posixSerial::begin(unsigned long baud, uint8_t config)
+{
+    end();
+    speed_t speed = baudToSpeed(baud);
+    if (speed == 0) return false;
+
+    _fd = open(_device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_fd < 0) return false;
+
+    struct termios tty;
+    if (tcgetattr(_fd, &tty) != 0)
+    {
+        end();
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+
+    int dataBits = ((config & 0x06) >> 1) + 5;
+    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tty.c_cflag |= CLOCAL | CREAD;
+    switch (dataBits)
+    {
+        case 5: tty.c_cflag |= CS5; break;
+        case 6: tty.c_cflag |= CS6; break;
+        case 7: tty.c_cflag |= CS7; break;
+        default: tty.c_cflag |= CS8; break;
+    }
+    bool parity = (config & 0x20) != 0;
+    if (parity) tty.c_cflag |= PARENB;
+    if ((config & 0x30) == 0x30) tty.c_cflag |= PARODD;
+    bool twoStopBits = (config & 0x08) != 0;
+    if (twoStopBits) tty.c_cflag |= CSTOPB;
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(_fd, TCSANOW, &tty) != 0)
+    {
+        end();
+        return false;
+    }
+    tcflush(_fd, TCIOFLUSH);
+
+    // Start bit + data bits + parity bit + stop bits, rounded up
+    uint32_t bitsPerChar = 1 + dataBits + (parity ? 1 : 0) + (twoStopBits ? 2 : 1);
+    _baud = baud;
+    _charMicros = (1000000UL*bitsPerChar + baud - 1)/baud;
+    _head = _tail = 0;
+    _sending = false;
+    if (_rs485Mode != rs485Auto) setRS485(_rs485Mode, _delayBeforeSend, _delayAfterSend);
+    return true;
+}
+
+void posixSerial::end(void)
+{
+    if (_fd < 0) return;
+    if (_sending) finishSending();
+    close(_fd);
+    _fd = -1;
+}
+
+// This sets how the RS-485 driver is switched between sending and receiving
+bool posixSerial::setRS485(rs485Mode mode, uint32_t delayBeforeSendMicros,
+                           uint32_t delayAfterSendMicros)
+{
+    _rs485Mode = mode;
+    _delayBeforeSend = delayBeforeSendMicros;
+    _delayAfterSend = delayAfterSendMicros;
+    if (_fd < 0) return true;  // It will be set up when the port is opened
+
+#ifdef __linux__
+    struct serial_rs485 rs485;
+    memset(&rs485, 0, sizeof(rs485));
+    if (mode == rs485Kernel)
+    {
+        // The kernel delays are in whole milliseconds
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        rs485.delay_rts_before_send = (delayBeforeSendMicros + 999)/1000;
+        rs485.delay_rts_after_send = (delayAfterSendMicros + 999)/1000;
+    }
+    bool kernelOK = ioctl(_fd, TIOCSRS485, &rs485) == 0;
+    if (mode == rs485Kernel) return kernelOK;
+#else
+    if (mode == rs485Kernel) return false;
+#endif
+
+    if (mode == rs485RTS) setRTS(false);
+    return true;
+}
+
+// This sets or clears RTS
+void posixSerial::setRTS(bool on)
+{
+    int flag = TIOCM_RTS;
+    ioctl(_fd, on ? TIOCMBIS : TIOCMBIC, &flag);
+}
+
+
+//----------------------------------------------------------------------------
+//                                  SENDING
+//----------------------------------------------------------------------------
+
+size_t posixSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (_fd < 0) return 0;
+
+    // Take the bus
+    if (!_sending)
+    {
+        if (_rs485Mode == rs485RTS)
+        {
+            setRTS(true);
+            if (_delayBeforeSend > 0) delayMicroseconds(_delayBeforeSend);
+        }
+        _sending = true;
+        _sendStart = micros();
+        _bytesSent = 0;
+    }
+
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t n = ::write(_fd, buffer + written, size - written);
+        if (n > 0) written += n;
+        else if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+        else
+        {
+            struct pollfd output = {_fd, POLLOUT, 0};
+            poll(&output, 1, 100);
+        }
+    }
+    _bytesSent += written;
+    return written;
+}
+
+// This waits until everything written has been sent, then lets go of the bus
+void posixSerial::flush(void)
+{
+    if (_fd >= 0 && _sending) finishSending();
+}
+
+// This finishes sending
+// tcdrain() only waits for the driver to hand everything to the UART (or
+// the USB adapter), so the turnaround also waits until the last character
+// should have left the wire, based on when sending started.
+void posixSerial::finishSending(void)
+{
+    tcdrain(_fd);
+    if (_rs485Mode == rs485RTS || _echoCancel)
+    {
+        uint32_t onWire = _bytesSent*_charMicros;
+        uint32_t elapsed = micros() - _sendStart;
+        if (elapsed < onWire) delayMicroseconds(onWire - elapsed);
+    }
+    if (_rs485Mode == rs485RTS)
+    {
+        if (_delayAfterSend > 0) delayMicroseconds(_delayAfterSend);
+        setRTS(false);
+    }
+    _sending = false;
+
+    // Throw away our own characters
+    // Allow a couple of characters (and USB latency) for the last of them.
+    if (_echoCancel)
+    {
+        int timeoutMs = (2*_charMicros)/1000 + 20;
+        uint32_t echoed = 0;
+        while (echoed < _bytesSent)
+        {
+            if (_head == _tail && !fill(timeoutMs)) break;
+            _tail = (_tail + 1) % POSIX_SERIAL_BUFFER;
+            echoed++;
+        }
+    }
+}
+
+
+//----------------------------------------------------------------------------
+//                                 RECEIVING
+//----------------------------------------------------------------------------
+
+// This fills the receive buffer with whatever has arrived
+bool posixSerial::fill(int timeoutMs)
+{
+    if (_fd < 0) return false;
+    if (timeoutMs > 0)
+    {
+        struct pollfd input = {_fd, POLLIN, 0};
+        if (poll(&input, 1, timeoutMs) <= 0) return false;
+    }
+
+    // Read into the free space, which may wrap around the end of the buffer
+    bool gotSomething = false;
+    while (true)
+    {
+        // One slot is always left empty so a full buffer isn't mistaken for empty
+        int space;
+        if (_head >= _tail) space = POSIX_SERIAL_BUFFER - _head - (_tail == 0 ? 1 : 0);
+        else space = _tail - _head - 1;
+        if (space <= 0) break;
+        ssize_t n = ::read(_fd, _buffer + _head, space);
+        if (n <= 0) break;
+        _head = (_head + n) % POSIX_SERIAL_BUFFER;
+        gotSomething = true;
+    }
+    return gotSomething;
+}
+
+int posixSerial::available(void)
+{
+    if (_sending) finishSending();
+    fill(0);
+    return (_head - _tail + POSIX_SERIAL_BUFFER) % POSIX_SERIAL_BUFFER;
+}
+
+int posixSerial::read(void)
+{
+    if (_sending) finishSending();
+    if (_head == _tail && !fill(0)) return -1;
+    int c = _buffer[_tail];
+    _tail = (_tail + 1) % POSIX_SERIAL_BUFFER;
+    return c;
+}
+
+int posixSerial::peek(void)
+{
+    if (_sending) finishSending();
+    if (_head == _tail && !fill(0)) return -1;
+    return _buffer[_tail];
+}
+
+// This waits up to the timeout for a character without spinning
+int posixSerial::timedRead(void)
+{
+    if (_sending) finishSending();
+    if (_head == _tail && !fill(_timeout)) return -1;
+    return read();
+}
+
+int posixSerial::timedPeek(void)
+{
+    if (_sending) finishSending();
+    if (_head == _tail && !fill(_timeout)) return -1;
+    return peek();
+}
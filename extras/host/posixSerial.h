@@ -0,0 +1,111 @@
+/*
+ *posixSerial.h
+ *
+ *This is a serial port on a Linux (or other POSIX) computer that works like
+ *an Arduino hardware serial port, so it can be handed to the library in
+ *place of Serial1.
+ *
+ *Most USB RS-485 adapters switch between sending and receiving by
+ *themselves.  For adapters that use RTS to switch direction, this can ask
+ *the kernel driver to do it or do it itself, waiting until the last
+ *character has actually left the wire before letting go of the bus.
+*/
+
+#ifndef posixSerial_h
+#define posixSerial_h
+
+#include <Arduino.h>
+
+// The size of the receive buffer
+#ifndef POSIX_SERIAL_BUFFER
+#define POSIX_SERIAL_BUFFER 256
+#endif
+
+// The ways the RS-485 driver can be switched between sending and receiving
+typedef enum rs485Mode
+{
+    rs485Auto = 0,  // The adapter does it by itself (or it's not RS-485)
+    rs485Kernel,  // The kernel driver sets RTS while sending
+    rs485RTS  // This sets RTS while sending and times the turnaround itself
+} rs485Mode;
+
+
+class posixSerial : public Stream
+{
+
+public:
+
+    // The device is something like "/dev/ttyUSB0"
+    posixSerial(const char *device);
+    ~posixSerial(void);
+
+    // This opens the port with the same configurations as an Arduino
+    // hardware serial port (ie, SERIAL_8O1).  Returns false if the port
+    // cannot be opened or the baud rate is not supported.
+    bool begin(unsigned long baud, uint8_t config = SERIAL_8N1);
+    void end(void);
+    operator bool(void) {return _fd >= 0;}
+
+    // This sets how the RS-485 driver is switched between sending and
+    // receiving.  The delays are how long to hold the driver on before and
+    // after sending.  Returns false if the mode isn't supported by the port.
+    bool setRS485(rs485Mode mode, uint32_t delayBeforeSendMicros = 0,
+                  uint32_t delayAfterSendMicros = 0);
+
+    // This throws away everything this port sends that it also hears, for
+    // adapters that don't turn off their receiver while sending
+    void setEchoCancel(bool cancel) {_echoCancel = cancel;}
+
+    // This returns the time to send one character, in microseconds
+    uint32_t getCharMicros(void) {return _charMicros;}
+
+    // This returns the file descriptor of the open port (or -1)
+    int getFD(void) {return _fd;}
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    // This waits until everything written has been sent, then lets go of
+    // the bus (if RS-485 direction is being controlled)
+    void flush(void);
+
+protected:
+    // These wait for a character without spinning
+    int timedRead(void);
+    int timedPeek(void);
+
+private:
+    // This fills the receive buffer with whatever has arrived, waiting up
+    // to the given number of milliseconds for something to arrive
+    bool fill(int timeoutMs);
+
+    // This finishes sending: waits for the last character to leave the
+    // wire, switches to receiving, and throws away any echo
+    void finishSending(void);
+
+    // This sets or clears RTS
+    void setRTS(bool on);
+
+    char _device[64];
+    int _fd;
+    uint32_t _baud;
+    uint32_t _charMicros;
+
+    rs485Mode _rs485Mode;
+    uint32_t _delayBeforeSend;
+    uint32_t _delayAfterSend;
+    bool _echoCancel;
+
+    bool _sending;
+    uint32_t _sendStart;
+    uint32_t _bytesSent;
+
+    uint8_t _buffer[POSIX_SERIAL_BUFFER];
+    int _head;
+    int _tail;
+};
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ *scanPoller.cpp
+*/
+
+#include "scanPoller.h"
+#include <scanRTU.h>  // For the frame gap
+
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//----------------------------------------------------------------------------
+//                       LOCK-FREE QUEUE OF MEASUREMENTS
+//----------------------------------------------------------------------------
+
+// A slot whose sequence equals the push position is free to write; one whose
+// sequence is one more than the pop position holds a record to read.
+scanRecordQueue::scanRecordQueue(void)
+{
+    for (size_t i = 0; i < SCAN_QUEUE_SIZE; i++)
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    _pushPosition.store(0, std::memory_order_relaxed);
+    _popPosition.store(0, std::memory_order_relaxed);
+}
+
+// This adds a record; returns false (and drops it) if the queue is full
+bool scanRecordQueue::push(const measurementRecord &record)
+{
+    size_t position = _pushPosition.load(std::memory_order_relaxed);
+    slot *target;
+    while (true)
+    {
+        target = &_slots[position & (SCAN_QUEUE_SIZE - 1)];
+        size_t sequence = target->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0)
+        {
+            if (_pushPosition.compare_exchange_weak(position, position + 1,
+                                                    std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) return false;  // Full
+        else position = _pushPosition.load(std::memory_order_relaxed);
+    }
+    target->record = record;
+    target->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// This takes the oldest record; returns false if the queue is empty
+bool scanRecordQueue::pop(measurementRecord &record)
+{
+    size_t position = _popPosition.load(std::memory_order_relaxed);
+    slot *source;
+    while (true)
+    {
+        source = &_slots[position & (SCAN_QUEUE_SIZE - 1)];
+        size_t sequence = source->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0)
+        {
+            if (_popPosition.compare_exchange_weak(position, position + 1,
+                                                   std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) return false;  // Empty
+        else position = _popPosition.load(std::memory_order_relaxed);
+    }
+    record = source->record;
+    source->sequence.store(position + SCAN_QUEUE_SIZE, std::memory_order_release);
+    return true;
+}
+
+
+//----------------------------------------------------------------------------
+//                          POLLER FOR MANY PORTS
+//----------------------------------------------------------------------------
+
+scanPoller::scanPoller(void)
+{
+    _portCount = 0;
+    _pollInterval = 5000;
+    _dropped = 0;
+    _running = false;
+    _notify[0] = _notify[1] = -1;
+    if (pipe(_notify) == 0)
+    {
+        fcntl(_notify[0], F_SETFL, O_NONBLOCK);
+        fcntl(_notify[1], F_SETFL, O_NONBLOCK);
+    }
+    for (int i = 0; i < SCAN_POLLER_MAX_PORTS; i++)
+    {
+        _ports[i].serial = NULL;
+        _ports[i].deviceCount = 0;
+        _ports[i].errors = 0;
+    }
+}
+
+scanPoller::~scanPoller(void)
+{
+    stop();
+    for (int i = 0; i < _portCount; i++) delete _ports[i].serial;
+    if (_notify[0] >= 0) close(_notify[0]);
+    if (_notify[1] >= 0) close(_notify[1]);
+}
+
+// This adds a serial port and returns its index
+int scanPoller::addPort(const char *device, unsigned long baud, uint8_t config)
+{
+    if (_portCount >= SCAN_POLLER_MAX_PORTS || _running) return -1;
+    portWorker &worker = _ports[_portCount];
+    worker.serial = new posixSerial(device);
+    worker.baud = baud;
+    worker.config = config;
+    worker.deviceCount = 0;
+    return _portCount++;
+}
+
+// This gives access to the serial port
+posixSerial *scanPoller::getPort(int port)
+{
+    if (port < 0 || port >= _portCount) return NULL;
+    return _ports[port].serial;
+}
+
+// This adds a device on a port
+bool scanPoller::addDevice(int port, byte slaveID)
+{
+    if (port < 0 || port >= _portCount || _running) return false;
+    portWorker &worker = _ports[port];
+    if (worker.deviceCount >= SCAN_POLLER_MAX_DEVICES) return false;
+    worker.slaveIDs[worker.deviceCount] = slaveID;
+    worker.lastTime[worker.deviceCount] = 0;
+    worker.deviceCount++;
+    return true;
+}
+
+// This returns the number of failed reads on a port
+uint32_t scanPoller::getErrors(int port)
+{
+    if (port < 0 || port >= _portCount) return 0;
+    return _ports[port].errors;
+}
+
+// This opens every port and starts a worker thread for each one
+bool scanPoller::start(void)
+{
+    if (_running) return true;
+    for (int i = 0; i < _portCount; i++)
+    {
+        if (!_ports[i].serial->begin(_ports[i].baud, _ports[i].config))
+        {
+            for (int j = 0; j < i; j++) _ports[j].serial->end();
+            return false;
+        }
+    }
+    _running = true;
+    for (int i = 0; i < _portCount; i++)
+        _ports[i].thread = std::thread(&scanPoller::run, this, (uint8_t)i);
+    return true;
+}
+
+// This stops every worker thread and closes the ports
+// A worker in the middle of a request finishes it first.
+void scanPoller::stop(void)
+{
+    if (!_running) return;
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _running = false;
+    }
+    _wake.notify_all();
+    for (int i = 0; i < _portCount; i++)
+    {
+        if (_ports[i].thread.joinable()) _ports[i].thread.join();
+        _ports[i].serial->end();
+    }
+}
+
+// This takes the oldest new measurement
+// The notification descriptor is only emptied once the queue looks empty,
+// and the queue is checked again after that, so a record added in between
+// is never missed.
+bool scanPoller::getRecord(measurementRecord &record)
+{
+    if (_queue.pop(record)) return true;
+    char drain[64];
+    while (read(_notify[0], drain, sizeof(drain)) > 0) {}
+    return _queue.pop(record);
+}
+
+// This waits up to the given time for a new measurement
+bool scanPoller::waitForRecord(measurementRecord &record, int timeoutMs)
+{
+    uint32_t start = millis();
+    while (true)
+    {
+        if (getRecord(record)) return true;
+        int remaining = timeoutMs - (int)(millis() - start);
+        if (remaining <= 0) return false;
+        struct pollfd input = {_notify[0], POLLIN, 0};
+        poll(&input, 1, remaining);
+    }
+}
+
+// This tells any readers of the notification descriptor about new records
+void scanPoller::notify(void)
+{
+    char c = 1;
+    if (write(_notify[1], &c, 1) < 0) {}  // A full pipe is already readable
+}
+
+// This waits until it's time to poll again or the poller is stopped
+bool scanPoller::sleepUntil(uint32_t wakeAt)
+{
+    std::unique_lock<std::mutex> lock(_sleepMutex);
+    int32_t remaining = (int32_t)(wakeAt - millis());
+    if (remaining > 0 && _running)
+        _wake.wait_for(lock, std::chrono::milliseconds(remaining), [this]{return !_running;});
+    return _running;
+}
+
+// This waits until the bus has been quiet for a whole frame gap
+void scanPoller::waitForSilence(portWorker &worker)
+{
+    uint32_t gap = scanRTU::frameGapMicros(worker.baud);
+    uint32_t quietSince = micros();
+    while (micros() - quietSince < gap)
+    {
+        if (worker.serial->available())
+        {
+            while (worker.serial->read() >= 0) {}
+            quietSince = micros();
+        }
+        else delayMicroseconds(gap - (micros() - quietSince));
+    }
+}
+
+// This reads registers from a device into the port's response buffer
+// An exception reply is only 5 bytes, so those are checked before waiting
+// for the rest.
+bool scanPoller::readRegisters(portWorker &worker, byte slaveID, byte regType,
+                               uint16_t startRegister, uint16_t numRegisters)
+{
+    byte request[8];
+    int length = scanRTU::buildReadRequest(request, slaveID, regType, startRegister, numRegisters);
+    waitForSilence(worker);
+    worker.serial->write(request, length);
+    worker.serial->flush();
+
+    byte *response = worker.response;
+    if (worker.serial->readBytes(response, 5) != 5) return false;
+    if (response[0] != slaveID || response[1] != regType || response[2] != 2*numRegisters)
+        return false;
+    int rest = 2*numRegisters;
+    if ((int)worker.serial->readBytes(response + 5, rest) != rest) return false;
+    return scanRTU::checkCRC(response, 5 + rest);
+}
+
+// This reads the time, device status, and parameter results of a device
+// The frames are planned and decoded by scan::readParameterSnapshot, but
+// they are read into the port's own buffer.
+bool scanPoller::readSnapshot(portWorker &worker, byte slaveID, parameterSnapshot &snapshot)
+{
+    deviceReader device = {this, &worker, slaveID};
+    return scan::readParameterSnapshot(readFrame, &device, snapshot);
+}
+
+// This is the frame reader for readSnapshot()
+const byte *scanPoller::readFrame(byte regType, uint16_t startRegister,
+                                  uint16_t numRegisters, void *context)
+{
+    deviceReader *device = (deviceReader*)context;
+    if (!device->poller->readRegisters(*device->worker, device->slaveID, regType,
+                                       startRegister, numRegisters))
+        return NULL;
+    return device->worker->response;
+}
+
+// This is what each worker thread runs
+// Every device on the port is checked once per poll interval, and its
+// measurement is queued only if its sample time has changed.
+void scanPoller::run(uint8_t port)
+{
+    portWorker &worker = _ports[port];
+    uint32_t nextPoll = millis();
+    while (_running)
+    {
+        for (int i = 0; i < worker.deviceCount && _running; i++)
+        {
+            measurementRecord record;
+            if (!readSnapshot(worker, worker.slaveIDs[i], record.snapshot))
+            {
+                worker.errors++;
+                continue;
+            }
+            if (record.snapshot.time == 0 || record.snapshot.time == worker.lastTime[i]) continue;
+            worker.lastTime[i] = record.snapshot.time;
+            record.port = port;
+            record.slaveID = worker.slaveIDs[i];
+            record.receivedAt = (uint32_t)time(NULL);
+            if (_queue.push(record)) notify();
+            else _dropped++;
+        }
+        nextPoll += _pollInterval;
+        // Don't try to catch up if the devices took longer than the interval
+        if ((int32_t)(nextPoll - millis()) < 0) nextPoll = millis();
+        if (!sleepUntil(nextPoll)) break;
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ *scanPoller.h
+ *
+ *This polls many spectro::lyzers (or ana::gates) on many serial ports from
+ *a single program on a Linux computer, and collects every new measurement
+ *into one queue.
+ *
+ *The modbus library waits for each reply, so each port gets one worker
+ *thread that talks to each of the devices on that port in turn.  The
+ *workers wait in poll() rather than spinning, so idle ports cost nothing.
+ *Every modbusMaster shares one static response buffer, so the workers don't
+ *use the modbus library at all; each one sends its own requests and reads
+ *the replies into a buffer of its own, so the ports can't trample each
+ *other's replies.  The frames are still planned and decoded by
+ *scan::readParameterSnapshot, which is handed a function to read them.
+ *New measurements go into a lock-free queue that any thread can read from;
+ *the notification file descriptor becomes readable whenever there is
+ *something in it, so it can be added to an existing poll/epoll loop.
+*/
+
+#ifndef scanPoller_h
+#define scanPoller_h
+
+#include <Arduino.h>
+#include <scanModbus.h>  // For parameter snapshots and the register map
+#include "posixSerial.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef SCAN_POLLER_MAX_PORTS
+#define SCAN_POLLER_MAX_PORTS 16
+#endif
+#ifndef SCAN_POLLER_MAX_DEVICES
+#define SCAN_POLLER_MAX_DEVICES 8  // Per port
+#endif
+// The number of records the queue can hold; must be a power of 2
+#ifndef SCAN_QUEUE_SIZE
+#define SCAN_QUEUE_SIZE 256
+#endif
+// The longest reply to a read: slave ID, function, byte count, data, CRC
+#define SCAN_POLLER_RESPONSE_SIZE (5 + 2*MAX_REGS_PER_FRAME)
+
+// One new measurement from one device
+typedef struct measurementRecord
+{
+    uint8_t port;  // The index returned by addPort()
+    byte slaveID;  // The modbus address of the device
+    uint32_t receivedAt;  // The computer's time (seconds from Jan 1, 1970)
+    parameterSnapshot snapshot;  // The measurement itself
+} measurementRecord;
+
+
+//----------------------------------------------------------------------------
+//                       LOCK-FREE QUEUE OF MEASUREMENTS
+//----------------------------------------------------------------------------
+// This is a bounded queue that any number of threads can add to and take
+// from without locks.  Each slot has a sequence number that says whether it
+// is ready to be written or read (D. Vyukov's bounded MPMC queue).
+class scanRecordQueue
+{
+
+public:
+    scanRecordQueue(void);
+
+    // This adds a record; returns false (and drops it) if the queue is full
+    bool push(const measurementRecord &record);
+
+    // This takes the oldest record; returns false if the queue is empty
+    bool pop(measurementRecord &record);
+
+private:
+    struct slot
+    {
+        std::atomic<size_t> sequence;
+        measurementRecord record;
+    };
+    slot _slots[SCAN_QUEUE_SIZE];
+    alignas(64) std::atomic<size_t> _pushPosition;
+    alignas(64) std::atomic<size_t> _popPosition;
+};
+
+
+//----------------------------------------------------------------------------
+//                          POLLER FOR MANY PORTS
+//----------------------------------------------------------------------------
+class scanPoller
+{
+
+public:
+    scanPoller(void);
+    ~scanPoller(void);
+
+    // This adds a serial port, ie "/dev/ttyUSB0", and returns its index
+    // (or -1 if there are already too many ports).  The port isn't opened
+    // until start().
+    int addPort(const char *device, unsigned long baud = 38400, uint8_t config = SERIAL_8O1);
+
+    // This gives access to the serial port, ie to set up RS-485 control
+    // before start()
+    posixSerial *getPort(int port);
+
+    // This adds a device on a port; returns false if there's no more room
+    bool addDevice(int port, byte slaveID);
+
+    // This sets how often each device is checked for a new measurement
+    void setPollInterval(uint32_t milliseconds) {_pollInterval = milliseconds;}
+
+    // These start and stop the worker threads
+    // start() returns false if any port couldn't be opened.
+    bool start(void);
+    void stop(void);
+
+    // This takes the oldest new measurement; returns false if there is none
+    bool getRecord(measurementRecord &record);
+
+    // This waits up to the given time for a new measurement
+    bool waitForRecord(measurementRecord &record, int timeoutMs);
+
+    // This file descriptor is readable while there are measurements waiting
+    int getNotifyFD(void) {return _notify[0];}
+
+    // This returns the number of measurements dropped because the queue was full
+    uint32_t getDropped(void) {return _dropped;}
+
+    // This returns the number of failed reads on a port
+    uint32_t getErrors(int port);
+
+private:
+    struct portWorker
+    {
+        posixSerial *serial;
+        unsigned long baud;
+        uint8_t config;
+        byte slaveIDs[SCAN_POLLER_MAX_DEVICES];
+        uint32_t lastTime[SCAN_POLLER_MAX_DEVICES];
+        uint8_t deviceCount;
+        byte response[SCAN_POLLER_RESPONSE_SIZE];  // Only this port's worker uses it
+        std::atomic<uint32_t> errors;
+        std::thread thread;
+    };
+
+    // This is what each worker thread runs
+    void run(uint8_t port);
+
+    // This reads registers from a device into the port's response buffer
+    bool readRegisters(portWorker &worker, byte slaveID, byte regType,
+                       uint16_t startRegister, uint16_t numRegisters);
+
+    // This reads the time, device status, and parameter results of a device
+    bool readSnapshot(portWorker &worker, byte slaveID, parameterSnapshot &snapshot);
+
+    // The device readSnapshot() is reading from, for its frame reader
+    struct deviceReader
+    {
+        scanPoller *poller;
+        portWorker *worker;
+        byte slaveID;
+    };
+
+    // This is the frame reader for readSnapshot()
+    static const byte *readFrame(byte regType, uint16_t startRegister,
+                                 uint16_t numRegisters, void *context);
+
+    // This waits until the bus has been quiet for a whole frame gap, so a
+    // late reply to the last request can't run into the next one
+    void waitForSilence(portWorker &worker);
+
+    // This waits until it's time to poll again or the poller is stopped
+    // Returns false if the poller is stopping.
+    bool sleepUntil(uint32_t wakeAt);
+
+    // This tells any readers of the notification descriptor about new records
+    void notify(void);
+
+    portWorker _ports[SCAN_POLLER_MAX_PORTS];
+    uint8_t _portCount;
+    uint32_t _pollInterval;
+    scanRecordQueue _queue;
+    std::atomic<uint32_t> _dropped;
+    int _notify[2];
+
+    std::atomic<bool> _running;
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+};
+
+#endif
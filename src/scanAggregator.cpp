@@ -0,0 +1,171 @@
+/*
+ *scanAggregator.cpp
+*/
+
+#include "scanAggregator.h"
+
+// This returns the start of the window containing the given time
+static uint32_t windowStartFor(uint32_t time, uint32_t windowLength)
+{
+    if (windowLength == 0) return time;
+    return time - time % windowLength;
+}
+
+
+//----------------------------------------------------------------------------
+//          FUNCTIONS TO SUMMARIZE PARAMETER RESULTS OVER TIME WINDOWS
+//----------------------------------------------------------------------------
+
+scanParameterAggregator::scanParameterAggregator(uint32_t windowLength)
+{
+    _windowLength = windowLength;
+    startWindow(0);
+}
+
+// This clears everything and starts a window containing the given time
+void scanParameterAggregator::startWindow(uint32_t time)
+{
+    _windowStart = windowStartFor(time, _windowLength);
+    _samples = 0;
+    _deviceFlagged = 0;
+    _deviceStatus = 0;
+    _count = 0;
+    for (int i = 0; i < MAX_PARAMETERS; i++)
+    {
+        _stats[i].reset();
+        _flagged[i] = 0;
+        _status[i] = 0;
+    }
+}
+
+// This is true if the given time is past the end of the current window
+bool scanParameterAggregator::windowEnded(uint32_t time)
+{
+    if (_samples == 0 || _windowLength == 0) return false;
+    return time >= _windowStart + _windowLength || time < _windowStart;
+}
+
+// This adds a snapshot to the current window
+void scanParameterAggregator::add(const parameterSnapshot &snapshot)
+{
+    if (_samples == 0) _windowStart = windowStartFor(snapshot.time, _windowLength);
+    if (_samples < 0xFFFF) _samples++;
+    if (snapshot.deviceStatus != 0 && _deviceFlagged < 0xFFFF) _deviceFlagged++;
+    _deviceStatus |= snapshot.deviceStatus;
+    if (snapshot.count > _count) _count = snapshot.count;
+    for (int i = 0; i < snapshot.count && i < MAX_PARAMETERS; i++)
+    {
+        _stats[i].add(snapshot.value[i]);
+        if (snapshot.status[i] != 0 && _flagged[i] < 0xFFFF) _flagged[i]++;
+        _status[i] |= snapshot.status[i];
+    }
+}
+
+// This fills in a summary of the current window
+void scanParameterAggregator::getSummary(parameterSummary &summary)
+{
+    summary.windowStart = _windowStart;
+    summary.windowLength = _windowLength;
+    summary.samples = _samples;
+    summary.deviceFlagged = _deviceFlagged;
+    summary.deviceStatus = _deviceStatus;
+    summary.count = _count;
+    for (int i = 0; i < _count; i++)
+    {
+        summary.mean[i] = _stats[i].get(statMean);
+        summary.stdDev[i] = _stats[i].get(statStdDev);
+        summary.minimum[i] = _stats[i].get(statMin);
+        summary.maximum[i] = _stats[i].get(statMax);
+        summary.flagged[i] = _flagged[i];
+        summary.status[i] = _status[i];
+    }
+}
+
+// This prints the summary of the current window as one delimited row
+void scanParameterAggregator::printSummary(Stream *stream, const char *dlm)
+{
+    stream->print(_windowStart);
+    stream->print(dlm);
+    stream->print(_samples);
+    stream->print(dlm);
+    stream->print(_deviceFlagged);
+    for (int i = 0; i < _count; i++)
+    {
+        stream->print(dlm);
+        stream->print(_stats[i].get(statMean), 4);
+        stream->print(dlm);
+        stream->print(_stats[i].get(statStdDev), 4);
+        stream->print(dlm);
+        stream->print(_stats[i].get(statMin), 4);
+        stream->print(dlm);
+        stream->print(_stats[i].get(statMax), 4);
+        stream->print(dlm);
+        stream->print(_flagged[i]);
+    }
+    stream->println();
+}
+void scanParameterAggregator::printSummary(Stream &stream, const char *dlm)
+{printSummary(&stream, dlm);}
+
+
+//----------------------------------------------------------------------------
+//          FUNCTIONS TO SUMMARIZE FINGERPRINTS OVER TIME WINDOWS
+//----------------------------------------------------------------------------
+
+scanSpectrumAggregator::scanSpectrumAggregator(uint32_t windowLength)
+{
+    _windowLength = windowLength;
+    startWindow(0);
+}
+
+// This clears everything and starts a window containing the given time
+void scanSpectrumAggregator::startWindow(uint32_t time)
+{
+    _windowStart = windowStartFor(time, _windowLength);
+    _samples = 0;
+    for (int i = 0; i < FINGERPRINT_VALUES; i++) _stats[i].reset();
+}
+
+// This is true if the given time is past the end of the current window
+bool scanSpectrumAggregator::windowEnded(uint32_t time)
+{
+    if (_samples == 0 || _windowLength == 0) return false;
+    return time >= _windowStart + _windowLength || time < _windowStart;
+}
+
+// This adds a whole fingerprint to the current window
+void scanSpectrumAggregator::add(const float *spectrum, uint32_t time)
+{
+    for (int i = 0; i < FINGERPRINT_VALUES; i++) _stats[i].add(spectrum[i]);
+    endSpectrum(time);
+}
+
+// This adds one streamed value
+void scanSpectrumAggregator::addValue(int index, float, float value, void *context)
+{
+    if (index < 0 || index >= FINGERPRINT_VALUES) return;
+    ((scanSpectrumAggregator*)context)->_stats[index].add(value);
+}
+
+// This finishes adding a streamed fingerprint
+void scanSpectrumAggregator::endSpectrum(uint32_t time)
+{
+    if (_samples == 0) _windowStart = windowStartFor(time, _windowLength);
+    if (_samples < 0xFFFF) _samples++;
+}
+
+// This prints one statistic for every wavelength as a delimited row
+void scanSpectrumAggregator::printSummary(Stream *stream, aggregateStat stat, const char *dlm)
+{
+    stream->print(_windowStart);
+    stream->print(dlm);
+    stream->print(_samples);
+    for (int i = 0; i < FINGERPRINT_VALUES; i++)
+    {
+        stream->print(dlm);
+        stream->print(_stats[i].get(stat), 4);
+    }
+    stream->println();
+}
+void scanSpectrumAggregator::printSummary(Stream &stream, aggregateStat stat, const char *dlm)
+{printSummary(&stream, stat, dlm);}
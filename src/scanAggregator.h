@@ -0,0 +1,187 @@
+/*
+ *scanAggregator.h
+*/
+
+#ifndef scanAggregator_h
+#define scanAggregator_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For parameter snapshots and the spectrum size
+
+// The statistics that can be printed for a window
+typedef enum aggregateStat
+{
+    statMean = 0,
+    statStdDev,
+    statMin,
+    statMax
+} aggregateStat;
+
+
+// This keeps the count, min, max, mean and variance of a series of values
+// without keeping the values, using Welford's method
+// NAN values are not counted.  The count is 32 bits so that a window that
+// never ends (a length of 0) can't wrap it back to 0.
+struct scanStats
+{
+    uint32_t n;
+    float mean;
+    float M2;  // Sum of squared differences from the mean
+    float minimum;
+    float maximum;
+
+    void reset(void){n = 0; mean = 0; M2 = 0; minimum = NAN; maximum = NAN;}
+    void add(float value)
+    {
+        if (isnan(value)) return;
+        n++;
+        float delta = value - mean;
+        mean += delta/n;
+        M2 += delta*(value - mean);
+        if (n == 1 || value < minimum) minimum = value;
+        if (n == 1 || value > maximum) maximum = value;
+    }
+    float variance(void) const {return n > 1 ? M2/(n - 1) : 0;}
+    float stdDev(void) const {return sqrt(variance());}
+    float get(aggregateStat stat) const
+    {
+        if (n == 0) return NAN;
+        switch (stat)
+        {
+            case statStdDev: return stdDev();
+            case statMin: return minimum;
+            case statMax: return maximum;
+            default: return mean;
+        }
+    }
+};
+
+// A summary of the parameter results over one window
+typedef struct parameterSummary
+{
+    uint32_t windowStart;  // Seconds from Jan 1, 1970
+    uint32_t windowLength;  // Seconds
+    // The counts of snapshots stop at 65535
+    uint16_t samples;  // The number of snapshots in the window
+    uint16_t deviceFlagged;  // The number of snapshots with any device status bit set
+    uint16_t deviceStatus;  // Every device status bit seen in the window
+    uint8_t count;  // The number of parameters
+    float mean[MAX_PARAMETERS];
+    float stdDev[MAX_PARAMETERS];
+    float minimum[MAX_PARAMETERS];
+    float maximum[MAX_PARAMETERS];
+    uint16_t flagged[MAX_PARAMETERS];  // The number of snapshots with any parameter status bit set
+    uint16_t status[MAX_PARAMETERS];  // Every parameter status bit seen in the window
+} parameterSummary;
+
+
+//----------------------------------------------------------------------------
+//          FUNCTIONS TO SUMMARIZE PARAMETER RESULTS OVER TIME WINDOWS
+//----------------------------------------------------------------------------
+// To use this, before adding each new snapshot, check whether it is past the
+// end of the current window.  If it is, send or save the summary and start
+// a new window:
+//    if (aggregator.windowEnded(snapshot.time))
+//    {
+//        aggregator.getSummary(summary);  // or printSummary(...)
+//        aggregator.startWindow(snapshot.time);
+//    }
+//    aggregator.add(snapshot);
+class scanParameterAggregator
+{
+
+public:
+
+    // The window length is in seconds; windows start on even multiples of it
+    // (ie, on the hour for 3600).  A length of 0 means the window only ends
+    // when startWindow() is called.
+    scanParameterAggregator(uint32_t windowLength = 3600);
+
+    // This clears everything and starts a window containing the given time
+    void startWindow(uint32_t time);
+
+    // This is true if the given time is past the end of a window that has
+    // any samples in it
+    bool windowEnded(uint32_t time);
+
+    // This adds a snapshot to the current window
+    void add(const parameterSnapshot &snapshot);
+
+    // This returns the number of snapshots in the current window
+    uint16_t getSamples(void){return _samples;}
+
+    // This returns the statistics for one parameter (counting from 1)
+    const scanStats &getStats(int parmNumber){return _stats[parmNumber - 1];}
+
+    // This fills in a summary of the current window
+    void getSummary(parameterSummary &summary);
+
+    // This prints the summary of the current window as one delimited row:
+    // window start, samples, then each parameter's statistics and flag count
+    void printSummary(Stream *stream, const char *dlm = ",");
+    void printSummary(Stream &stream, const char *dlm = ",");
+
+private:
+    uint32_t _windowLength;
+    uint32_t _windowStart;
+    uint16_t _samples;
+    uint16_t _deviceFlagged;
+    uint16_t _deviceStatus;
+    uint8_t _count;
+    scanStats _stats[MAX_PARAMETERS];
+    uint16_t _flagged[MAX_PARAMETERS];
+    uint16_t _status[MAX_PARAMETERS];
+};
+
+
+//----------------------------------------------------------------------------
+//          FUNCTIONS TO SUMMARIZE FINGERPRINTS OVER TIME WINDOWS
+//----------------------------------------------------------------------------
+// This works the same way as the parameter aggregator, but keeps statistics
+// for every wavelength.  It can be given whole spectra, or fed values as
+// they are streamed from the spectro::lyser, ie:
+//    uint32_t fpTime = spectro.getFingerprintTime();
+//    if (aggregator.windowEnded(fpTime)) {...}
+//    spectro.getFingerprintData(scanSpectrumAggregator::addValue, &aggregator);
+//    aggregator.endSpectrum(fpTime);
+// NB:  This takes about 4kb of RAM - too much for an AVR board.
+class scanSpectrumAggregator
+{
+
+public:
+
+    scanSpectrumAggregator(uint32_t windowLength = 3600);
+
+    // This clears everything and starts a window containing the given time
+    void startWindow(uint32_t time);
+
+    // This is true if the given time is past the end of a window that has
+    // any samples in it
+    bool windowEnded(uint32_t time);
+
+    // This adds a whole fingerprint to the current window
+    void add(const float *spectrum, uint32_t time);
+
+    // These add a streamed fingerprint, one value at a time
+    static void addValue(int index, float wavelength, float value, void *context);
+    void endSpectrum(uint32_t time);
+
+    // This returns the number of fingerprints in the current window
+    uint16_t getSamples(void){return _samples;}
+
+    // This returns the statistics for one wavelength (counting from 0)
+    const scanStats &getStats(int index){return _stats[index];}
+
+    // This prints one statistic for every wavelength as a delimited row,
+    // starting with the window start and number of samples
+    void printSummary(Stream *stream, aggregateStat stat, const char *dlm = ",");
+    void printSummary(Stream &stream, aggregateStat stat, const char *dlm = ",");
+
+private:
+    uint32_t _windowLength;
+    uint32_t _windowStart;
+    uint16_t _samples;
+    scanStats _stats[FINGERPRINT_VALUES];
+};
+
+#endif
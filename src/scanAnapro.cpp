@@ -93,6 +93,25 @@ void anapro::printParameterDataRow(Stream *stream, const char *dlm)
 void anapro::printParameterDataRow(Stream &stream, const char *dlm)
 {printParameterDataRow(&stream, dlm);}
 
+// This prints a parameter data row from a snapshot
+void anapro::printParameterDataRow(Stream *stream, const parameterSnapshot &snapshot, const char *dlm)
+{
+    stream->print(timeToStringDot(snapshot.time));
+    stream->print(dlm);
+    if (snapshot.deviceStatus == 0) {stream->print("Ok"); stream->print(dlm);}
+    else {stream->print("Error"); stream->print(dlm);}
+    for (int i = 0; i < snapshot.count; i++)
+    {
+        stream->print(snapshot.value[i], 3);
+        stream->print(dlm);
+        stream->print(snapshot.status[i]);
+        if (i < snapshot.count-1) stream->print(dlm);
+    }
+    stream->println();
+}
+void anapro::printParameterDataRow(Stream &stream, const parameterSnapshot &snapshot, const char *dlm)
+{printParameterDataRow(&stream, snapshot, dlm);}
+
 // This prints out a header for a "fp" file in the format that the
 // s::can/ana::xxx software is expecting
 void anapro::printFingerprintHeader(Stream *stream, const char *dlm, spectralSource source)
@@ -103,10 +122,10 @@ void anapro::printFingerprintHeader(Stream *stream, const char *dlm, spectralSou
     stream->print("Status");
     stream->print("_");
     stream->print(source);
-    for (float i = 200.00; i <= 750.00; i+=2.5)
+    for (int i = 0; i < inputReg::fFingerprintData.count(); i++)
     {
         stream->print(dlm);
-        stream->print(i, 2);
+        stream->print(scan::wavelength(i), 2);
     }
     stream->println();
 }
@@ -37,6 +37,12 @@ public:
     void printParameterDataRow(Stream *stream, const char *dlm="\t");
     void printParameterDataRow(Stream &stream, const char *dlm="\t");
 
+    // This prints the same row from a parameter snapshot (ie, one read back
+    // from a scanJournal) without asking the spectro::lyzer for anything.
+    // The status after each value is that parameter's own status.
+    void printParameterDataRow(Stream *stream, const parameterSnapshot &snapshot, const char *dlm="\t");
+    void printParameterDataRow(Stream &stream, const parameterSnapshot &snapshot, const char *dlm="\t");
+
     // This prints out a header for a "fp" file ini the format that the
     // s::can/ana::xxx software is expecting
     void printFingerprintHeader(Stream *stream, const char *dlm="\t", spectralSource source=fingerprint);
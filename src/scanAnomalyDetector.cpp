@@ -0,0 +1,216 @@
+/*
+ *scanAnomalyDetector.cpp
+*/
+
+#include "scanAnomalyDetector.h"
+
+#define ANOMALY_EPSILON 1e-12
+
+
+//----------------------------------------------------------------------------
+//      FUNCTIONS TO DETECT FOULING AND AIR BUBBLES FROM THE FINGERPRINT
+//----------------------------------------------------------------------------
+
+scanAnomalyDetector::scanAnomalyDetector(float learningRate, float threshold)
+{
+    _learningRate = learningRate;
+    _threshold = threshold;
+    _warmup = 30;
+    _scanMB = NULL;
+    _consecutive = 0;
+    _openSeconds = 0;
+    _valveOpen = false;
+    _valveOpenedAt = 0;
+    reset();
+}
+
+// This forgets everything that has been learned
+// The components start as orthogonal unit-length combs across the spectrum.
+void scanAnomalyDetector::reset(void)
+{
+    _samples = 0;
+    _anomalousInARow = 0;
+    _cleaningsInARow = 0;
+    _QMean = _QVariance = _T2Mean = _T2Variance = 0;
+    float scale = 1/sqrt((float)(FINGERPRINT_VALUES/ANOMALY_COMPONENTS));
+    for (int i = 0; i < FINGERPRINT_VALUES; i++) _mean[i] = 0;
+    for (int j = 0; j < ANOMALY_COMPONENTS; j++)
+    {
+        _variances[j] = 1;
+        for (int i = 0; i < FINGERPRINT_VALUES; i++)
+            _components[j][i] = (i % ANOMALY_COMPONENTS == j) ? scale : 0;
+    }
+}
+
+// This calculates the scores and the component values of a fingerprint
+// NAN values are treated as being on the baseline.
+void scanAnomalyDetector::calculate(const float *spectrum, float *components, anomalyScore &result)
+{
+    float *residual = _scratch;
+    for (int i = 0; i < FINGERPRINT_VALUES; i++)
+    {
+        residual[i] = spectrum[i] - _mean[i];
+        if (isnan(residual[i])) residual[i] = 0;
+    }
+
+    // Take out each component in turn, the same way they are learned, so
+    // what's left is right even before the components are quite orthogonal
+    for (int j = 0; j < ANOMALY_COMPONENTS; j++)
+    {
+        const float *v = _components[j];
+        float length = _variances[j] + ANOMALY_EPSILON;
+        float along = 0;
+        for (int i = 0; i < FINGERPRINT_VALUES; i++) along += residual[i]*v[i];
+        along /= length;
+        components[j] = along;
+        along /= length;
+        for (int i = 0; i < FINGERPRINT_VALUES; i++) residual[i] -= along*v[i];
+    }
+
+    // Q is the squared size of what's left
+    result.Q = 0;
+    for (int i = 0; i < FINGERPRINT_VALUES; i++) result.Q += residual[i]*residual[i];
+    result.T2 = 0;
+    for (int j = 0; j < ANOMALY_COMPONENTS; j++)
+        result.T2 += components[j]*components[j]/(_variances[j] + ANOMALY_EPSILON);
+
+    result.anomalous = _samples >= _warmup &&
+        (result.Q > _QMean + _threshold*sqrt(_QVariance) ||
+         result.T2 > _T2Mean + _threshold*sqrt(_T2Variance));
+    result.cleaned = false;
+    result.rebaselined = false;
+}
+
+// This scores a fingerprint without learning from it
+anomalyScore scanAnomalyDetector::score(const float *spectrum)
+{
+    anomalyScore result;
+    float components[ANOMALY_COMPONENTS];
+    calculate(spectrum, components, result);
+    return result;
+}
+
+// This scores a fingerprint, then learns from it if it's normal
+anomalyScore scanAnomalyDetector::add(const float *spectrum)
+{
+    anomalyScore result;
+    float components[ANOMALY_COMPONENTS];
+    if (_samples == 0)
+    {
+        // Start the baseline at the first fingerprint
+        for (int i = 0; i < FINGERPRINT_VALUES; i++)
+            _mean[i] = isnan(spectrum[i]) ? 0 : spectrum[i];
+    }
+    calculate(spectrum, components, result);
+
+    if (result.anomalous)
+    {
+        if (_anomalousInARow < 0xFF) _anomalousInARow++;
+        if (_scanMB != NULL && _anomalousInARow >= _consecutive &&
+            _cleaningsInARow >= ANOMALY_MAX_CLEANINGS)
+        {
+            // Cleaning hasn't brought it back, so it's the water that has
+            // changed; start over from this fingerprint (which only goes one
+            // deep, since nothing is flagged while warming up)
+            reset();
+            result = add(spectrum);
+            result.rebaselined = true;
+        }
+        else if (_scanMB != NULL && !_valveOpen && _anomalousInARow >= _consecutive)
+        {
+            if (_scanMB->setCleaningMode(cleaningOn))
+            {
+                _valveOpen = true;
+                _valveOpenedAt = millis();
+                result.cleaned = true;
+                _cleaningsInARow++;
+            }
+            _anomalousInARow = 0;
+        }
+    }
+    else
+    {
+        _anomalousInARow = 0;
+        _cleaningsInARow = 0;
+        learn(spectrum, components, result);
+    }
+    return result;
+}
+
+// This learns from a fingerprint
+// The components are learned with candid covariance-free incremental PCA
+// (Weng et al., 2003): each component vector v is pulled toward the
+// deviation d in proportion to how much of d lies along it,
+//    v = (1 - rate)*v + rate*(d.v/|v|)*d
+// then that part of d is taken out before updating the next component.
+// The length of each vector converges to the variance along it, so no
+// separate step size or scaling is needed.
+void scanAnomalyDetector::learn(const float *spectrum, const float *components,
+                                const anomalyScore &result)
+{
+    _samples++;
+    float alpha = _learningRate;
+    if (_samples < 1/_learningRate) alpha = 1.0/(_samples + 1);  // Learn fast at first
+
+    // Update the usual sizes of the scores
+    if (_samples > 1)
+    {
+        updateEWMA(result.Q, _QMean, _QVariance);
+        updateEWMA(result.T2, _T2Mean, _T2Variance);
+    }
+
+    // Get the deviation from the mean, then update the mean
+    // The residual from scoring is done with, so its space is reused
+    float *deviation = _scratch;
+    for (int i = 0; i < FINGERPRINT_VALUES; i++)
+    {
+        float d = spectrum[i] - _mean[i];
+        if (isnan(d)) d = 0;
+        deviation[i] = d;
+        _mean[i] += alpha*d;
+    }
+
+    // Update each component, then take it out of the deviation
+    for (int j = 0; j < ANOMALY_COMPONENTS; j++)
+    {
+        float *v = _components[j];
+        float along = components[j];  // Already calculated while scoring
+        float lengthSquared = 0;
+        float dot = 0;
+        for (int i = 0; i < FINGERPRINT_VALUES; i++)
+        {
+            v[i] = (1 - alpha)*v[i] + alpha*along*deviation[i];
+            lengthSquared += v[i]*v[i];
+            dot += deviation[i]*v[i];
+        }
+        _variances[j] = sqrt(lengthSquared);
+        float scale = dot/(lengthSquared + ANOMALY_EPSILON);
+        for (int i = 0; i < FINGERPRINT_VALUES; i++) deviation[i] -= scale*v[i];
+    }
+}
+
+// This updates an exponentially weighted mean and variance
+void scanAnomalyDetector::updateEWMA(float value, float &mean, float &variance)
+{
+    float alpha = _learningRate;
+    if (_samples < 1/_learningRate) alpha = 1.0/(_samples + 1);
+    float delta = value - mean;
+    mean += alpha*delta;
+    variance = (1 - alpha)*(variance + alpha*delta*delta);
+}
+
+// This sets up automatic cleaning
+void scanAnomalyDetector::setCleaning(scan *scanMB, uint8_t consecutive, uint16_t openSeconds)
+{
+    _scanMB = scanMB;
+    _consecutive = consecutive > 0 ? consecutive : 1;
+    _openSeconds = openSeconds;
+}
+
+// This closes the cleaning valve once it has been open long enough
+void scanAnomalyDetector::poll(void)
+{
+    if (!_valveOpen) return;
+    if (millis() - _valveOpenedAt < (uint32_t)_openSeconds*1000) return;
+    if (_scanMB->setCleaningMode(cleaningOff)) _valveOpen = false;
+}
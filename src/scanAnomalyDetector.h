@@ -0,0 +1,126 @@
+/*
+ *scanAnomalyDetector.h
+*/
+
+#ifndef scanAnomalyDetector_h
+#define scanAnomalyDetector_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For opening the cleaning valve and the spectrum size
+
+// The number of principal components to track
+// More of them cover more kinds of normal variation in the water, but each
+// adds a full-length vector to the detector and another pass over the
+// fingerprint to every score.
+#ifndef ANOMALY_COMPONENTS
+#define ANOMALY_COMPONENTS 3
+#endif
+
+// How many cleanings in a row can fail to bring the fingerprints back to
+// normal before the detector decides the water itself has changed, and
+// starts a new baseline instead of cleaning again
+#ifndef ANOMALY_MAX_CLEANINGS
+#define ANOMALY_MAX_CLEANINGS 3
+#endif
+
+// The result of scoring one fingerprint
+typedef struct anomalyScore
+{
+    float Q;  // Squared distance from the baseline outside the principal components
+    float T2;  // Hotelling's T^2 distance within the principal components
+    bool anomalous;  // True if either is beyond the threshold
+    bool cleaned;  // True if this fingerprint triggered a cleaning
+    bool rebaselined;  // True if this fingerprint started a new baseline
+} anomalyScore;
+
+
+//----------------------------------------------------------------------------
+//      FUNCTIONS TO DETECT FOULING AND AIR BUBBLES FROM THE FINGERPRINT
+//----------------------------------------------------------------------------
+// This keeps a running model of what "normal" fingerprints look like: an
+// exponentially weighted mean spectrum plus the few directions the spectrum
+// normally varies in (principal components, learned one spectrum at a time
+// with candid covariance-free incremental PCA).  Each new fingerprint is scored by
+// how far it is from the mean within those directions (T^2) and outside of
+// them (Q).  Fouling and bubbles shift the whole spectrum in ways normal
+// water-quality changes don't, which shows up in Q long before the sensor
+// status bits are set.
+// Scoring and learning are both O(values x components).
+// Anomalous fingerprints are not learned from, so fouling that builds up
+// slowly will still be flagged.  That also means a real, lasting change in
+// the water would be flagged forever, so once ANOMALY_MAX_CLEANINGS
+// cleanings in a row haven't helped, the detector forgets what it has
+// learned and starts again from the current fingerprint (warming up again
+// before it flags anything).  Without cleaning set up, call reset() if
+// the fingerprints stay anomalous.
+class scanAnomalyDetector
+{
+
+public:
+
+    // The learning rate sets how quickly the baseline follows the water
+    // (smaller = slower); the threshold is how many standard deviations
+    // above its usual level a score has to be to be anomalous.
+    scanAnomalyDetector(float learningRate = 0.02, float threshold = 4.0);
+
+    // This forgets everything that has been learned
+    void reset(void);
+
+    // This sets how many fingerprints to learn from before flagging anything
+    void setWarmup(uint16_t samples){_warmup = samples;}
+
+    // This returns how many fingerprints have been learned from
+    uint16_t getSamples(void){return _samples;}
+
+    // This scores a fingerprint without learning from it
+    anomalyScore score(const float *spectrum);
+
+    // This scores a fingerprint, then learns from it if it's normal
+    // If cleaning has been set up and enough fingerprints in a row are
+    // anomalous, this opens the cleaning valve, or starts a new baseline if
+    // the last ANOMALY_MAX_CLEANINGS cleanings didn't help.
+    anomalyScore add(const float *spectrum);
+
+    // This lets the detector open the cleaning valve when the given number
+    // of fingerprints in a row are anomalous, and close it again after the
+    // given number of seconds.  Call poll() regularly to close the valve.
+    void setCleaning(scan *scanMB, uint8_t consecutive = 3, uint16_t openSeconds = 3);
+
+    // This closes the cleaning valve once it has been open long enough
+    void poll(void);
+
+    // This returns the baseline (mean) spectrum
+    const float *getBaseline(void){return _mean;}
+
+private:
+    // This calculates the scores and the component values of a fingerprint
+    void calculate(const float *spectrum, float *components, anomalyScore &result);
+
+    // This learns from a fingerprint
+    void learn(const float *spectrum, const float *components, const anomalyScore &result);
+
+    // This updates an exponentially weighted mean and variance
+    void updateEWMA(float value, float &mean, float &variance);
+
+    float _learningRate;
+    float _threshold;
+    uint16_t _warmup;
+    uint16_t _samples;
+    float _mean[FINGERPRINT_VALUES];
+    float _components[ANOMALY_COMPONENTS][FINGERPRINT_VALUES];  // Not unit length!
+    float _variances[ANOMALY_COMPONENTS];  // The length of each component, which is the variance along it
+    // Space for the residual while scoring and the deviation while learning,
+    // so neither has to fit on the stack
+    float _scratch[FINGERPRINT_VALUES];
+    float _QMean, _QVariance, _T2Mean, _T2Variance;
+
+    scan *_scanMB;
+    uint8_t _consecutive;
+    uint8_t _anomalousInARow;
+    uint8_t _cleaningsInARow;  // Cleanings with no normal fingerprint since
+    uint16_t _openSeconds;
+    bool _valveOpen;
+    uint32_t _valveOpenedAt;
+};
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ *scanBusMonitor.cpp
+*/
+
+#include "scanBusMonitor.h"
+
+
+//----------------------------------------------------------------------------
+//                 LISTENING TO SOMEONE ELSE'S MODBUS TRAFFIC
+//----------------------------------------------------------------------------
+
+scanBusMonitor::scanBusMonitor(Stream *stream, uint32_t baud)
+{
+    _stream = stream;
+    _gap = scanRTU::frameGapMicros(baud);
+    _slaveID = 0;
+    _length = 0;
+    _overflow = false;
+    _lastByte = 0;
+    _pending = false;
+    _parmCount = 0;
+    _snapshotCallback = NULL;
+    _snapshotContext = NULL;
+    _fingerprintCallback = NULL;
+    _fingerprintContext = NULL;
+    _frames = 0;
+    _responses = 0;
+    _errors = 0;
+    _unmatched = 0;
+    _snapshotSlave = 0;
+    _reported = true;  // So starting the first snapshot doesn't report anything
+    finishSnapshot();
+}
+scanBusMonitor::scanBusMonitor(Stream &stream, uint32_t baud)
+  : scanBusMonitor(&stream, baud) {}
+
+void scanBusMonitor::setParameterCount(uint8_t count)
+{_parmCount = count > MAX_PARAMETERS ? MAX_PARAMETERS : count;}
+
+void scanBusMonitor::setSnapshotCallback(monitorCallback callback, void *context)
+{
+    _snapshotCallback = callback;
+    _snapshotContext = context;
+}
+
+void scanBusMonitor::setFingerprintCallback(sweepCallback callback, void *context)
+{
+    _fingerprintCallback = callback;
+    _fingerprintContext = context;
+}
+
+bool scanBusMonitor::task(void)
+{
+    bool decoded = false;
+    uint32_t now = micros();
+    while (_stream->available() > 0)
+    {
+        byte c = _stream->read();
+        // A silence since the last byte ends the frame, whatever is in it
+        if (_length > 0 && now - _lastByte >= _gap) decoded |= endFrame();
+        if (_length < MONITOR_BUFFER_SIZE) _buffer[_length++] = c;
+        else _overflow = true;
+        _lastByte = now;
+        if (frameComplete()) decoded |= endFrame();
+    }
+    if (_length > 0 && micros() - _lastByte >= _gap) decoded |= endFrame();
+    return decoded;
+}
+
+void scanBusMonitor::flush(void)
+{
+    finishSnapshot();
+}
+
+// A frame doesn't say how long it is, so this checks the CRC at each length
+// it could be for its function code:  a read request (8 bytes), a read
+// response (5 + byte count), a write request (9 + byte count) or response
+// (8), or an exception (5).  After a read request, only the response
+// length is checked.
+bool scanBusMonitor::frameComplete(void)
+{
+    if (_length < 5 || _overflow) return false;
+    byte function = _buffer[1];
+    bool couldBe = false;
+    if (function & 0x80) couldBe = _length == 5;
+    else if (function == 0x03 || function == 0x04)
+    {
+        if (_pending && _buffer[0] == _pendingSlave && function == _pendingFunction)
+            couldBe = _length == 5 + 2*_pendingCount;
+        else couldBe = _length == 8 || _length == 5 + _buffer[2];
+    }
+    else if (function == 0x10)
+        couldBe = _length == 8 || (_length >= 7 && _length == 9 + _buffer[6]);
+    else couldBe = _length == 8;
+    return couldBe && scanRTU::checkCRC(_buffer, _length);
+}
+
+bool scanBusMonitor::endFrame(void)
+{
+    int length = _length;
+    bool overflow = _overflow;
+    _length = 0;
+    _overflow = false;
+    if (overflow || length < 5 || !scanRTU::checkCRC(_buffer, length))
+    {
+        _errors++;
+        _pending = false;
+        return false;
+    }
+    _frames++;
+
+    byte slaveID = _buffer[0];
+    byte function = _buffer[1];
+    if (function != 0x03 && function != 0x04)
+    {
+        _pending = false;
+        return false;
+    }
+
+    // A response to the request before it
+    if (_pending && slaveID == _pendingSlave && function == _pendingFunction &&
+        length == 5 + 2*_pendingCount && _buffer[2] == 2*_pendingCount)
+    {
+        _pending = false;
+        _responses++;
+        if (_slaveID != 0 && slaveID != _slaveID) return false;
+        scanFrame frame(_buffer);
+        if (function == 0x04)
+        {
+            decodeParameters(slaveID, frame, _pendingStart);
+            decodeFingerprint(frame, _pendingStart);
+        }
+        return true;
+    }
+
+    // A new request
+    if (length == 8)
+    {
+        _pending = true;
+        _pendingSlave = slaveID;
+        _pendingFunction = function;
+        _pendingStart = ((uint16_t)_buffer[2] << 8) | _buffer[3];
+        _pendingCount = ((uint16_t)_buffer[4] << 8) | _buffer[5];
+        return false;
+    }
+
+    _unmatched++;
+    _pending = false;
+    return false;
+}
+
+// The parts are put together the same way scan::getParameterSnapshot does,
+// but from whatever frames the master happens to ask for
+void scanBusMonitor::decodeParameters(byte slaveID, const scanFrame &frame, int frameStart)
+{
+    if (slaveID != _snapshotSlave) finishSnapshot();
+    _snapshotSlave = slaveID;
+
+    int countReg = inputReg::uiParameterCount.at() - frameStart;
+    if (frame.contains(countReg)) setParameterCount(frame.uint16At(countReg));
+
+    int timeReg = inputReg::tSampleTime.at() - frameStart;
+    if (frame.contains(timeReg, inputReg::tSampleTime.width()))
+    {
+        uint32_t nanoseconds;
+        uint32_t time = frame.TAI64NAt(timeReg, nanoseconds);
+        // A new sample time is a new measurement
+        if (_haveTime && time != _snapshot.time) finishSnapshot();
+        _snapshot.time = time;
+        _haveTime = true;
+    }
+
+    int statusReg = inputReg::bmDeviceStatus.at() - frameStart;
+    if (frame.contains(statusReg)) _snapshot.deviceStatus = frame.uint16At(statusReg);
+
+    for (int n = 1; n <= MAX_PARAMETERS; n++)
+    {
+        int firstReg = inputReg::bmPStatus.at(n) - frameStart;
+        int lastReg = inputReg::xPValue.at(n) + 1 - frameStart;
+        if (!frame.contains(firstReg, lastReg - firstReg + 1)) continue;
+        // Without a sample time, seeing a parameter again is the only sign
+        // of a new measurement
+        if (!_haveTime && (_parmsSeen & (1UL << (n - 1)))) finishSnapshot();
+        _snapshot.status[n - 1] = frame.uint16At(firstReg);
+        _snapshot.specStatus[n - 1] = frame.uint16At(inputReg::bmPPrivStatus.at(n) - frameStart);
+        _snapshot.value[n - 1] = frame.float32At(inputReg::xPValue.at(n) - frameStart);
+        _parmsSeen |= 1UL << (n - 1);
+    }
+
+    // Hand it on as soon as it's whole
+    if (!_reported && _haveTime && _parmCount > 0)
+    {
+        uint32_t all = (_parmCount >= 32) ? 0xFFFFFFFF : (1UL << _parmCount) - 1;
+        if ((_parmsSeen & all) == all) reportSnapshot();
+    }
+}
+
+void scanBusMonitor::decodeFingerprint(const scanFrame &frame, int frameStart)
+{
+    if (_fingerprintCallback == NULL) return;
+    const scanRegister &reg = inputReg::fFingerprintData;
+    int frameEnd = frameStart + frame.registers();
+    for (int source = 0; source <= other; source++)
+    {
+        int first = reg.at(source);
+        if (frameEnd <= first || frameStart >= first + reg.length) continue;
+        // Only whole values, starting on a value boundary
+        int index = frameStart > first ? (frameStart - first + 1)/2 : 0;
+        for (; index < reg.count(); index++)
+        {
+            int valueReg = first + index*reg.width() - frameStart;
+            if (!frame.contains(valueReg, reg.width())) break;
+            _fingerprintCallback((spectralSource)source, index, scan::wavelength(index),
+                                 frame.float32At(valueReg), _fingerprintContext);
+        }
+    }
+}
+
+void scanBusMonitor::finishSnapshot(void)
+{
+    if (!_reported && (_haveTime || _parmsSeen != 0)) reportSnapshot();
+    _snapshot.time = 0;
+    _snapshot.deviceStatus = 0;
+    _snapshot.count = 0;
+    for (int i = 0; i < MAX_PARAMETERS; i++)
+    {
+        _snapshot.status[i] = 0;
+        _snapshot.specStatus[i] = 0;
+        _snapshot.value[i] = NAN;
+    }
+    _haveTime = false;
+    _parmsSeen = 0;
+    _reported = false;
+}
+
+void scanBusMonitor::reportSnapshot(void)
+{
+    // If the parameter count isn't known, it's the highest one seen
+    uint8_t count = _parmCount;
+    if (count == 0)
+        for (int n = 1; n <= MAX_PARAMETERS; n++)
+            if (_parmsSeen & (1UL << (n - 1))) count = n;
+    _snapshot.count = count;
+    _reported = true;
+    if (_snapshotCallback != NULL) _snapshotCallback(_snapshotSlave, _snapshot, _snapshotContext);
+}
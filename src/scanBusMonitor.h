@@ -0,0 +1,127 @@
+/*
+ *scanBusMonitor.h
+*/
+
+#ifndef scanBusMonitor_h
+#define scanBusMonitor_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For the snapshot, register map, and sweep callback
+#include "scanRTU.h"  // For the CRC and frame timing
+
+// The longest RTU frame there can be (slave ID + PDU + CRC)
+#define MONITOR_BUFFER_SIZE 256
+
+// This is called with every parameter snapshot seen on the bus
+typedef void (*monitorCallback)(byte slaveID, const parameterSnapshot &snapshot, void *context);
+
+
+//----------------------------------------------------------------------------
+//                 LISTENING TO SOMEONE ELSE'S MODBUS TRAFFIC
+//----------------------------------------------------------------------------
+// This listens, without ever sending anything, to the traffic between
+// another modbus master (ie, a con::cube or PLC) and the spectro::lyser.
+// Frames are split by the 3.5 character silence between them (or sooner,
+// once the bytes so far make a whole frame with a good CRC), each response
+// is matched to the request before it, and the register ranges it covers
+// are decoded with the same register map and frame decoding as scan:
+//  - the sample time, device status, and each parameter's block of 8
+//    registers (120 + 8n) are put together into parameter snapshots
+//  - fingerprint values (522 + 512n) are handed on as they are seen
+// so the results come out just as if they had been polled, with no added
+// traffic on the bus.
+//
+// Bytes must be read off the port at least once per character time for the
+// timing to be right, so call task() as often as possible.  An enable pin
+// for an RS-485 adapter must be held LOW (receive).
+//
+//    scanBusMonitor monitor(Serial1, 38400);
+//    monitor.setSnapshotCallback(printSnapshot);
+//    while (true) monitor.task();
+class scanBusMonitor
+{
+
+public:
+    scanBusMonitor(Stream *stream, uint32_t baud);
+    scanBusMonitor(Stream &stream, uint32_t baud);
+
+    // This only decodes traffic to and from one slave (0 for any)
+    void setSlaveID(byte slaveID) {_slaveID = slaveID;}
+
+    // This sets how many parameters make a whole snapshot.  If it isn't set,
+    // it's learned if the master reads the parameter count (input register
+    // 22); until then, a snapshot is finished when a new sample time or a
+    // parameter that's already been seen turns up.
+    void setParameterCount(uint8_t count);
+
+    // These set the functions that are given each snapshot and each
+    // fingerprint value
+    void setSnapshotCallback(monitorCallback callback, void *context = NULL);
+    void setFingerprintCallback(sweepCallback callback, void *context = NULL);
+
+    // This reads whatever has arrived and handles any finished frames
+    // Returns true if a response was decoded.
+    bool task(void);
+
+    // This hands on the snapshot being put together, even if it isn't whole
+    void flush(void);
+
+    // These return counts of what's been seen
+    uint32_t getFrameCount(void) {return _frames;}
+    uint32_t getResponseCount(void) {return _responses;}
+    uint32_t getErrorCount(void) {return _errors;}  // Bad CRC or too long
+    uint32_t getUnmatchedCount(void) {return _unmatched;}  // Responses without a request
+
+private:
+    // This returns true if the bytes so far are a whole frame with a good CRC
+    bool frameComplete(void);
+
+    // This checks and handles the frame in the buffer and empties it
+    bool endFrame(void);
+
+    // These decode a read response that started at the given register
+    void decodeParameters(byte slaveID, const scanFrame &frame, int frameStart);
+    void decodeFingerprint(const scanFrame &frame, int frameStart);
+
+    // This hands on the snapshot (if it hasn't been already) and starts a
+    // new one
+    void finishSnapshot(void);
+
+    // This hands the snapshot to the callback
+    void reportSnapshot(void);
+
+    Stream *_stream;
+    uint32_t _gap;  // The silence that ends a frame (us)
+    byte _slaveID;
+    byte _buffer[MONITOR_BUFFER_SIZE];
+    int _length;
+    bool _overflow;
+    uint32_t _lastByte;  // When the last byte arrived (us)
+
+    // The request waiting for a response
+    bool _pending;
+    byte _pendingSlave;
+    byte _pendingFunction;
+    uint16_t _pendingStart;
+    uint16_t _pendingCount;
+
+    // The snapshot being put together
+    parameterSnapshot _snapshot;
+    byte _snapshotSlave;
+    uint8_t _parmCount;  // 0 if unknown
+    bool _haveTime;
+    uint32_t _parmsSeen;  // Bit n-1 is set once parameter n is in
+    bool _reported;  // Whether this snapshot has been handed on
+
+    monitorCallback _snapshotCallback;
+    void *_snapshotContext;
+    sweepCallback _fingerprintCallback;
+    void *_fingerprintContext;
+
+    uint32_t _frames;
+    uint32_t _responses;
+    uint32_t _errors;
+    uint32_t _unmatched;
+};
+
+#endif
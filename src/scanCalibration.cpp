@@ -0,0 +1,130 @@
+/*
+ *scanCalibration.cpp
+*/
+
+#include "scanCalibration.h"
+
+
+//----------------------------------------------------------------------------
+//            FUNCTIONS TO APPLY THE LOCAL CALIBRATIONS ON THE ARDUINO
+//----------------------------------------------------------------------------
+
+// This reads the calibration settings of every parameter
+// Everything from the upper limit to the precision is within 20 registers,
+// so each parameter takes just one frame.
+bool scanCalibration::begin(void)
+{
+    _count = _scanMB->getParameterCount();
+    if (_count > MAX_PARAMETERS) _count = MAX_PARAMETERS;
+    if (_count < 0) _count = 0;
+
+    bool success = true;
+    for (int parm = 1; parm <= _count; parm++)
+    {
+        int firstReg = holdingReg::xPUpperLimit.at(parm);
+        int numRegs = holdingReg::uiPPrecision.at(parm) - firstReg + 1;
+        if (!_scanMB->modbus.getRegisters(0x03, firstReg, numRegs))
+        {
+            // Leave this parameter uncorrected
+            setCalibration(parm, 0, 1, 0, 0);
+            for (int i = 0; i < 4; i++) _deviceCoeffs[parm - 1][i] = _coeffs[parm - 1][i];
+            _upper[parm - 1] = NAN;
+            _lower[parm - 1] = NAN;
+            _precision[parm - 1] = 0;
+            _roundScale[parm - 1] = 0;
+            success = false;
+            continue;
+        }
+        scanFrame frame = _scanMB->lastFrame();
+        _upper[parm - 1] = frame.float32At(holdingReg::xPUpperLimit.at(parm) - firstReg);
+        _lower[parm - 1] = frame.float32At(holdingReg::xPLowerLimit.at(parm) - firstReg);
+        frame.copyTo(_coeffs[parm - 1], 4, holdingReg::fCalibrCoeff.at(parm) - firstReg);
+        for (int i = 0; i < 4; i++) _deviceCoeffs[parm - 1][i] = _coeffs[parm - 1][i];
+        _precision[parm - 1] = frame.uint16At(holdingReg::uiPPrecision.at(parm) - firstReg);
+        // Anything beyond 6 decimal places is past what a float can hold
+        if (_precision[parm - 1] > 6) _roundScale[parm - 1] = 0;
+        else _roundScale[parm - 1] = pow(10, _precision[parm - 1]);
+    }
+    return success;
+}
+
+// This replaces the cached calibration of a parameter
+void scanCalibration::setCalibration(int parmNumber, float offset, float slope, float x2, float x3)
+{
+    _coeffs[parmNumber - 1][0] = offset;
+    _coeffs[parmNumber - 1][1] = slope;
+    _coeffs[parmNumber - 1][2] = x2;
+    _coeffs[parmNumber - 1][3] = x3;
+}
+
+// This clips a value to the limits and rounds it to the precision
+// Limits that couldn't be read (NAN) are ignored.
+float scanCalibration::limit(int parmNumber, float value)
+{
+    if (value > _upper[parmNumber - 1]) value = _upper[parmNumber - 1];
+    if (value < _lower[parmNumber - 1]) value = _lower[parmNumber - 1];
+    float scale = _roundScale[parmNumber - 1];
+    if (scale > 0) value = floor(value*scale + 0.5)/scale;
+    return value;
+}
+
+// This applies the calibration of a parameter to one value
+float scanCalibration::apply(int parmNumber, float value)
+{
+    if (parmNumber < 1 || parmNumber > _count) return value;
+    const float *c = _coeffs[parmNumber - 1];
+    return limit(parmNumber, c[0] + value*(c[1] + value*(c[2] + value*c[3])));
+}
+
+// This applies the calibration of a parameter to an array of values
+// The coefficients are pulled out of the arrays once, before the loop.
+void scanCalibration::apply(int parmNumber, float values[], int numValues)
+{
+    if (parmNumber < 1 || parmNumber > _count) return;
+    float c0 = _coeffs[parmNumber - 1][0];
+    float c1 = _coeffs[parmNumber - 1][1];
+    float c2 = _coeffs[parmNumber - 1][2];
+    float c3 = _coeffs[parmNumber - 1][3];
+    for (int i = 0; i < numValues; i++)
+    {
+        float x = values[i];
+        values[i] = c0 + x*(c1 + x*(c2 + x*c3));
+    }
+    for (int i = 0; i < numValues; i++) values[i] = limit(parmNumber, values[i]);
+}
+
+// This undoes the spectro::lyser's calibration of a parameter
+// A cubic has no simple inverse, so this uses Newton's method, starting
+// from the linear part (which is exact when x2 and x3 are 0).
+float scanCalibration::uncalibrate(int parmNumber, float value)
+{
+    if (parmNumber < 1 || parmNumber > _count) return value;
+    const float *c = _deviceCoeffs[parmNumber - 1];
+    if (c[1] == 0 && c[2] == 0 && c[3] == 0) return NAN;
+    float x = c[1] != 0 ? (value - c[0])/c[1] : 0;
+    for (int i = 0; i < CALIBRATION_INVERSE_STEPS; i++)
+    {
+        float error = c[0] + x*(c[1] + x*(c[2] + x*c[3])) - value;
+        float slope = c[1] + x*(2*c[2] + 3*x*c[3]);
+        if (slope == 0) return NAN;
+        float step = error/slope;
+        x -= step;
+        if (fabs(step) <= 1e-6*(1 + fabs(x))) return x;
+    }
+    return NAN;
+}
+
+// This changes an array of values from the spectro::lyser's calibration
+void scanCalibration::recalibrate(int parmNumber, float values[], int numValues)
+{
+    if (parmNumber < 1 || parmNumber > _count) return;
+    for (int i = 0; i < numValues; i++) values[i] = uncalibrate(parmNumber, values[i]);
+    apply(parmNumber, values, numValues);
+}
+
+// This changes every value in a snapshot from the spectro::lyser's calibrations
+void scanCalibration::recalibrate(parameterSnapshot &snapshot)
+{
+    for (int parm = 1; parm <= snapshot.count && parm <= _count; parm++)
+        snapshot.value[parm - 1] = apply(parm, uncalibrate(parm, snapshot.value[parm - 1]));
+}
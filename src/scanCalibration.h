@@ -0,0 +1,93 @@
+/*
+ *scanCalibration.h
+*/
+
+#ifndef scanCalibration_h
+#define scanCalibration_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For modbus communication
+
+// The most Newton's method steps to take undoing a cubic calibration
+#ifndef CALIBRATION_INVERSE_STEPS
+#define CALIBRATION_INVERSE_STEPS 20
+#endif
+
+
+//----------------------------------------------------------------------------
+//            FUNCTIONS TO APPLY THE LOCAL CALIBRATIONS ON THE ARDUINO
+//----------------------------------------------------------------------------
+// The spectro::lyser applies a cubic "local calibration" to each parameter:
+//    corrected = offset + slope*x + x2*x^2 + x3*x^3
+// then clips it to the parameter limits and rounds it to the parameter
+// precision.  This keeps a copy of all of those settings so the same
+// correction can be applied to values on the Arduino (ie, to re-calculate
+// a logged history after the local calibration has been changed) without
+// asking the spectro::lyser for them again.
+// Values read from the spectro::lyser already have its calibration applied,
+// so recalibrate() undoes that one (as read by begin()) before applying the
+// cached one.  The clipping and rounding the spectro::lyser did can't be
+// undone, so values at its limits stay at them.
+class scanCalibration
+{
+
+public:
+
+    scanCalibration(scan *scanMB){_scanMB = scanMB; _count = 0;}
+
+    // This reads the calibration coefficients, limits, and precision of
+    // every parameter, with one modbus frame per parameter.
+    // Returns true if all were read.
+    bool begin(void);
+
+    // This returns the number of parameters with calibrations loaded
+    int getParameterCount(void){return _count;}
+
+    // These return the cached settings for a parameter
+    float getCalibOffset(int parmNumber){return _coeffs[parmNumber - 1][0];}
+    float getCalibSlope(int parmNumber){return _coeffs[parmNumber - 1][1];}
+    float getCalibX2(int parmNumber){return _coeffs[parmNumber - 1][2];}
+    float getCalibX3(int parmNumber){return _coeffs[parmNumber - 1][3];}
+    float getUpperLimit(int parmNumber){return _upper[parmNumber - 1];}
+    float getLowerLimit(int parmNumber){return _lower[parmNumber - 1];}
+    uint16_t getPrecision(int parmNumber){return _precision[parmNumber - 1];}
+
+    // This replaces the cached calibration of a parameter, ie, to try out a
+    // new local calibration before it is put on the spectro::lyser
+    void setCalibration(int parmNumber, float offset, float slope, float x2, float x3);
+
+    // This applies the calibration of a parameter to one value
+    float apply(int parmNumber, float value);
+
+    // This applies the calibration of a parameter to an array of values,
+    // in place, ie, a back-log of values from a single parameter
+    void apply(int parmNumber, float values[], int numValues);
+
+    // This undoes the spectro::lyser's calibration of a parameter (as read by
+    // begin()), giving the value before it was calibrated.  Returns NAN if the
+    // calibration can't be inverted there.
+    float uncalibrate(int parmNumber, float value);
+
+    // This changes an array of values read from the spectro::lyser, in place,
+    // from its calibration of a parameter to the cached one
+    void recalibrate(int parmNumber, float values[], int numValues);
+
+    // This changes every value in a snapshot read from the spectro::lyser, in
+    // place, from its calibrations to the cached ones
+    void recalibrate(parameterSnapshot &snapshot);
+
+private:
+    // This clips a value to the limits and rounds it to the precision
+    float limit(int parmNumber, float value);
+
+    scan *_scanMB;
+    int _count;
+    float _coeffs[MAX_PARAMETERS][4];  // offset, slope, x2, x3
+    float _deviceCoeffs[MAX_PARAMETERS][4];  // As read from the spectro::lyser
+    float _upper[MAX_PARAMETERS];
+    float _lower[MAX_PARAMETERS];
+    uint16_t _precision[MAX_PARAMETERS];
+    float _roundScale[MAX_PARAMETERS];  // 10^precision, or 0 to skip rounding
+};
+
+#endif
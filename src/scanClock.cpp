@@ -0,0 +1,100 @@
+/*
+ *scanClock.cpp
+*/
+
+#include "scanClock.h"
+
+// After this long (s) the millisecond difference from the baseline would
+// overflow, so the drift is worked out from a new baseline (keeping the old
+// drift until the new span is long enough)
+#define CLOCK_MAX_DRIFT_SPAN 2000000L  // about 23 days
+
+
+//----------------------------------------------------------------------------
+//                   KEEPING TIME WITHOUT ASKING THE PROBE
+//----------------------------------------------------------------------------
+
+scanClock::scanClock(scan *spectro, clockSource clock)
+{
+    _spectro = spectro;
+    _clock = clock;
+    _synced = false;
+    _lastSync = 0;
+    _anchorLocal = 0;
+    _anchorProbe = 0;
+    _baseLocal = 0;
+    _baseProbe = 0;
+    _drift = 0;
+    _offset = 0;
+}
+scanClock::scanClock(scan &spectro, clockSource clock)
+  : scanClock(&spectro, clock) {}
+
+bool scanClock::sync(void)
+{
+    uint32_t probeTime = _spectro->getSystemTime();
+    uint32_t local = _clock();
+    if (probeTime == 0) return false;
+
+    if (!_synced) setBaseline(local, probeTime);
+    else
+    {
+        // If the probe's clock isn't close to where it should be, someone
+        // has set it; start again from here
+        int32_t error = (int32_t)(probeTime - now());
+        if (error > CLOCK_JUMP || error < -CLOCK_JUMP) setBaseline(local, probeTime);
+        else if (probeTime - _baseProbe > CLOCK_MAX_DRIFT_SPAN) setBaseline(local, probeTime);
+        else
+        {
+            // The readings are only to the second, so compare against the
+            // first one of the span; the longer the span the better the
+            // drift is known
+            uint32_t span = local - _baseLocal;
+            if (span >= CLOCK_MIN_DRIFT_SPAN)
+                _drift = ((float)(probeTime - _baseProbe)*1000.0 - span)/span;
+        }
+    }
+
+    _anchorLocal = local;
+    _anchorProbe = probeTime;
+    _lastSync = local;
+    _synced = true;
+    return true;
+}
+
+bool scanClock::needsSync(void)
+{
+    return !_synced || _clock() - _lastSync >= (uint32_t)CLOCK_SYNC_INTERVAL;
+}
+
+uint32_t scanClock::now(void)
+{
+    if (!_synced) return 0;
+    uint32_t elapsed = _clock() - _anchorLocal;
+    // The probe's clock had already counted part of the second it was read
+    // in; take the middle of it
+    int32_t ms = 500 + elapsed + lround(elapsed*_drift);
+    return _anchorProbe + ms/1000;
+}
+
+bool scanClock::correct(uint32_t referenceTime, uint32_t threshold)
+{
+    if (!_synced && !sync()) return false;
+    _offset = (int32_t)(now() - referenceTime);
+    if (_offset <= (int32_t)threshold && _offset >= -(int32_t)threshold) return true;
+
+    if (!_spectro->setSystemTime(referenceTime)) return false;
+    uint32_t local = _clock();
+    // The drift is a property of the probe's clock, so it's kept
+    setBaseline(local, referenceTime);
+    _anchorLocal = local;
+    _anchorProbe = referenceTime;
+    _lastSync = local;
+    return true;
+}
+
+void scanClock::setBaseline(uint32_t localMs, uint32_t probeSeconds)
+{
+    _baseLocal = localMs;
+    _baseProbe = probeSeconds;
+}
@@ -0,0 +1,106 @@
+/*
+ *scanClock.h
+*/
+
+#ifndef scanClock_h
+#define scanClock_h
+
+#include <Arduino.h>
+#include "scanModbus.h"
+
+// How often to read the probe's clock again (ms)
+#ifndef CLOCK_SYNC_INTERVAL
+#define CLOCK_SYNC_INTERVAL 21600000L  // 6 hours
+#endif
+
+// The probe's clock only counts whole seconds, so the drift is only worked
+// out once there's at least this long (ms) between the readings compared
+#ifndef CLOCK_MIN_DRIFT_SPAN
+#define CLOCK_MIN_DRIFT_SPAN 3600000L  // 1 hour
+#endif
+
+// A reading this far (s) from what was expected means the probe's clock was
+// changed, so the drift is worked out again from scratch
+#ifndef CLOCK_JUMP
+#define CLOCK_JUMP 10
+#endif
+
+// How far (s) the probe's clock can be from the reference before correct()
+// sets it
+#ifndef CLOCK_CORRECT_THRESHOLD
+#define CLOCK_CORRECT_THRESHOLD 2
+#endif
+
+// The local clock, in milliseconds (ie, millis)
+typedef unsigned long (*clockSource)(void);
+
+
+//----------------------------------------------------------------------------
+//                   KEEPING TIME WITHOUT ASKING THE PROBE
+//----------------------------------------------------------------------------
+// This reads the probe's clock now and then, tracks how far it is from the
+// local clock and how fast it drifts, and works out the probe's time from
+// the local clock in between, so timestamps don't each cost a modbus read.
+//
+// If the logger has a better clock (a real time clock, GPS, or network
+// time), correct() sets the probe's clock to it whenever they've drifted
+// apart, so the records from several probes line up.
+//
+//    scanClock probeClock(spectro);
+//    probeClock.sync();
+//    ...
+//    if (probeClock.needsSync()) probeClock.sync();
+//    time_t now = probeClock.now();
+class scanClock
+{
+
+public:
+    scanClock(scan *spectro, clockSource clock = millis);
+    scanClock(scan &spectro, clockSource clock = millis);
+
+    // This reads the probe's clock and updates the offset and drift
+    bool sync(void);
+
+    // This returns true when it's time to read the probe's clock again
+    bool needsSync(void);
+
+    // This returns true once the probe's clock has been read
+    bool isSynced(void) {return _synced;}
+
+    // This returns the probe's time (seconds since Jan 1, 1970) from the
+    // local clock, without asking the probe
+    uint32_t now(void);
+
+    // This returns how much faster the probe's clock runs than the local
+    // one, in parts per million (0 until it's known)
+    float getDrift(void) {return _drift*1000000.0;}
+
+    // This compares the probe's time with a better clock (seconds since Jan
+    // 1, 1970) and sets the probe's clock if they're more than the threshold
+    // apart.  Returns false if the probe's clock needed setting but couldn't
+    // be set.
+    bool correct(uint32_t referenceTime, uint32_t threshold = CLOCK_CORRECT_THRESHOLD);
+
+    // This returns the probe's time minus the reference time at the last
+    // correct(), in seconds
+    int32_t getOffset(void) {return _offset;}
+
+private:
+    // This makes a reading the start of a new span for working out the drift
+    void setBaseline(uint32_t localMs, uint32_t probeSeconds);
+
+    scan *_spectro;
+    clockSource _clock;
+    bool _synced;
+    uint32_t _lastSync;  // When the probe's clock was last read (local ms)
+    // The reading the probe's time is worked out from
+    uint32_t _anchorLocal;  // ms
+    uint32_t _anchorProbe;  // seconds
+    // The reading the drift is worked out from
+    uint32_t _baseLocal;  // ms
+    uint32_t _baseProbe;  // seconds
+    float _drift;  // Fraction faster the probe's clock runs
+    int32_t _offset;
+};
+
+#endif
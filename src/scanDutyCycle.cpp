@@ -0,0 +1,97 @@
+/*
+ *scanDutyCycle.cpp
+*/
+
+#include "scanDutyCycle.h"
+
+
+//----------------------------------------------------------------------------
+//                   SLEEPING BETWEEN MEASUREMENTS
+//----------------------------------------------------------------------------
+
+scanDutyCycle::scanDutyCycle(scanMeasurementTracker *tracker, sleepFunction sleep,
+                             trackerClock clock)
+{
+    _tracker = tracker;
+    _sleep = sleep;
+    _clock = clock;
+    _powerPin = -1;
+    _onLevel = HIGH;
+    _warmup = 0;
+    _start = 0;
+    _asleep = 0;
+}
+scanDutyCycle::scanDutyCycle(scanMeasurementTracker &tracker, sleepFunction sleep,
+                             trackerClock clock)
+  : scanDutyCycle(&tracker, sleep, clock) {}
+
+void scanDutyCycle::setPowerPin(int pin, uint8_t onLevel, uint32_t warmup)
+{
+    _powerPin = pin;
+    _onLevel = onLevel;
+    _warmup = pin >= 0 ? warmup : 0;
+    if (_powerPin < 0) return;
+    pinMode(_powerPin, OUTPUT);
+    setPower(true);
+    _sleep(_warmup);
+}
+
+void scanDutyCycle::begin(void)
+{
+    _tracker->begin();
+    _start = _clock();
+    _asleep = 0;
+}
+
+bool scanDutyCycle::waitForMeasurement(uint32_t timeout)
+{
+    uint32_t start = _clock();
+    while (!_tracker->poll())
+    {
+        uint32_t wait = _tracker->msUntilNextPoll();
+        if (timeout > 0 && _clock() - start + wait > timeout) return false;
+        if (wait >= (uint32_t)DUTY_MIN_POWER_OFF) sleep(wait);
+        else
+        {
+            _sleep(wait);
+            _asleep += wait;
+        }
+    }
+    return true;
+}
+
+void scanDutyCycle::sleep(uint32_t ms)
+{
+    // The transceiver has to be back on (and ready) by the end
+    if (ms <= _warmup)
+    {
+        _sleep(ms);
+        _asleep += ms;
+        return;
+    }
+    // The board sleeps through the warmup too, with the transceiver on
+    setPower(false);
+    _sleep(ms - _warmup);
+    setPower(true);
+    if (_warmup > 0) _sleep(_warmup);
+    _asleep += ms;
+}
+
+uint32_t scanDutyCycle::getAwakeTime(void)
+{
+    uint32_t total = _clock() - _start;
+    return total > _asleep ? total - _asleep : 0;
+}
+
+float scanDutyCycle::getDutyRatio(void)
+{
+    uint32_t total = _clock() - _start;
+    if (total == 0) return 1;
+    return (float)getAwakeTime()/total;
+}
+
+void scanDutyCycle::setPower(bool on)
+{
+    if (_powerPin < 0) return;
+    digitalWrite(_powerPin, on ? _onLevel : !_onLevel);
+}
@@ -0,0 +1,98 @@
+/*
+ *scanDutyCycle.h
+*/
+
+#ifndef scanDutyCycle_h
+#define scanDutyCycle_h
+
+#include <Arduino.h>
+#include "scanMeasurementTracker.h"
+
+// Waits shorter than this (ms) aren't worth turning the transceiver off for;
+// the board still sleeps, but the transceiver stays on
+#ifndef DUTY_MIN_POWER_OFF
+#define DUTY_MIN_POWER_OFF 2000L
+#endif
+
+// How long the RS-485 transceiver needs after being powered before it can
+// talk (ms)
+#ifndef DUTY_POWER_WARMUP
+#define DUTY_POWER_WARMUP 50L
+#endif
+
+// The function that puts the board to sleep for a number of milliseconds
+// (ie, delay, or one that sets an alarm on a real time clock and powers down)
+typedef void (*sleepFunction)(unsigned long ms);
+
+
+//----------------------------------------------------------------------------
+//                   SLEEPING BETWEEN MEASUREMENTS
+//----------------------------------------------------------------------------
+// This uses a scanMeasurementTracker to know when the next measurement will
+// be finished, and between polls turns off the RS-485 transceiver and puts
+// the board to sleep, waking just in time to read the results.
+//
+// The sleep function does the sleeping, so it can be whatever the board
+// needs.  If it stops millis() (ie, a power-down sleep on an AVR), give the
+// tracker and the duty cycle a clock that keeps counting while asleep, like
+// one read from a real time clock.  On a computer, a simulated clock and a
+// sleep function that moves it forward make the whole cycle testable (see
+// "dutyCycleSim" in "extras/host").  The transceiver's warmup is slept
+// through with the same function.
+//
+//    scanMeasurementTracker tracker(spectro);
+//    scanDutyCycle dutyCycle(tracker, powerDown);
+//    dutyCycle.setPowerPin(22);
+//    dutyCycle.begin();
+//    while (true)
+//    {
+//        dutyCycle.waitForMeasurement();
+//        ... read the results ...
+//    }
+class scanDutyCycle
+{
+
+public:
+    // The clock should be the same one the tracker uses
+    scanDutyCycle(scanMeasurementTracker *tracker, sleepFunction sleep = delay,
+                  trackerClock clock = millis);
+    scanDutyCycle(scanMeasurementTracker &tracker, sleepFunction sleep = delay,
+                  trackerClock clock = millis);
+
+    // This sets the pin that powers the RS-485 transceiver, the level that
+    // turns it on, and how long it needs after being turned on, and turns it
+    // on.  Call it before talking to the device.
+    void setPowerPin(int pin, uint8_t onLevel = HIGH, uint32_t warmup = DUTY_POWER_WARMUP);
+
+    // This starts the tracker and starts counting the time awake and asleep
+    void begin(void);
+
+    // This sleeps until the next measurement has finished.  Returns false if
+    // none has within the timeout (ms, 0 to wait forever).
+    bool waitForMeasurement(uint32_t timeout = 0);
+
+    // This turns off the transceiver and sleeps for the given time (ms),
+    // turning the transceiver back on in time for it to be ready at the end
+    void sleep(uint32_t ms);
+
+    // These return the time spent awake and asleep since begin() (ms)
+    uint32_t getAwakeTime(void);
+    uint32_t getAsleepTime(void) {return _asleep;}
+
+    // This returns the fraction of the time since begin() spent awake
+    float getDutyRatio(void);
+
+private:
+    void setPower(bool on);
+
+    scanMeasurementTracker *_tracker;
+    sleepFunction _sleep;
+    trackerClock _clock;
+    int _powerPin;
+    uint8_t _onLevel;
+    uint32_t _warmup;
+    uint32_t _start;  // When begin() was called (ms)
+    uint32_t _asleep;  // Total time asleep (ms)
+};
+
+#endif
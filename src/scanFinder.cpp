@@ -0,0 +1,240 @@
+/*
+ *scanFinder.cpp
+*/
+
+#include "scanFinder.h"
+
+// The serial settings to try, in order
+// The spectro::lyser only supports 9600, 19200, and 38400 baud, but an
+// ana::gate or converter might be set to 57600.
+static const uint32_t searchBauds[] = {38400, 9600, 19200, 57600};
+static const specParity searchParities[] = {odd, noParity, noParity, even};
+static const byte searchStopBits[] = {1, 2, 1, 1};
+#define NUM_SEARCH_BAUDS (sizeof(searchBauds)/sizeof(searchBauds[0]))
+#define NUM_SEARCH_FRAMES (sizeof(searchParities)/sizeof(searchParities[0]))
+#define NUM_SEARCH_SETTINGS (NUM_SEARCH_BAUDS*NUM_SEARCH_FRAMES)
+
+// The addresses to try, in order
+// The first ones are tried at every serial setting before any of the rest.
+static const byte searchAddresses[] = {0x04, 0x01, 0x02, 0x03, 0x05, 0x06, 0x07,
+                                       0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E};
+#define NUM_LIKELY_ADDRESSES 2
+#define NUM_SEARCH_ADDRESSES (sizeof(searchAddresses)/sizeof(searchAddresses[0]))
+
+
+//----------------------------------------------------------------------------
+//              FUNCTIONS TO SEARCH FOR A DEVICE ON AN UNKNOWN BUS
+//----------------------------------------------------------------------------
+
+// This sets up the search
+bool scanFinder::begin(Stream *stream, scanSerialOpener opener, int enablePin)
+{
+    _stream = stream;
+    _debugStream = NULL;
+    _opener = opener;
+    _enablePin = enablePin;
+    _timeout = SCAN_PROBE_TIMEOUT;
+    _current.baud = 0;
+    _heardLastProbe = false;
+    _probes = 0;
+    if (_enablePin >= 0)
+    {
+        pinMode(_enablePin, OUTPUT);
+        digitalWrite(_enablePin, LOW);
+    }
+    return _stream != NULL && _opener != NULL;
+}
+bool scanFinder::begin(Stream &stream, scanSerialOpener opener, int enablePin)
+{return begin(&stream, opener, enablePin);}
+
+
+// This searches for a device on the bus
+scanBusSettings scanFinder::find(void)
+{
+    scanBusSettings result;
+    result.found = false;
+    result.slaveID = 0;
+    uint32_t start = millis();
+    _probes = 0;
+
+    // Put each setting together
+    scanSerialSettings settings[NUM_SEARCH_SETTINGS];
+    for (size_t i = 0; i < NUM_SEARCH_BAUDS; i++)
+    {
+        for (size_t j = 0; j < NUM_SEARCH_FRAMES; j++)
+        {
+            settings[i*NUM_SEARCH_FRAMES + j].baud = searchBauds[i];
+            settings[i*NUM_SEARCH_FRAMES + j].parity = searchParities[j];
+            settings[i*NUM_SEARCH_FRAMES + j].stopBits = searchStopBits[j];
+        }
+    }
+    // Flags for the settings on which something came back
+    bool heardOn[NUM_SEARCH_SETTINGS];
+
+    // First try the likely addresses on every setting
+    // The very first try is the factory default, 0x04 at 38400 8O1.
+    for (size_t i = 0; i < NUM_SEARCH_SETTINGS && !result.found; i++)
+    {
+        openPort(settings[i]);
+        heardOn[i] = false;
+        for (size_t k = 0; k < NUM_LIKELY_ADDRESSES; k++)
+        {
+            if (probe(searchAddresses[k]))
+            {
+                result.found = true;
+                result.slaveID = searchAddresses[k];
+                result.serial = settings[i];
+                break;
+            }
+            if (_heardLastProbe) heardOn[i] = true;
+        }
+    }
+
+    // Then try all of the other addresses, starting with the settings that
+    // got some sort of response the first time around
+    for (int pass = 0; pass < 2 && !result.found; pass++)
+    {
+        for (size_t i = 0; i < NUM_SEARCH_SETTINGS && !result.found; i++)
+        {
+            if (heardOn[i] != (pass == 0)) continue;
+            openPort(settings[i]);
+            for (size_t k = NUM_LIKELY_ADDRESSES; k < NUM_SEARCH_ADDRESSES; k++)
+            {
+                if (probe(searchAddresses[k]))
+                {
+                    result.found = true;
+                    result.slaveID = searchAddresses[k];
+                    result.serial = settings[i];
+                    break;
+                }
+            }
+        }
+    }
+
+    // Leave the port open on the settings that worked
+    if (result.found) openPort(result.serial);
+    result.probes = _probes;
+    result.searchTime = millis() - start;
+    if (_debugStream != NULL)
+    {
+        if (result.found) _debugStream->print("Found device after ");
+        else _debugStream->print("No device found after ");
+        _debugStream->print(result.probes);
+        _debugStream->print(" probes and ");
+        _debugStream->print(result.searchTime);
+        _debugStream->println(" ms");
+    }
+    return result;
+}
+
+
+// This opens the port with the given settings and probes the given slave
+bool scanFinder::probe(byte slaveID, const scanSerialSettings &settings)
+{
+    openPort(settings);
+    return probe(slaveID);
+}
+
+
+// This checks whether the given slave answers on the port as it is opened
+// The probe reads holding register 0 (the slave address), which every
+// s::can device has.
+bool scanFinder::probe(byte slaveID)
+{
+    _heardLastProbe = false;
+    _probes++;
+    debugSettings(slaveID);
+
+    // Don't talk over anyone else
+    waitForSilence();
+
+    // Send the request
+    byte request[8];
+    int requestLength = scanRTU::buildReadRequest(request, slaveID, 0x03,
+                                                  holdingReg::uiAddress.at(), 1);
+    if (_enablePin >= 0) digitalWrite(_enablePin, HIGH);
+    _stream->write(request, requestLength);
+    _stream->flush();
+    if (_enablePin >= 0) digitalWrite(_enablePin, LOW);
+
+    // Collect whatever comes back, stopping at the end of the first frame
+    // A normal reply is 7 bytes and an exception is 5.
+    byte reply[7];
+    int replyLength = 0;
+    uint32_t gap = scanRTU::frameGapMicros(_current.baud);
+    uint32_t start = millis();
+    uint32_t lastByte = 0;
+    while (millis() - start < _timeout)
+    {
+        if (_stream->available())
+        {
+            int nextByte = _stream->read();
+            if (replyLength < 7) reply[replyLength] = nextByte;
+            replyLength++;
+            lastByte = micros();
+        }
+        else if (replyLength > 0 && micros() - lastByte > gap) break;
+    }
+    _heardLastProbe = replyLength > 0;
+
+    if (replyLength == 7 && reply[0] == slaveID && reply[1] == 0x03
+        && scanRTU::checkCRC(reply, 7)) return true;
+    if (replyLength == 5 && reply[0] == slaveID && reply[1] == 0x83
+        && scanRTU::checkCRC(reply, 5)) return true;
+    if (_debugStream != NULL && _heardLastProbe)
+    {
+        _debugStream->print("  Got ");
+        _debugStream->print(replyLength);
+        _debugStream->println(" bytes, but not a valid reply");
+    }
+    return false;
+}
+
+
+// This opens the port with the given settings
+void scanFinder::openPort(const scanSerialSettings &settings)
+{
+    _opener(settings.baud, settings.parity, settings.stopBits);
+    _current = settings;
+}
+
+
+// This waits for the bus to be quiet for at least one frame gap
+// Anything received in the meantime is thrown away.  Returns false if the
+// bus never went quiet before the probe timeout.
+bool scanFinder::waitForSilence(void)
+{
+    uint32_t gap = scanRTU::frameGapMicros(_current.baud);
+    uint32_t start = millis();
+    uint32_t quietSince = micros();
+    while (millis() - start < _timeout)
+    {
+        if (_stream->available())
+        {
+            _stream->read();
+            quietSince = micros();
+        }
+        else if (micros() - quietSince >= gap) return true;
+    }
+    return false;
+}
+
+
+// This prints the settings being tried to the debugging stream
+void scanFinder::debugSettings(byte slaveID)
+{
+    if (_debugStream == NULL) return;
+    _debugStream->print("Trying address 0x");
+    if (slaveID < 0x10) _debugStream->print("0");
+    _debugStream->print(slaveID, HEX);
+    _debugStream->print(" at ");
+    _debugStream->print(_current.baud);
+    _debugStream->print(" 8");
+    switch (_current.parity)
+    {
+        case odd: _debugStream->print("O"); break;
+        case even: _debugStream->print("E"); break;
+        default: _debugStream->print("N"); break;
+    }
+    _debugStream->println(_current.stopBits);
+}
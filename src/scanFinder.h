@@ -0,0 +1,102 @@
+/*
+ *scanFinder.h
+*/
+
+#ifndef scanFinder_h
+#define scanFinder_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For the parity enum, serial opener, and register map
+#include "scanRTU.h"  // For building raw request frames
+
+#define SCAN_PROBE_TIMEOUT 200  // How long to wait for a reply to each probe (ms)
+// A modbusMaster call waits 500ms for every wrong guess; the spectro::lyser
+// answers a single register read well within this.
+
+
+// The serial port settings the spectro::lyser or ana::gate might be using
+// For RTU, the modbus spec calls for 2 stop bits with no parity, but
+// many devices are set to 1.
+typedef struct scanSerialSettings
+{
+    uint32_t baud;
+    specParity parity;
+    byte stopBits;
+} scanSerialSettings;
+
+// What was found by the search
+typedef struct scanBusSettings
+{
+    bool found;  // True if a device replied
+    byte slaveID;  // The modbus address that replied
+    scanSerialSettings serial;  // The serial settings it replied on
+    uint16_t probes;  // How many requests were sent to find it
+    uint32_t searchTime;  // How long the search took (ms)
+} scanBusSettings;
+
+
+//----------------------------------------------------------------------------
+//              FUNCTIONS TO SEARCH FOR A DEVICE ON AN UNKNOWN BUS
+//----------------------------------------------------------------------------
+class scanFinder
+{
+
+public:
+
+    // This sets up the search
+    // The "stream" is the serial port the device is on; it will be started
+    // and restarted by the opener function, so it does not need to be begun.
+    bool begin(Stream *stream, scanSerialOpener opener, int enablePin = -1);
+    bool begin(Stream &stream, scanSerialOpener opener, int enablePin = -1);
+
+    // This changes how long to wait for a reply to each probe
+    void setTimeout(uint16_t timeout){_timeout = timeout;}
+
+    // This searches for a device on the bus
+    // The likely defaults (0x04 at 38400 8O1) are tried first, then the two
+    // most common addresses at every serial setting, then all of the rest.
+    // Serial settings on which something garbled came back are tried first.
+    scanBusSettings find(void);
+
+    // This opens the port with the given settings and checks whether the
+    // given slave answers on them
+    bool probe(byte slaveID, const scanSerialSettings &settings);
+
+    // This checks whether the given slave answers on the port as it is
+    // currently opened.  Any valid reply, including a modbus exception,
+    // counts as an answer.
+    bool probe(byte slaveID);
+
+    // This is true if anything at all came back after the last probe, even
+    // if it wasn't a valid reply
+    bool heardLastProbe(void){return _heardLastProbe;}
+
+    // This sets a stream for debugging information to go to;
+    void setDebugStream(Stream *stream){_debugStream = stream;}
+    void setDebugStream(Stream &stream){_debugStream = &stream;}
+
+    // This stops debugging output
+    void stopDebugging(void){_debugStream = NULL;}
+
+private:
+    // This opens the port with the given settings
+    void openPort(const scanSerialSettings &settings);
+
+    // This waits for the bus to be quiet for at least one frame gap, so a
+    // probe is never sent over the top of someone else's traffic
+    bool waitForSilence(void);
+
+    // This prints the settings being tried to the debugging stream
+    void debugSettings(byte slaveID);
+
+    Stream *_stream;
+    Stream *_debugStream;
+    scanSerialOpener _opener;
+    int _enablePin;
+    uint16_t _timeout;
+    scanSerialSettings _current;  // The settings the port is currently open with
+    bool _heardLastProbe;
+    uint16_t _probes;
+};
+
+#endif
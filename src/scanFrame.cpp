@@ -0,0 +1,92 @@
+/*
+ *scanFrame.cpp
+*/
+
+#include "scanFrame.h"
+
+
+//----------------------------------------------------------------------------
+//                  A TYPED VIEW OF A MODBUS RESPONSE FRAME
+//----------------------------------------------------------------------------
+
+// This returns the uint16 in the given register
+uint16_t scanFrame::uint16At(int reg) const
+{
+    if (!contains(reg)) return 0;
+    return word(data(reg));
+}
+
+// This returns the int16 in the given register
+int16_t scanFrame::int16At(int reg) const
+{
+    if (!contains(reg)) return 0;
+    return (int16_t)word(data(reg));
+}
+
+// This returns the float32 in the given register and the one after it
+float scanFrame::float32At(int reg) const
+{
+    if (!contains(reg, 2)) return NAN;
+    uint32_t bits = dword(data(reg));
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+// This returns the time in the six registers beginning at the given one
+// TAI64N is 8 bytes of seconds, of which only the low 4 are kept, followed
+// by 4 bytes of nanoseconds.  The returned seconds can be used as unix time.
+uint32_t scanFrame::TAI64NAt(int reg, uint32_t &nanoseconds) const
+{
+    nanoseconds = 0;
+    if (!contains(reg, 6)) return 0;
+    nanoseconds = dword(data(reg) + 8);
+    return dword(data(reg) + 4);
+}
+
+// This copies characters starting at the given register into a buffer
+int scanFrame::charAt(int reg, char outChar[], int charLength) const
+{
+    outChar[0] = '\0';
+    if (!contains(reg, (charLength + 1)/2)) return 0;
+    const byte *p = data(reg);
+    int i = 0;
+    for (; i < charLength && p[i] != '\0'; i++) outChar[i] = p[i];
+    outChar[i] = '\0';
+    return i;
+}
+
+// This returns the characters starting at the given register as a String
+String scanFrame::StringAt(int reg, int charLength) const
+{
+    char outChar[charLength + 1];
+    charAt(reg, outChar, charLength);
+    return String(outChar);
+}
+
+// This decodes a run of floats, each taking two registers
+int scanFrame::copyTo(float *values, int numValues, int reg) const
+{
+    if (reg < 0) return 0;
+    int available = (registers() - reg)/2;
+    if (numValues > available) numValues = available;
+    const byte *p = data(reg);
+    uint32_t bits;
+    for (int i = 0; i < numValues; i++, p += 4)
+    {
+        bits = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        memcpy(&values[i], &bits, 4);
+    }
+    return numValues > 0 ? numValues : 0;
+}
+
+// This decodes a run of uint16s, each taking one register
+int scanFrame::copyTo(uint16_t *values, int numValues, int reg) const
+{
+    if (reg < 0) return 0;
+    int available = registers() - reg;
+    if (numValues > available) numValues = available;
+    const byte *p = data(reg);
+    for (int i = 0; i < numValues; i++, p += 2) values[i] = word(p);
+    return numValues > 0 ? numValues : 0;
+}
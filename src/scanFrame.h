@@ -0,0 +1,69 @@
+/*
+ *scanFrame.h
+*/
+
+#ifndef scanFrame_h
+#define scanFrame_h
+
+#include <Arduino.h>
+#include <SensorModbusMaster.h>  // For the modbus response buffer
+
+
+//----------------------------------------------------------------------------
+//                  A TYPED VIEW OF A MODBUS RESPONSE FRAME
+//----------------------------------------------------------------------------
+// This reads values straight out of the response to a "read registers"
+// command, without copying the frame.  Values are addressed by register
+// number counted from the first register that was requested (so 0 is the
+// first register in the frame), not by byte index into the frame.
+// Every read is checked against the byte count in the frame; anything that
+// would run off the end of the data returns 0 (or NAN for floats).
+// All values are big-endian, as sent by the s::can.
+class scanFrame
+{
+
+public:
+
+    // This views a raw response frame: slave ID, function, byte count, data
+    scanFrame(const byte *response){_frame = response;}
+    // This views the last response received by a modbusMaster
+    scanFrame(modbusMaster &modbus){_frame = modbus.responseBuffer;}
+
+    // This returns the number of registers of data in the frame
+    int registers(void) const {return _frame[2]/2;}
+
+    // This checks that the given number of registers starting at reg are
+    // all within the frame
+    bool contains(int reg, int numRegisters = 1) const
+    {return reg >= 0 && numRegisters >= 0 && reg + numRegisters <= registers();}
+
+    // These return a single value starting at the given register
+    uint16_t uint16At(int reg) const;
+    int16_t int16At(int reg) const;
+    float float32At(int reg) const;
+    uint32_t TAI64NAt(int reg, uint32_t &nanoseconds) const;
+    String StringAt(int reg, int charLength) const;
+
+    // This copies characters into a buffer of at least charLength + 1,
+    // stopping at the first null.  Returns the number of characters copied.
+    int charAt(int reg, char outChar[], int charLength) const;
+
+    // These decode a run of values starting at the given register into an
+    // array, in one pass over the frame.  The run is cut short at the end of
+    // the frame.  Returns the number of values copied.
+    int copyTo(float *values, int numValues, int reg = 0) const;
+    int copyTo(uint16_t *values, int numValues, int reg = 0) const;
+
+private:
+    // This returns a pointer to the first byte of the given register
+    const byte *data(int reg) const {return _frame + 3 + 2*reg;}
+
+    // These assemble big-endian values from the bytes at p
+    static uint16_t word(const byte *p) {return ((uint16_t)p[0] << 8) | p[1];}
+    static uint32_t dword(const byte *p)
+    {return ((uint32_t)word(p) << 16) | word(p + 2);}
+
+    const byte *_frame;
+};
+
+#endif
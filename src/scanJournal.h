@@ -0,0 +1,452 @@
+/*
+ *scanJournal.h
+ *
+ *This is all in the header (rather than a .cpp file) so that sketches that
+ *don't use an SD card don't need the SdFat library to compile.
+*/
+
+#ifndef scanJournal_h
+#define scanJournal_h
+
+#include <Arduino.h>
+#include <SdFat.h>  // To communicate with the SD card
+#include "scanModbus.h"  // For the parameter snapshot and spectral sources
+#include "scanRTU.h"  // For the CRC
+
+#define JOURNAL_MAGIC 0xA5  // The first byte of every record
+#define JOURNAL_HEADER_LENGTH 8  // Magic, type, payload length, sequence number
+#define JOURNAL_CRC_LENGTH 2
+#define JOURNAL_SECTOR_SIZE 512
+#define JOURNAL_MAX_VALUES 256  // The most values in a fingerprint record
+#define JOURNAL_MAX_PAYLOAD (7 + 4*JOURNAL_MAX_VALUES)
+
+// How far apart (in bytes) to write checkpoints; recovery after a power
+// loss reads at most about this much of the file
+#ifndef JOURNAL_CHECKPOINT_INTERVAL
+#define JOURNAL_CHECKPOINT_INTERVAL 16384L
+#endif
+
+// The kinds of records in a journal
+typedef enum journalRecordType
+{
+    journalNone = 0,  // Returned at the end of the journal
+    journalPad,  // Filler so a checkpoint starts on a sector boundary
+    journalCheckpoint,  // The state of the journal, for quick recovery
+    journalUplinked,  // Everything up to this sequence number has been sent
+    journalParameters,  // A parameter snapshot
+    journalFingerprint  // The values of one spectral source
+} journalRecordType;
+
+
+//----------------------------------------------------------------------------
+//                       A JOURNAL OF MEASUREMENTS
+//----------------------------------------------------------------------------
+// This appends measurements to a binary file on an SD card so that a power
+// loss can never leave a half-written row behind, and keeps track of which
+// measurements have been sent on (uplinked) so nothing is sent twice or
+// skipped after a restart.
+//
+// Every record is:
+//    0xA5 | type | payload length (2) | sequence number (4) | payload | CRC16
+// with numbers low byte first and the modbus CRC16 of everything after the
+// 0xA5.  Floats are written in the board's own byte order (little-endian on
+// AVR, ARM, and x86).
+//
+// Every JOURNAL_CHECKPOINT_INTERVAL bytes there is a checkpoint record,
+// starting on a sector boundary, which holds the last sequence number, the
+// last uplinked sequence number, and where the checkpoint before it is.  On
+// start-up, the journal looks back from the end of the file, one sector at
+// a time, for the last checkpoint, and then checks every record after it;
+// the file is cut off at the first record that's incomplete or fails its
+// CRC.
+//
+// The journal is synced after every record, so when append() returns true
+// the record is safely on the card.  If any of a record can't be written,
+// the file is cut back to where the record started and append() returns
+// false, so the next record doesn't end up after a torn one (which recovery
+// would cut off, along with everything after it).
+//
+//    scanJournal journal;
+//    journal.begin("journal.bin");  // After sd.begin()
+//    spectro.getParameterSnapshot(snapshot);
+//    journal.append(snapshot);
+//    ...
+//    journal.seek(journal.getUplinked() + 1);
+//    uint32_t sequence;
+//    while (journal.readNext(sequence) == journalParameters)
+//    {
+//        journal.readSnapshot(snapshot);
+//        spectroPr.printParameterDataRow(Serial, snapshot);
+//    }
+class scanJournal
+{
+
+public:
+    scanJournal(void)
+    {
+        _end = 0;
+        _recordStart = 0;
+        _lastCheckpoint = 0;
+        _lastSequence = 0;
+        _uplinked = 0;
+        _readPosition = 0;
+        _recordPayload = 0;
+        _recordType = journalNone;
+        _crc = 0xFFFF;
+        _writeError = false;
+    }
+
+    // This opens the journal, creating it if need be, and recovers it after a
+    // power loss.  Returns false if the file can't be opened or isn't a
+    // journal.
+    bool begin(const char *name)
+    {
+        end();
+        if (!_file.open(name, O_RDWR | O_CREAT)) return false;
+        _end = 0;
+        _lastCheckpoint = 0;
+        _lastSequence = 0;
+        _uplinked = 0;
+        _readPosition = 0;
+        if (_file.fileSize() == 0) return writeCheckpoint();
+        return recover();
+    }
+
+    // This closes the journal
+    void end(void)
+    {
+        if (_file.isOpen()) _file.close();
+    }
+
+    // This adds a parameter snapshot to the journal as the next sequence number
+    bool append(const parameterSnapshot &snapshot)
+    {
+        byte payload[7];
+        putUint32(payload, snapshot.time);
+        putUint16(payload + 4, snapshot.deviceStatus);
+        payload[6] = snapshot.count;
+        startRecord(journalParameters, _lastSequence + 1, 7 + 8*snapshot.count);
+        put(payload, 7);
+        for (int i = 0; i < snapshot.count; i++)
+        {
+            byte parameter[8];
+            putUint16(parameter, snapshot.status[i]);
+            putUint16(parameter + 2, snapshot.specStatus[i]);
+            memcpy(parameter + 4, &snapshot.value[i], 4);
+            put(parameter, 8);
+        }
+        return finishDataRecord();
+    }
+
+    // This adds the fingerprint values of one spectral source to the journal
+    bool append(uint32_t time, spectralSource source, const float *values, int count)
+    {
+        if (count > JOURNAL_MAX_VALUES) return false;
+        byte payload[7];
+        putUint32(payload, time);
+        payload[4] = source;
+        putUint16(payload + 5, count);
+        startRecord(journalFingerprint, _lastSequence + 1, 7 + 4*count);
+        put(payload, 7);
+        put((const byte *)values, 4*count);
+        return finishDataRecord();
+    }
+
+    // This records that everything up to the given sequence number has been
+    // sent on
+    bool markUplinked(uint32_t sequence)
+    {
+        startRecord(journalUplinked, sequence, 0);
+        if (!finishRecord()) return false;
+        _uplinked = sequence;
+        return finishAppend();
+    }
+
+    // This returns the sequence number of the last measurement
+    uint32_t getLastSequence(void) {return _lastSequence;}
+
+    // This returns the last sequence number marked as uplinked
+    uint32_t getUplinked(void) {return _uplinked;}
+
+    // This returns the length of the journal, in bytes
+    uint32_t size(void) {return _end;}
+
+    // This moves the reader to the first measurement with the given sequence
+    // number or later, following the checkpoints back to find it
+    bool seek(uint32_t sequence)
+    {
+        uint32_t checkpoint = _lastCheckpoint;
+        journalHeader header;
+        while (checkpoint > 0)
+        {
+            if (!readHeader(checkpoint, header)) return false;
+            if (header.sequence < sequence) break;
+            byte payload[8];
+            _file.read(payload, 8);
+            uint32_t previous = getUint32(payload + 4);
+            if (previous >= checkpoint) return false;  // Damaged
+            checkpoint = previous;
+        }
+        _readPosition = checkpoint;
+        while (_readPosition < _end)
+        {
+            if (!readHeader(_readPosition, header)) return false;
+            if (isData(header.type) && header.sequence >= sequence) return true;
+            _readPosition += recordLength(header);
+        }
+        return true;
+    }
+
+    // This moves the reader back to the start of the journal
+    void rewind(void) {_readPosition = 0;}
+
+    // This finds the next measurement and returns its type and sequence
+    // number, or journalNone at the end of the journal.  Read its contents
+    // with readSnapshot() or readFingerprint().
+    journalRecordType readNext(uint32_t &sequence)
+    {
+        journalHeader header;
+        _recordType = journalNone;
+        while (_readPosition < _end)
+        {
+            uint32_t position = _readPosition;
+            if (!readHeader(position, header)) return journalNone;
+            _readPosition += recordLength(header);
+            if (!isData(header.type) || !checkRecord(position, header)) continue;
+            _recordType = (journalRecordType)header.type;
+            _recordPayload = position + JOURNAL_HEADER_LENGTH;
+            sequence = header.sequence;
+            return _recordType;
+        }
+        return journalNone;
+    }
+
+    // This reads the parameter snapshot found by readNext()
+    bool readSnapshot(parameterSnapshot &snapshot)
+    {
+        if (_recordType != journalParameters) return false;
+        byte payload[8];
+        if (!_file.seekSet(_recordPayload) || _file.read(payload, 7) != 7) return false;
+        snapshot.time = getUint32(payload);
+        snapshot.deviceStatus = getUint16(payload + 4);
+        snapshot.count = min(payload[6], (byte)MAX_PARAMETERS);
+        for (int i = 0; i < snapshot.count; i++)
+        {
+            if (_file.read(payload, 8) != 8) return false;
+            snapshot.status[i] = getUint16(payload);
+            snapshot.specStatus[i] = getUint16(payload + 2);
+            memcpy(&snapshot.value[i], payload + 4, 4);
+        }
+        return true;
+    }
+
+    // This reads the fingerprint found by readNext()
+    // Returns the number of values, or -1 if it can't be read.
+    int readFingerprint(uint32_t &time, spectralSource &source, float *values, int maxValues)
+    {
+        if (_recordType != journalFingerprint) return -1;
+        byte payload[7];
+        if (!_file.seekSet(_recordPayload) || _file.read(payload, 7) != 7) return -1;
+        time = getUint32(payload);
+        source = (spectralSource)payload[4];
+        int count = min((int)getUint16(payload + 5), maxValues);
+        if (_file.read(values, 4*count) != 4*count) return -1;
+        return count;
+    }
+
+private:
+    typedef struct journalHeader
+    {
+        byte type;
+        uint16_t length;  // Of the payload
+        uint32_t sequence;
+    } journalHeader;
+
+    static bool isData(byte type) {return type == journalParameters || type == journalFingerprint;}
+
+    static uint32_t recordLength(const journalHeader &header)
+    {return JOURNAL_HEADER_LENGTH + header.length + JOURNAL_CRC_LENGTH;}
+
+    static void putUint16(byte *buffer, uint16_t value)
+    {
+        buffer[0] = value & 0xFF;
+        buffer[1] = value >> 8;
+    }
+    static void putUint32(byte *buffer, uint32_t value)
+    {
+        putUint16(buffer, value & 0xFFFF);
+        putUint16(buffer + 2, value >> 16);
+    }
+    static uint16_t getUint16(const byte *buffer) {return buffer[0] | (buffer[1] << 8);}
+    static uint32_t getUint32(const byte *buffer)
+    {return getUint16(buffer) | ((uint32_t)getUint16(buffer + 2) << 16);}
+
+    // This writes bytes at the end of the journal, adding them to the CRC
+    // After an error, the rest of the record is skipped.
+    void put(const byte *buffer, int length)
+    {
+        if (_writeError) return;
+        _crc = scanRTU::crc16(buffer, length, _crc);
+        if (_file.write(buffer, length) != (size_t)length) _writeError = true;
+        _end += length;
+    }
+
+    // This writes the header of a record
+    void startRecord(byte type, uint32_t sequence, uint16_t length)
+    {
+        byte header[JOURNAL_HEADER_LENGTH];
+        header[0] = JOURNAL_MAGIC;
+        header[1] = type;
+        putUint16(header + 2, length);
+        putUint32(header + 4, sequence);
+        _recordStart = _end;
+        _writeError = !_file.seekSet(_end);
+        _crc = 0xFFFF;
+        put(header, 1);
+        _crc = 0xFFFF;  // The magic byte isn't part of the CRC
+        put(header + 1, JOURNAL_HEADER_LENGTH - 1);
+    }
+
+    // This writes the CRC at the end of a record
+    // If any of the record couldn't be written, the journal is cut back to
+    // where it started (the next record is written there even if cutting it
+    // fails) and this returns false.
+    bool finishRecord(void)
+    {
+        byte crc[JOURNAL_CRC_LENGTH];
+        putUint16(crc, _crc);
+        put(crc, JOURNAL_CRC_LENGTH);
+        if (!_writeError) return true;
+        _end = _recordStart;
+        _file.truncate(_end);
+        return false;
+    }
+
+    bool finishDataRecord(void)
+    {
+        if (!finishRecord()) return false;
+        _lastSequence++;
+        return finishAppend();
+    }
+
+    // This writes a checkpoint if it's time for one, then syncs
+    bool finishAppend(void)
+    {
+        if (_end - _lastCheckpoint >= JOURNAL_CHECKPOINT_INTERVAL) return writeCheckpoint();
+        return _file.sync();
+    }
+
+    // This pads the journal to the next sector boundary and writes a checkpoint
+    bool writeCheckpoint(void)
+    {
+        uint32_t gap = (JOURNAL_SECTOR_SIZE - _end % JOURNAL_SECTOR_SIZE) % JOURNAL_SECTOR_SIZE;
+        if (gap > 0 && gap < JOURNAL_HEADER_LENGTH + JOURNAL_CRC_LENGTH) gap += JOURNAL_SECTOR_SIZE;
+        if (gap > 0)
+        {
+            startRecord(journalPad, 0, gap - JOURNAL_HEADER_LENGTH - JOURNAL_CRC_LENGTH);
+            byte zero = 0;
+            for (uint32_t i = 0; i < gap - JOURNAL_HEADER_LENGTH - JOURNAL_CRC_LENGTH; i++) put(&zero, 1);
+            if (!finishRecord()) return false;
+        }
+        uint32_t position = _end;
+        byte payload[8];
+        putUint32(payload, _uplinked);
+        putUint32(payload + 4, _lastCheckpoint);
+        startRecord(journalCheckpoint, _lastSequence, 8);
+        put(payload, 8);
+        if (!finishRecord()) return false;
+        _lastCheckpoint = position;
+        return _file.sync();
+    }
+
+    // This reads the header of the record at the given position, leaving the
+    // file at the start of its payload
+    bool readHeader(uint32_t position, journalHeader &header)
+    {
+        byte buffer[JOURNAL_HEADER_LENGTH];
+        if (!_file.seekSet(position)) return false;
+        if (_file.read(buffer, JOURNAL_HEADER_LENGTH) != JOURNAL_HEADER_LENGTH) return false;
+        if (buffer[0] != JOURNAL_MAGIC) return false;
+        header.type = buffer[1];
+        header.length = getUint16(buffer + 2);
+        header.sequence = getUint32(buffer + 4);
+        if (header.type < journalPad || header.type > journalFingerprint) return false;
+        if (header.length > JOURNAL_MAX_PAYLOAD) return false;
+        return position + recordLength(header) <= _file.fileSize();
+    }
+
+    // This checks the CRC of the record at the given position
+    bool checkRecord(uint32_t position, const journalHeader &header)
+    {
+        byte buffer[32];
+        uint16_t crc = 0xFFFF;
+        int left = JOURNAL_HEADER_LENGTH - 1 + header.length;
+        if (!_file.seekSet(position + 1)) return false;
+        while (left > 0)
+        {
+            int n = min(left, (int)sizeof(buffer));
+            if (_file.read(buffer, n) != n) return false;
+            crc = scanRTU::crc16(buffer, n, crc);
+            left -= n;
+        }
+        if (_file.read(buffer, JOURNAL_CRC_LENGTH) != JOURNAL_CRC_LENGTH) return false;
+        return getUint16(buffer) == crc;
+    }
+
+    // This finds the last checkpoint, checks every record after it, and cuts
+    // off anything incomplete at the end
+    bool recover(void)
+    {
+        uint32_t fileSize = _file.fileSize();
+        uint32_t position = ((fileSize - 1)/JOURNAL_SECTOR_SIZE)*JOURNAL_SECTOR_SIZE;
+        journalHeader header;
+        while (!(readHeader(position, header) && header.type == journalCheckpoint
+                 && checkRecord(position, header)))
+        {
+            if (position == 0)
+            {
+                // A journal that lost power while it was being created
+                if (fileSize >= JOURNAL_SECTOR_SIZE) return false;
+                _file.truncate(0);
+                return writeCheckpoint();
+            }
+            position -= JOURNAL_SECTOR_SIZE;
+        }
+        byte payload[8];
+        _file.seekSet(position + JOURNAL_HEADER_LENGTH);
+        _file.read(payload, 8);
+        _uplinked = getUint32(payload);
+        _lastSequence = header.sequence;
+        _lastCheckpoint = position;
+
+        position += recordLength(header);
+        while (position < fileSize && readHeader(position, header) && checkRecord(position, header))
+        {
+            if (isData(header.type)) _lastSequence = header.sequence;
+            else if (header.type == journalUplinked) _uplinked = header.sequence;
+            else if (header.type == journalCheckpoint) _lastCheckpoint = position;
+            position += recordLength(header);
+        }
+        _end = position;
+        if (_end < fileSize)
+        {
+            _file.truncate(_end);
+            return _file.sync();
+        }
+        return true;
+    }
+
+    File _file;
+    uint32_t _end;  // The length of the journal
+    uint32_t _recordStart;  // Where the record being written starts
+    uint32_t _lastCheckpoint;  // Where the last checkpoint starts
+    uint32_t _lastSequence;
+    uint32_t _uplinked;
+    uint32_t _readPosition;
+    uint32_t _recordPayload;  // Where the payload of the record last read starts
+    journalRecordType _recordType;  // The type of the record last read
+    uint16_t _crc;  // Of the record being written
+    bool _writeError;
+};
+
+#endif
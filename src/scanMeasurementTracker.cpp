@@ -0,0 +1,92 @@
+/*
+ *scanMeasurementTracker.cpp
+*/
+
+#include "scanMeasurementTracker.h"
+
+
+//----------------------------------------------------------------------------
+//                   KNOWING WHEN A MEASUREMENT HAS FINISHED
+//----------------------------------------------------------------------------
+
+scanMeasurementTracker::scanMeasurementTracker(scan *spectro, trackerClock clock)
+{
+    _spectro = spectro;
+    _clock = clock;
+    _interval = 0;
+    _parameterTime = 0;
+    _lastPoll = 0;
+    _lastCompletion = 0;
+    _polls = 0;
+    _busy = false;
+    _locked = false;
+}
+scanMeasurementTracker::scanMeasurementTracker(scan &spectro, trackerClock clock)
+  : scanMeasurementTracker(&spectro, clock) {}
+
+void scanMeasurementTracker::begin(void)
+{
+    int interval = _spectro->getMeasInterval();
+    _interval = interval > 0 ? interval : 0;
+    _parameterTime = 0;
+    _polls = 0;
+    _busy = false;
+    _locked = false;
+}
+
+bool scanMeasurementTracker::poll(void)
+{
+    uint32_t now = _clock();
+    uint32_t sinceLastPoll = now - _lastPoll;
+    _lastPoll = now;
+    _polls++;
+
+    uint32_t parameterTime;
+    uint16_t deviceStatus;
+    if (!_spectro->getMeasurementState(parameterTime, deviceStatus)) return false;
+    _busy = (deviceStatus & DEVICE_BUSY) != 0;
+
+    // Wait until the device has finished writing the results
+    if (_busy || parameterTime == 0 || parameterTime == _parameterTime) return false;
+
+    if (_parameterTime != 0)
+    {
+        // Learn the interval from the measurement times; a gap of more than
+        // one interval means a measurement was missed (or the poll was late)
+        uint32_t interval = parameterTime - _parameterTime;
+        if (_interval == 0 || interval < _interval + _interval/2) _interval = interval;
+
+        // It finished sometime since the last poll; if that was recent, take
+        // the middle of that time as the phase
+        if (sinceLastPoll <= TRACKER_SEARCH_POLL)
+        {
+            _lastCompletion = now - sinceLastPoll/2;
+            _locked = true;
+        }
+        // If it was already done at the first poll of the lead, it's been
+        // finishing earlier than expected; move the phase back a lead's worth
+        else if (_locked) _lastCompletion = now - TRACKER_LEAD;
+    }
+    _parameterTime = parameterTime;
+    return true;
+}
+
+uint32_t scanMeasurementTracker::msUntilNextPoll(void)
+{
+    if (_busy) return TRACKER_CLOSE_POLL;
+    if (!_locked || _interval == 0) return TRACKER_SEARCH_POLL;
+
+    uint32_t now = _clock();
+    uint32_t due = _lastCompletion + _interval*1000;
+    int32_t wait = (int32_t)(due - TRACKER_LEAD - now);
+    if (wait > 0) return wait;
+
+    // If it's been more than an interval past due, the phase has been lost
+    // (ie, the device stopped logging)
+    if ((int32_t)(now - due) > (int32_t)(_interval*1000))
+    {
+        _locked = false;
+        return TRACKER_SEARCH_POLL;
+    }
+    return TRACKER_CLOSE_POLL;
+}
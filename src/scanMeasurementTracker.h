@@ -0,0 +1,97 @@
+/*
+ *scanMeasurementTracker.h
+*/
+
+#ifndef scanMeasurementTracker_h
+#define scanMeasurementTracker_h
+
+#include <Arduino.h>
+#include "scanModbus.h"
+
+#define DEVICE_BUSY 0x2000  // b13 of the device status:  measuring
+
+// How often to poll (ms) while looking for the end of a measurement when we
+// don't yet know when to expect it
+#ifndef TRACKER_SEARCH_POLL
+#define TRACKER_SEARCH_POLL 5000L
+#endif
+
+// How often to poll (ms) while the device is busy or a measurement is due
+#ifndef TRACKER_CLOSE_POLL
+#define TRACKER_CLOSE_POLL 1000L
+#endif
+
+// How long before a measurement is expected to finish to start polling (ms)
+#ifndef TRACKER_LEAD
+#define TRACKER_LEAD 3000L
+#endif
+
+// The clock the tracker uses, in milliseconds (ie, millis)
+typedef unsigned long (*trackerClock)(void);
+
+
+//----------------------------------------------------------------------------
+//                   KNOWING WHEN A MEASUREMENT HAS FINISHED
+//----------------------------------------------------------------------------
+// This watches the measurement time and the busy bit of the device status
+// to learn when the spectro::lyzer finishes each measurement, so the results
+// can be read right after they're ready (and never while they're being
+// written) with as few polls as possible.
+//
+// Until it has seen a measurement finish, it polls every TRACKER_SEARCH_POLL
+// ms.  After that it knows the phase: it waits until TRACKER_LEAD ms before
+// the next measurement should finish and then polls every
+// TRACKER_CLOSE_POLL ms until it has.
+//
+//    scanMeasurementTracker tracker(spectro);
+//    tracker.begin();
+//    while (!tracker.poll()) delay(tracker.msUntilNextPoll());
+//    ... read the results ...
+class scanMeasurementTracker
+{
+
+public:
+    // The clock can be swapped for another (ie, for testing, or a real time
+    // clock that keeps counting while the board sleeps)
+    scanMeasurementTracker(scan *spectro, trackerClock clock = millis);
+    scanMeasurementTracker(scan &spectro, trackerClock clock = millis);
+
+    // This gets the measurement interval from the device and forgets the phase
+    void begin(void);
+
+    // This checks the device once.  Returns true when there is a finished
+    // measurement that hasn't been returned before (including, on the first
+    // poll, the one from before the tracker started).
+    bool poll(void);
+
+    // This returns how long to wait (ms) before polling again
+    uint32_t msUntilNextPoll(void);
+
+    // This returns true if the device was measuring at the last poll
+    bool isBusy(void) {return _busy;}
+
+    // This returns true once the tracker knows when measurements finish
+    bool isLocked(void) {return _locked;}
+
+    // This returns the time between measurements, in seconds (0 if unknown)
+    uint32_t getInterval(void) {return _interval;}
+
+    // This returns the measurement time seen at the last poll
+    uint32_t getParameterTime(void) {return _parameterTime;}
+
+    // This returns the number of polls since begin()
+    uint32_t getPollCount(void) {return _polls;}
+
+private:
+    scan *_spectro;
+    trackerClock _clock;
+    uint32_t _interval;  // Seconds
+    uint32_t _parameterTime;  // The last measurement time seen
+    uint32_t _lastPoll;  // When the device was last polled (ms)
+    uint32_t _lastCompletion;  // When the last measurement finished (ms)
+    uint32_t _polls;
+    bool _busy;
+    bool _locked;
+};
+
+#endif
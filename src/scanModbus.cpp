@@ -3,6 +3,7 @@
 */
 
 #include "scanModbus.h"
+#include "scanModbusTCP.h"  // For pipelined spectral sweeps
 
 //----------------------------------------------------------------------------
 //                          GENERAL USE FUNCTIONS
@@ -12,10 +13,22 @@
 // This function sets up the communication
 // It should be run during the arduino "setup" function.
 // The "stream" device must be initialized and begun prior to running this.
+// The model type is detected here once so later calls don't need to re-read
+// it; if the device isn't answering yet, it will be retried on first use.
 bool scan::begin(byte modbusSlaveID, Stream *stream, int enablePin)
 {
     _slaveID = modbusSlaveID;
-    return modbus.begin(modbusSlaveID, stream, enablePin);
+    _modelType = 0;
+    _privateConfig.swVersion = 0;
+    _privateConfig.regType = 0;
+    _privateConfig.globalCalReg = 0;
+    _privateConfig.nextGlobalCalReg = 0;
+    _privateConfigChecked = false;
+    bool success = modbus.begin(modbusSlaveID, stream, enablePin);
+#if !defined(SCAN_SPECTROLYSER_ONLY) && !defined(SCAN_ANAGATE_ONLY)
+    if (success) getModelType();
+#endif
+    return success;
 }
 bool scan::begin(byte modbusSlaveID, Stream &stream, int enablePin)
 {return begin(modbusSlaveID, &stream, enablePin);}
@@ -44,112 +57,123 @@ bool scan::printSetup(Stream *stream)
 
     // Get rest of the input registers
     int parmCount;
-    if (modbus.getRegisters(0x04, 0, 25))
+    if (modbus.getRegisters(0x04, inputReg::uiVersion.at(), inputReg::uiParameterScale.at() + 1))
     {
         // Setup information from input registers
 
         stream->print("Instrument model is: ");
-        stream->println(modbus.StringFromFrame(20, 9));
+        stream->println(modbus.StringFromFrame(inputReg::abModel.chars(),
+                                               inputReg::abModel.byteInFrame(0)));
 
         stream->print("Instrument Serial Number is: ");
-        stream->println(modbus.StringFromFrame(8, 29));
+        stream->println(modbus.StringFromFrame(inputReg::abSerialNumber.chars(),
+                                               inputReg::abSerialNumber.byteInFrame(0)));
 
         stream->print("Hardware has been restarted: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 45));
+        stream->print(modbus.int16FromFrame(bigEndian, inputReg::uiHWStarts.byteInFrame(0)));
         stream->println(" times");
 
         stream->print("There are ");
-        parmCount = modbus.int16FromFrame(bigEndian, 47);
+        parmCount = modbus.int16FromFrame(bigEndian, inputReg::uiParameterCount.byteInFrame(0));
         stream->print(parmCount);
         stream->println(" parameters being measured");
 
+        int parmType = modbus.int16FromFrame(bigEndian, inputReg::eParameterType.byteInFrame(0));
         stream->print("The data type of the parameters is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 49));
+        stream->print(parmType);
         stream->print(" (");
-        stream->print(parseParameterType(modbus.int16FromFrame(bigEndian, 49)));
+        stream->print(parseParameterType(parmType));
         stream->println(")");
 
         stream->print("The parameter scale factor is: ");
-        stream->println(modbus.int16FromFrame(bigEndian, 51));
+        stream->println(modbus.int16FromFrame(bigEndian, inputReg::uiParameterScale.byteInFrame(0)));
     }
     else return false;
 
     // Get the holding registers
     stream->println("------------------------------------------");
-    if (modbus.getRegisters(0x03, 0, 27))
+    if (modbus.getRegisters(0x03, holdingReg::uiAddress.at(), holdingReg::uiIndexLogResult.at() + 1))
     {
         // Setup information from holding registers
+        int commMode = modbus.int16FromFrame(bigEndian, holdingReg::eCommMode.byteInFrame(0));
         stream->print("Communication mode setting is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 5));
+        stream->print(commMode);
         stream->print(" (");
-        stream->print(parseCommunicationMode(modbus.int16FromFrame(bigEndian, 5)));
+        stream->print(parseCommunicationMode(commMode));
         stream->println(")");
 
+        int baud = modbus.int16FromFrame(bigEndian, holdingReg::eBaudrate.byteInFrame(0));
         stream->print("Baud Rate setting is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 7));
+        stream->print(baud);
         stream->print(" (");
-        stream->print(parseBaudRate(modbus.int16FromFrame(bigEndian, 7)));
+        stream->print(parseBaudRate(baud));
         stream->println(")");
 
+        int parity = modbus.int16FromFrame(bigEndian, holdingReg::eParity.byteInFrame(0));
         stream->print("Parity setting is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 9));
+        stream->print(parity);
         stream->print(" (");
-        stream->print(parseParity(modbus.int16FromFrame(bigEndian, 9)));
+        stream->print(parseParity(parity));
         stream->println(")");
 
+        int pointerByte = holdingReg::pDeviceConfigPrivate.byteInFrame(0);
         stream->print("Private configuration begins sometime after register ");
-        stream->print(modbus.pointerFromFrame(bigEndian, 13));
+        stream->print(modbus.pointerFromFrame(bigEndian, pointerByte));
         stream->print(", which is type ");
-        stream->print(modbus.pointerTypeFromFrame(bigEndian, 13));
+        stream->print(modbus.pointerTypeFromFrame(bigEndian, pointerByte));
         stream->print(" (");
-        stream->print(parseRegisterType(modbus.pointerTypeFromFrame(bigEndian, 13)));
+        stream->print(parseRegisterType(modbus.pointerTypeFromFrame(bigEndian, pointerByte)));
         stream->println(")");
 
         stream->print("Current s::canpoint is: ");
-        stream->println(modbus.StringFromFrame(12, 15));
+        stream->println(modbus.StringFromFrame(holdingReg::abDeviceLocation.chars(),
+                                               holdingReg::abDeviceLocation.byteInFrame(0)));
 
+        int cleanMode = modbus.int16FromFrame(bigEndian, holdingReg::eCleanMode.byteInFrame(0));
         stream->print("Cleaning mode setting is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 27));
+        stream->print(cleanMode);
         stream->print(" (");
-        stream->print(parseCleaningMode(modbus.int16FromFrame(bigEndian, 27)));
+        stream->print(parseCleaningMode(cleanMode));
         stream->println(")");
 
         stream->print("Cleaning interval is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 29));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiCleanInterval.byteInFrame(0)));
         stream->println(" measurements between cleanings");
 
         stream->print("Cleaning time is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 31));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiCleanDuration.byteInFrame(0)));
         stream->println(" seconds");
 
         stream->print("Wait time between cleaning and sampling is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 33));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiCleanWait.byteInFrame(0)));
         stream->println(" seconds");
 
         stream->print("Current System Time is: ");
         uint32_t nanoseconds;
-        stream->print((uint32_t)(modbus.TAI64NFromFrame(nanoseconds, 35)));
+        stream->print((uint32_t)(modbus.TAI64NFromFrame(nanoseconds,
+                                 holdingReg::tSystemTime.byteInFrame(0))));
         stream->println(" seconds past Jan 1, 1970");
 
         stream->print("Measurement interval is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 47));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiMeasInterval.byteInFrame(0)));
         stream->println(" seconds");
 
+        int logMode = modbus.int16FromFrame(bigEndian, holdingReg::eLoggingMode.byteInFrame(0));
         stream->print("Logging mode setting is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 49));
+        stream->print(logMode);
         stream->print(" (");
-        stream->print(parseLoggingMode(modbus.int16FromFrame(bigEndian, 49)));
+        stream->print(parseLoggingMode(logMode));
         stream->println(")");
 
         stream->print("Logging interval is: ");
-        stream->print(modbus.int16FromFrame(bigEndian, 51));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiLogInterval.byteInFrame(0)));
         stream->println(" seconds");
 
-        stream->print(modbus.int16FromFrame(bigEndian, 53));
+        stream->print(modbus.int16FromFrame(bigEndian, holdingReg::uiNLogResultsTotal.byteInFrame(0)));
         stream->println(" results have been logged so far");
 
         stream->print("Index device status is: ");
-        stream->println(modbus.int16FromFrame(bigEndian, 53));
+        stream->println(modbus.int16FromFrame(bigEndian, holdingReg::uiIndexLogResult.byteInFrame(0)));
     }
     else return false;
 
@@ -188,7 +212,7 @@ bool scan::printSetup(Stream &stream) {return printSetup(&stream);}
 // Reset all settings to default
 bool scan::resetSettings(void)
 {
-    return modbus.uint16ToRegister(4, 1, bigEndian);
+    return modbus.uint16ToRegister(holdingReg::eChangeSettings.at(), 1, bigEndian);
 }
 
 
@@ -198,13 +222,13 @@ bool scan::setSlaveID(byte newSlaveID)
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = newSlaveID;
-    return modbus.setRegisters(0, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::uiAddress.at(), 1, byteToSend);
 }
 
 
 // This returns the current device status as a bitmap
 int scan::getDeviceStatus(void)
-{return modbus.uint16FromRegister(0x04, 120);}
+{return uint16FromMap(inputReg::bmDeviceStatus);}
 // This parses the device status bitmask and prints out from the codes
 void scan::printDeviceStatus(uint16_t bitmask, Stream *stream)
 {
@@ -267,7 +291,7 @@ void scan::printSystemStatus(uint16_t bitmask, Stream &stream)
 bool scan::wakeSpec(void)
 {
     // _debugStream->println("------>Checking if spectro::lyzer is awake.<------");
-    if (modbus.uint16FromRegister(0x03, 0) > 0)
+    if (uint16FromMap(holdingReg::uiAddress) > 0)
     {
         // _debugStream->println("------>Spectro::lyser is now awake.<------");
         return true;
@@ -290,17 +314,11 @@ bool scan::wakeSpec(void)
 // System time is in input registers 104-109
 // (96-bit timestamp in TAI64N format - in this case, ignoring the nanoseconds)
 uint32_t scan::getParameterTime(void)
-{
-    uint32_t nanoseconds;
-    return modbus.TAI64NFromRegister(0x04, 104, nanoseconds);
-}
+{return TAI64NFromMap(inputReg::tSampleTime);}
 // This gets any general errors regarding the measured parameters (parameter status public)
+// The status of parameter n is in input register 120 + 8n
 uint16_t scan::getParameterStatus(int parmNumber)
-{
-    int startingReg = 120 + 8*parmNumber;
-    // Get the register data
-    return modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-}
+{return uint16FromMap(inputReg::bmPStatus, parmNumber);}
 void scan::printParameterStatus(uint16_t bitmask, Stream *stream)
 {
     // b15 - 8xxx
@@ -343,12 +361,9 @@ void scan::printParameterStatus(uint16_t bitmask, Stream *stream)
 void scan::printParameterStatus(uint16_t bitmask, Stream &stream)
 {printParameterStatus(bitmask, &stream);}
 // This gets any specific errors for the spectrometer itself (sensor status private)
+// The private status of parameter n is in input register 121 + 8n
 uint16_t scan::getSpecStatus(int parmNumber)
-{
-    int startingReg = 121 + 8*parmNumber;
-    // Get the register data
-    return modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-}
+{return uint16FromMap(inputReg::bmPPrivStatus, parmNumber);}
 void scan::printSpecStatus(uint16_t bitmask, Stream *stream)
 {
     // b15 - 8xxx
@@ -406,118 +421,292 @@ void scan::printSpecStatus(uint16_t bitmask, Stream *stream)
 void scan::printSpecStatus(uint16_t bitmask, Stream &stream)
 {printSpecStatus(bitmask, &stream);}
 // This gets calibrated data value
+// The value of parameter n is in input registers 122-123 + 8n
 float scan::getParameterValue(int parmNumber)
+{return float32FromMap(inputReg::xPValue, parmNumber);}
+
+// This gets the sample time and the device status with one request
+// They're only a few registers apart, so reading the registers between them
+// is cheaper than a second request.
+bool scan::getMeasurementState(uint32_t &parameterTime, uint16_t &deviceStatus)
 {
-    int startingReg = 120 + 8*parmNumber + 2;
-    // Get the register data
-    return modbus.float32FromRegister(0x04, startingReg, bigEndian);
+    int frameStart = inputReg::tSampleTime.at();
+    int frameEnd = inputReg::bmDeviceStatus.at();
+    if (!modbus.getRegisters(0x04, frameStart, frameEnd - frameStart + 1)) return false;
+    scanFrame frame = lastFrame();
+    uint32_t nanoseconds;
+    parameterTime = frame.TAI64NAt(0, nanoseconds);
+    deviceStatus = frame.uint16At(frameEnd - frameStart);
+    return true;
+}
+
+// This gets the time, device status, and parameter results all at once
+bool scan::getParameterSnapshot(parameterSnapshot &snapshot)
+{return readParameterSnapshot(readOwnFrame, this, snapshot);}
+
+// This is the frame reader for getParameterSnapshot()
+const byte *scan::readOwnFrame(byte regType, uint16_t startRegister,
+                               uint16_t numRegisters, void *context)
+{
+    scan *self = (scan*)context;
+    if (!self->modbus.getRegisters(regType, startRegister, numRegisters)) return NULL;
+    return self->modbus.responseBuffer;
+}
+
+// This gets the time, device status, and parameter results, reading each
+// frame with the given function
+// The first frame starts at the sample time and runs as far into the
+// parameter results as it can; each frame after that starts at the first
+// parameter that didn't fit completely in the one before.
+bool scan::readParameterSnapshot(frameReader reader, void *context,
+                                 parameterSnapshot &snapshot)
+{
+    const scanRegister &countReg = inputReg::uiParameterCount;
+    const byte *response = reader(countReg.regType, countReg.at(), 1, context);
+    if (response == NULL) return false;
+    int parmCount = scanFrame(response).uint16At(0);
+    if (parmCount > MAX_PARAMETERS) parmCount = MAX_PARAMETERS;
+    snapshot.count = parmCount;
+
+    int lastReg = inputReg::xPValue.at(parmCount) + 1;
+    if (lastReg < inputReg::bmDeviceStatus.at()) lastReg = inputReg::bmDeviceStatus.at();
+    int frameStart = inputReg::tSampleTime.at();
+    int nextParm = 1;
+    bool firstFrame = true;
+    while (firstFrame || nextParm <= parmCount)
+    {
+        int frameEnd = frameStart + MAX_REGS_PER_FRAME - 1;
+        if (frameEnd > lastReg) frameEnd = lastReg;
+        response = reader(0x04, frameStart, frameEnd - frameStart + 1, context);
+        if (response == NULL) return false;
+        scanFrame frame(response);
+        if (firstFrame)
+        {
+            uint32_t nanoseconds;
+            snapshot.time = frame.TAI64NAt(inputReg::tSampleTime.at() - frameStart, nanoseconds);
+            snapshot.deviceStatus = frame.uint16At(inputReg::bmDeviceStatus.at() - frameStart);
+            firstFrame = false;
+        }
+        int firstParmThisFrame = nextParm;
+        while (nextParm <= parmCount && inputReg::xPValue.at(nextParm) + 1 <= frameEnd)
+        {
+            snapshot.status[nextParm - 1] = frame.uint16At(inputReg::bmPStatus.at(nextParm) - frameStart);
+            snapshot.specStatus[nextParm - 1] = frame.uint16At(inputReg::bmPPrivStatus.at(nextParm) - frameStart);
+            snapshot.value[nextParm - 1] = frame.float32At(inputReg::xPValue.at(nextParm) - frameStart);
+            nextParm++;
+        }
+        // Stop rather than loop forever if a parameter can't fit in a frame
+        if (nextParm == firstParmThisFrame && frameStart == inputReg::bmPStatus.at(nextParm)) return false;
+        frameStart = inputReg::bmPStatus.at(nextParm);
+    }
+    return true;
 }
 
 
 // Last measurement time as a 32-bit count of seconds from Jan 1, 1970
 // (96-bit timestamp in TAI64N format - in this case, ignoring the nanoseconds)
+// Each spectral source is a block of 512 input registers, starting at 512
 uint32_t scan::getFingerprintTime(spectralSource source)
-{
-    int startingReg = 512 + 512*source;
-    uint32_t nanoseconds;
-    return modbus.TAI64NFromRegister(0x04, startingReg, nanoseconds);
-}
+{return TAI64NFromMap(inputReg::tFingerprintTime, source);}
 // This returns detector type used for the fingerprint
 detectorType scan::getFingerprintDetectorType(spectralSource source)
-{
-    int startingReg = 518 + 512*source;
-    int detect;
-    detect = modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-    return (detectorType)detect;
-}
+{return (detectorType)uint16FromMap(inputReg::eDetectorType, source);}
 // This returns the spectral source type used for the fingerprint
 spectralSource scan::getFingerprintSource(spectralSource source)
-{
-    int startingReg = 519 + 512*source;
-    int src;
-    src = modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-    return (spectralSource)src;
-}
-// This returns the spectral source type used for the fingerprint
+{return (spectralSource)uint16FromMap(inputReg::eSpectralSource, source);}
+// This returns the path length for the fingerprint, in tenths of a mm
 int scan::getFingerprintPathLength(spectralSource source)
-{
-    int startingReg = 520 + 512*source;
-    return modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-}
+{return uint16FromMap(inputReg::uiPathLength, source);}
 // This returns the parameter status for the fingerprint
+// A total and complete WAG as to the location of the status (521)
+// My other guess is that the status is in 508
 uint16_t scan::getFingerprintStatus(spectralSource source)
-{
-    // A total and complete WAG as to the location of the status (521)
-    // My other guess is that the status is in 508
-    int startingReg = 521 + 512*source;
-    return modbus.uint16FromRegister(0x04, startingReg, bigEndian);
-}
+{return uint16FromMap(inputReg::uiFPStatus, source);}
+// This gets spectral values from the sensor and hands them one at a time
+// to the callback function as each modbus frame arrives
+bool scan::getFingerprintData(spectralCallback callback, void *context, spectralSource source)
+{return streamFloatBlock(inputReg::fFingerprintData, source, callback, context, wavelength);}
+
+// This is the callback to fill an array with spectral values
+static void storeSpectralValue(int index, float, float value, void *context)
+{((float*)context)[index] = value;}
+
 // This gets spectral values from the sensor and puts them into a previously
 // initialized float array.  The array must have space for 221 values!
 // The actual return from the function is an integer which is a bit-mask
 // describing the fingerprint status (or, well, it would be if I could figure
-// out which register that value lived in).
-// int scan::getFingerprintData(float fpArray[], spectralSource source)
-// {
-//     int startingReg = 522 + 512*source;
-//     byte regType = 0x04;
-//     int totalValues = 221;
-//
-//     // Get the register data in several batches
-//        int valuesRemaining;
-//        int numRegsThisCall;
-//        float pointVal;
-//     for (int currentValueBeingRead = 0; currentValueBeingRead < totalValues;)
-//     {
-//         valuesRemaining = totalValues - currentValueBeingRead;
-//         if (valuesRemaining < (MAX_REGS_PER_FRAME/2)) numRegsThisCall = valuesRemaining*2;
-//         else numRegsThisCall = MAX_REGS_PER_FRAME;
-//         modbus.getRegisters(regType, startingReg + currentValueBeingRead*2, numRegsThisCall);
-//         for (int valueInThisCall = 0; valueInThisCall < (numRegsThisCall/2); valueInThisCall++)
-//         {
-//             pointVal = modbus.float32FromFrame(bigEndian, (valueInThisCall*4 + 3));
-//             fpArray[i+currentValueBeingRead] = pointVal;
-//             currentValueBeingRead++;
-//         }
-//     }
-//
-//     // A total and complete WAG as to the location of the status (521)
-//     // My other guess is that the status is in 508 (startingReg-14)
-//     Serial.println("Status");
-//     return modbus.uint16FromRegister(0x04, startingReg-1, bigEndian);
-// }
+// out which register that value lived in).  Returns -1 if the values
+// couldn't all be read.
+int scan::getFingerprintData(float fpArray[], spectralSource source)
+{
+    if (!getFingerprintData(storeSpectralValue, fpArray, source)) return -1;
+    return getFingerprintStatus(source);
+}
+// This returns the index of the fingerprint value closest to a wavelength
+// Wavelengths outside of 200-750 nm are clamped to the first or last value.
+int scan::wavelengthIndex(float nm)
+{
+    int index = round((nm - FIRST_WAVELENGTH)/WAVELENGTH_STEP);
+    if (index < 0) index = 0;
+    if (index > inputReg::fFingerprintData.count() - 1) index = inputReg::fFingerprintData.count() - 1;
+    return index;
+}
+
+// The wanted values and the callback to pass them to while reading windows
+typedef struct windowFilter
+{
+    int first[MAX_SPECTRAL_WINDOWS];
+    int last[MAX_SPECTRAL_WINDOWS];
+    int count;
+    spectralCallback callback;
+    void *context;
+} windowFilter;
+
+// This is the callback to pass on only the values inside of the windows
+// The values between closely spaced windows are read but not passed on.
+static void filterSpectralValue(int index, float wavelength, float value, void *context)
+{
+    windowFilter *filter = (windowFilter*)context;
+    for (int i = 0; i < filter->count; i++)
+    {
+        if (index >= filter->first[i] && index <= filter->last[i])
+        {
+            filter->callback(index, wavelength, value, filter->context);
+            return;
+        }
+    }
+}
+
+// This gets only the fingerprint values inside of the given wavelength windows
+// The windows are sorted and merged, and windows closer together than
+// SPECTRAL_WINDOW_GAP values are read in the same request.
+bool scan::getFingerprintWindows(const spectralWindow windows[], int numWindows,
+                                 spectralCallback callback, void *context,
+                                 spectralSource source)
+{
+    if (numWindows > MAX_SPECTRAL_WINDOWS) numWindows = MAX_SPECTRAL_WINDOWS;
+
+    // Convert the windows to value indices, sorted by the first index
+    windowFilter filter;
+    filter.count = 0;
+    filter.callback = callback;
+    filter.context = context;
+    for (int w = 0; w < numWindows; w++)
+    {
+        float startNm = windows[w].startNm;
+        float endNm = windows[w].endNm;
+        if (endNm < startNm) {float swap = startNm; startNm = endNm; endNm = swap;}
+        int first = wavelengthIndex(startNm);
+        int last = wavelengthIndex(endNm);
+        int i = filter.count;
+        while (i > 0 && filter.first[i-1] > first)
+        {
+            filter.first[i] = filter.first[i-1];
+            filter.last[i] = filter.last[i-1];
+            i--;
+        }
+        filter.first[i] = first;
+        filter.last[i] = last;
+        filter.count++;
+    }
+
+    // Merge any windows that overlap or touch
+    int merged = 0;
+    for (int i = 1; i < filter.count; i++)
+    {
+        if (filter.first[i] <= filter.last[merged] + 1)
+        {
+            if (filter.last[i] > filter.last[merged]) filter.last[merged] = filter.last[i];
+        }
+        else
+        {
+            merged++;
+            filter.first[merged] = filter.first[i];
+            filter.last[merged] = filter.last[i];
+        }
+    }
+    if (filter.count > 0) filter.count = merged + 1;
+
+    // Read the windows, bridging any small gaps between them
+    for (int i = 0; i < filter.count;)
+    {
+        int first = filter.first[i];
+        int last = filter.last[i];
+        for (i++; i < filter.count && filter.first[i] - last - 1 <= SPECTRAL_WINDOW_GAP; i++)
+            last = filter.last[i];
+        if (!streamFloatBlock(inputReg::fFingerprintData, source, filterSpectralValue,
+                              &filter, wavelength, first, last - first + 1)) return false;
+    }
+    return true;
+}
+
+// This gets only the fingerprint values inside of the given wavelength
+// windows and puts them into a previously initialized float array
+// The array must have space for 221 values!  Values outside of the windows
+// are left alone.
+bool scan::getFingerprintWindows(const spectralWindow windows[], int numWindows,
+                                 float fpArray[], spectralSource source)
+{return getFingerprintWindows(windows, numWindows, storeSpectralValue, fpArray, source);}
+
+// The callback and requests for a pipelined spectral sweep
+typedef struct sweepContext
+{
+    const scanTCPRead *requests;
+    sweepCallback callback;
+    void *context;
+} sweepContext;
+
+// This decodes one reply of a spectral sweep
+// The source and the first value in the frame both come from the register
+// the request started at.
+static void decodeSweepFrame(int request, const scanFrame &frame, void *context)
+{
+    const sweepContext *sweep = (const sweepContext*)context;
+    const scanRegister &reg = inputReg::fFingerprintData;
+    int offset = sweep->requests[request].startRegister - reg.at();
+    int source = offset/reg.stride;
+    int firstValue = (offset % reg.stride)/reg.width();
+    int numValues = sweep->requests[request].numRegisters/reg.width();
+    for (int i = 0; i < numValues; i++)
+    {
+        int index = firstValue + i;
+        sweep->callback((spectralSource)source, index, scan::wavelength(index),
+                        frame.float32At(i*reg.width()), sweep->context);
+    }
+}
+
+// This gets the fingerprint data for every spectral source in the mask
+// over Modbus TCP, with several requests waiting for replies at once
+bool scan::getFingerprintSweep(scanModbusTCP &transport, sweepCallback callback,
+                               void *context, uint8_t sources)
+{
+    const scanRegister &reg = inputReg::fFingerprintData;
+    scanTCPRead requests[8*inputReg::fFingerprintData.frames()];
+    int count = 0;
+    for (int source = 0; source < 8; source++)
+    {
+        if (!(sources & (1 << source))) continue;
+        for (int value = 0; value < reg.count(); value += reg.valuesPerFrame())
+        {
+            int numValues = reg.count() - value;
+            if (numValues > reg.valuesPerFrame()) numValues = reg.valuesPerFrame();
+            requests[count].unitID = _slaveID;
+            requests[count].regType = reg.regType;
+            requests[count].startRegister = reg.at(source) + value*reg.width();
+            requests[count].numRegisters = numValues*reg.width();
+            count++;
+        }
+    }
+    sweepContext sweep = {requests, callback, context};
+    return transport.readPipelined(requests, count, decodeSweepFrame, &sweep);
+}
+
 // This prints the fingerprint data as delimeter separated data.
 // By default, the delimeter is a TAB (\t, 0x09), as expected by the s::can/ana::xxx software.
 // This includes the fingerprint timestamp and status
 // NB:  You can use this to print to a file on a SD card!
 void scan::printFingerprintData(Stream *stream, const char *dlm, spectralSource source)
-{
-        int startingReg = 522 + 512*source;
-        byte regType = 0x04;
-        int totalValues = 221;
-
-        // Get the register data in several batches
-        int valuesRemaining;
-        int numRegsThisCall;
-        int firstRegThisCall;
-        float pointVal;
-        for (int currentValueBeingRead = 0; currentValueBeingRead < totalValues;)
-        {
-            valuesRemaining = totalValues - currentValueBeingRead;
-            if (valuesRemaining < (MAX_REGS_PER_FRAME/2)) numRegsThisCall = valuesRemaining*2;
-            else numRegsThisCall = MAX_REGS_PER_FRAME;
-            firstRegThisCall = startingReg + currentValueBeingRead*2;
-            modbus.getRegisters(regType, firstRegThisCall, numRegsThisCall);
-            for (int valueInThisCall = 0; valueInThisCall < (numRegsThisCall/2); valueInThisCall++)
-            {
-                pointVal = modbus.float32FromFrame(bigEndian, (valueInThisCall*4 + 3));
-                if (currentValueBeingRead < totalValues) stream->print(pointVal, 4);
-                if (currentValueBeingRead < totalValues-1) stream->print(dlm);
-                currentValueBeingRead++;
-            }
-        }
-        stream->println();
-}
+{printFloatBlock(inputReg::fFingerprintData, source, stream, dlm);}
 void scan::printFingerprintData(Stream &stream, const char *dlm, spectralSource source)
 {printFingerprintData(&stream, dlm, source);}
 
@@ -529,13 +718,13 @@ void scan::printFingerprintData(Stream &stream, const char *dlm, spectralSource
 // Functions for the communication mode
 // The Communication mode is in holding register 1 (1 uint16 register)
 int scan::getCommunicationMode(void)
-{return modbus.uint16FromRegister(0x03, 1);}
+{return uint16FromMap(holdingReg::eCommMode);}
 bool scan::setCommunicationMode(specCommMode mode)
 {
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = mode;
-    return modbus.setRegisters(1, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::eCommMode.at(), 1, byteToSend);
 }
 String scan::parseCommunicationMode(uint16_t code)
 {
@@ -552,13 +741,13 @@ String scan::parseCommunicationMode(uint16_t code)
 // Functions for the serial baud rate (iff communication mode = modbus RTU or modbus ASCII)
 // Baud rate is in holding register 2 (1 uint16 register)
 int scan::getBaudRate(void)
-{return modbus.uint16FromRegister(0x03, 2);}
+{return uint16FromMap(holdingReg::eBaudrate);}
 bool scan::setBaudRate(specBaudRate baud)
 {
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = baud;
-    return modbus.setRegisters(2, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::eBaudrate.at(), 1, byteToSend);
 }
 uint16_t scan::parseBaudRate(uint16_t code)
 {
@@ -578,13 +767,13 @@ uint16_t scan::parseBaudRate(uint16_t code)
 // Functions for the serial parity (iff communication mode = modbus RTU or modbus ASCII)
 // Parity is in holding register 3 (1 uint16 register)
 int scan::getParity(void)
-{return modbus.uint16FromRegister(0x03, 3);}
+{return uint16FromMap(holdingReg::eParity);}
 bool scan::setParity(specParity parity)
 {
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = parity;
-    return modbus.setRegisters(3, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::eParity.at(), 1, byteToSend);
 }
 String scan::parseParity(uint16_t code)
 {
@@ -597,13 +786,55 @@ String scan::parseParity(uint16_t code)
     }
 }
 
+// The baud rates the spectro::lyser supports, in order of their setting code
+static const uint32_t specBaudRates[] = {9600, 19200, 38400};
+
+// This reads the address, communication mode, baud rate and parity (holding
+// registers 0-3) at once, then steps the baud rate up as far as maxBaud
+bool scan::negotiateFastestBaud(scanSerialOpener opener, uint32_t maxBaud, byte stopBits)
+{
+    int frameStart = holdingReg::uiAddress.at();
+    int frameEnd = holdingReg::eParity.at();
+    if (!modbus.getRegisters(0x03, frameStart, frameEnd - frameStart + 1)) return false;
+    scanFrame frame = lastFrame();
+    uint16_t commMode = frame.uint16At(holdingReg::eCommMode.at() - frameStart);
+    uint16_t current = frame.uint16At(holdingReg::eBaudrate.at() - frameStart);
+    specParity parity = (specParity)frame.uint16At(holdingReg::eParity.at() - frameStart);
+    if (commMode == modbusTCP || current > b38400) return false;
+
+    int fastest = b38400;
+    while (fastest > (int)current && specBaudRates[fastest] > maxBaud) fastest--;
+    if (fastest <= (int)current) return true;  // Already as fast as it can go
+
+    // The device may answer at either rate, so the answer isn't checked
+    setBaudRate((specBaudRate)fastest);
+    opener(specBaudRates[fastest], parity, stopBits);
+    if (verifyCommunication()) return true;
+
+    // If it can be heard at the old rate, it never changed.  If it can't, it
+    // can't be heard at either rate, so there's no point telling it to go
+    // back; the port is left at the old rate for it to be looked for again.
+    opener(specBaudRates[current], parity, stopBits);
+    verifyCommunication();
+    return false;
+}
+
+bool scan::verifyCommunication(void)
+{
+    // Anything garbled from the change is cleared out before each request
+    delay(BAUD_SETTLE_TIME);
+    for (int i = 0; i < BAUD_VERIFY_TRIES; i++)
+        if (uint16FromMap(holdingReg::uiAddress) == _slaveID) return true;
+    return false;
+}
+
 // Functions to get a pointer to the private configuration register
 // Pointer to the private configuration is in holding register 5
 // This is read only
 int scan::getprivateConfigRegister(void)
-{return modbus.pointerFromRegister(0x03, 5);}
+{return modbus.pointerFromRegister(0x03, holdingReg::pDeviceConfigPrivate.at());}
 int scan::getprivateConfigRegisterType(void)
-{return modbus.pointerTypeFromRegister(0x03, 5);}
+{return modbus.pointerTypeFromRegister(0x03, holdingReg::pDeviceConfigPrivate.at());}
 String scan::parseRegisterType(uint16_t code)
 {
     switch (code)
@@ -618,36 +849,121 @@ String scan::parseRegisterType(uint16_t code)
 
 // This reads the global calibration name from the private registers
 // NB This is NOT documented
-// NB In theory, can get the location from the pointer to private setup which
-// is in the holding registers.  In reality, it seems alwasy to start at 1180
-// for the spectrolyzer and to be in for ana::gate, so I'll just call there
-// and save data transfer time.
+// NB Where the spectro::lyser keeps the global calibration depends on the
+// firmware.  The location is looked for once and cached; if it can't be
+// found, this falls back to register 1081, where it has been on every
+// spectro::lyser we've seen.  For ana::gate it is always input register 964.
 String scan::getCurrentGlobalCal(void)
 {
-    if (getModelType() == 0x0603) return modbus.StringFromRegister(0x04, 964, 12);
-    else return modbus.StringFromRegister(0x03, 1080, 12);
-    /*
+    if (isAnaGate()) return StringFromMap(anaGateMap::globalCal());
+    scanRegister globalCal = spectroLyserMap::globalCal();
+    if (resolvePrivateConfig())
+    {
+        globalCal.regType = _privateConfig.regType;
+        globalCal.address = _privateConfig.globalCalReg;
+    }
+    return StringFromMap(globalCal);
+}
+
+// This reads the name of the next global calibration stored on the device
+// NB This is NOT documented, and is only available from the spectro::lyser
+String scan::getNextGlobalCal(void)
+{
+    if (isAnaGate() || !resolvePrivateConfig()) return "";
+    scanRegister nextCal = holdingReg::cGlobalCalList1;
+    nextCal.regType = _privateConfig.regType;
+    nextCal.address = _privateConfig.nextGlobalCalReg;
+    return StringFromMap(nextCal);
+}
+
+// This checks whether a register could be the start of a calibration name:
+// two printable characters, or one followed by the padding
+static bool startsName(uint16_t reg)
+{
+    byte first = reg >> 8;
+    byte second = reg & 0xFF;
+    if (first < 0x20 || first > 0x7E) return false;
+    return second == 0 || (second >= 0x20 && second <= 0x7E);
+}
+
+// This searches the private configuration for the global calibration names
+// On every firmware we've logged (see RegisterLog.txt) the in-use name is at
+// holding register 1081, before the private configuration pointer (1232,
+// whose registers are all zero), so that is checked first with one frame.
+// Otherwise this reads full frames from the pointer and takes the first
+// register that starts a name.  The other names are at fixed offsets from
+// the in-use one.
+// Returns true if the search could be completed, even if nothing was found.
+// Only a completed search is remembered; one cut short by the bus is tried
+// again the next time the names are needed.
+bool scan::discoverPrivateConfig(void)
+{
+    float swVersion = getSWVersion();
+    // Until something is found, nothing is there
+    _privateConfig.swVersion = 0;
+    _privateConfig.regType = 0x03;
+    _privateConfig.globalCalReg = 0;
+    _privateConfig.nextGlobalCalReg = 0;
+    int listOffset = holdingReg::cGlobalCalList1.address - holdingReg::cGlobalCal0.address;
+
+    // The usual place, with the first stored name after it
+    int numRegs = listOffset + holdingReg::cGlobalCalList1.length;
+    uint16_t regValues[MAX_REGS_PER_FRAME];
+    if (modbus.getRegisters(0x03, holdingReg::cGlobalCal0.address, numRegs) &&
+        lastFrame().copyTo(regValues, numRegs) == numRegs &&
+        startsName(regValues[0]) && startsName(regValues[listOffset]))
+    {
+        _privateConfig.swVersion = swVersion;
+        _privateConfig.globalCalReg = holdingReg::cGlobalCal0.address;
+        _privateConfig.nextGlobalCalReg = holdingReg::cGlobalCalList1.address;
+        return true;
+    }
+
+    // Get the pointer to the private configuration
+    if (!modbus.getRegisters(0x03, holdingReg::pDeviceConfigPrivate.at(), 1)) return false;
+    int startReg = modbus.pointerFromFrame(bigEndian, 3);
     byte regType;
-    switch (getprivateConfigRegisterType())
+    switch (modbus.pointerTypeFromFrame(bigEndian, 3))
     {
         case 0: regType = 0x03; break;
         case 1: regType = 0x04; break;
-        case 2: regType = 0x02; break;
-        case 3: regType = 0x05; break;
-        default: regType = 0x00; break;
+        default: return false;  // Names can't be in coils or discrete inputs
     }
-    // Because the address of the private config could be shifted, we have to
-    // search for the actual start of the global calibration name
-    int testVal;
-    int actualReg;
-    for (int i = 0; i < 256; i++)
+
+    // Read the private configuration, a frame at a time
+    int numRegsThisCall;
+    for (int regsSearched = 0; regsSearched < PRIVATE_CONFIG_SEARCH_REGS;)
     {
-        actualReg = regNum + i;
-        testVal = modbus.uint16FromRegister(regType, actualReg);
-        if (testVal != 0) break;
+        numRegsThisCall = PRIVATE_CONFIG_SEARCH_REGS - regsSearched;
+        if (numRegsThisCall > MAX_REGS_PER_FRAME) numRegsThisCall = MAX_REGS_PER_FRAME;
+        if (!modbus.getRegisters(regType, startReg + regsSearched, numRegsThisCall)) return false;
+        numRegsThisCall = lastFrame().copyTo(regValues, numRegsThisCall);
+        for (int regInThisCall = 0; regInThisCall < numRegsThisCall; regInThisCall++)
+        {
+            if (startsName(regValues[regInThisCall]))
+            {
+                _privateConfig.swVersion = swVersion;
+                _privateConfig.regType = regType;
+                _privateConfig.globalCalReg = startReg + regsSearched + regInThisCall;
+                _privateConfig.nextGlobalCalReg = _privateConfig.globalCalReg + listOffset;
+                return true;
+            }
+        }
+        regsSearched += numRegsThisCall;
     }
-    return modbus.StringFromRegister(regType, actualReg, 12);
-    */
+
+    // The whole area was blank, so remember that nothing is there
+    _privateConfig.swVersion = swVersion;
+    _privateConfig.regType = regType;
+    return true;
+}
+
+// This restores previously discovered private configuration locations
+// They will be checked against the software version the first time they're used
+void scan::setPrivateConfigMap(const privateConfigMap &configMap)
+{
+    _privateConfig = configMap;
+    _privateConfigChecked = false;
 }
 
 
@@ -655,21 +971,21 @@ String scan::getCurrentGlobalCal(void)
 // Device Location (s::canpoint) is registers 6-11 (char[12])
 // This is read only
 String scan::getScanPoint(void)
-{return modbus.StringFromRegister(0x03, 6, 12);}
+{return StringFromMap(holdingReg::abDeviceLocation);}
 bool scan::setScanPoint(char charScanPoint[12])
-{return modbus.charToRegister(6, charScanPoint, 12);}
+{return modbus.charToRegister(holdingReg::abDeviceLocation.at(), charScanPoint, 12);}
 
 
 // Functions for the cleaning mode configuration
 // Cleaning mode is in holding register 12 (1 uint16 register)
 int scan::getCleaningMode(void)
-{return modbus.uint16FromRegister(0x03, 12);}
+{return uint16FromMap(holdingReg::eCleanMode);}
 bool scan::setCleaningMode(cleaningMode mode)
 {
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = mode;
-    return modbus.setRegisters(12, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::eCleanMode.at(), 1, byteToSend);
 }
 String scan::parseCleaningMode(uint16_t code)
 {
@@ -687,53 +1003,50 @@ String scan::parseCleaningMode(uint16_t code)
 // (0 - no automatic cleaning enabled)
 // Cleaning interval is in holding register 13 (1 uint16 register)
 int scan::getCleaningInterval(void)
-{return modbus.uint16FromRegister(0x03, 13);}
+{return uint16FromMap(holdingReg::uiCleanInterval);}
 bool scan::setCleaningInterval(uint16_t intervalSamples)
-{return modbus.uint16ToRegister(13, intervalSamples, bigEndian);}
+{return modbus.uint16ToRegister(holdingReg::uiCleanInterval.at(), intervalSamples, bigEndian);}
 
 // Functions for the cleaning duration in seconds
 // Cleaning duration is in holding register 14 (1 uint16 register)
 int scan::getCleaningDuration(void)
-{return modbus.uint16FromRegister(0x03, 14);}
+{return uint16FromMap(holdingReg::uiCleanDuration);}
 bool scan::setCleaningDuration(uint16_t secDuration)
-{return modbus.uint16ToRegister(14, secDuration, bigEndian);}
+{return modbus.uint16ToRegister(holdingReg::uiCleanDuration.at(), secDuration, bigEndian);}
 
 // Functions for the waiting time between end of cleaning
 // and the start of a measurement
 // Cleaning wait time is in holding register 15 (1 uint16 register)
 int scan::getCleaningWait(void)
-{return modbus.uint16FromRegister(0x03, 15);}
+{return uint16FromMap(holdingReg::uiCleanWait);}
 bool scan::setCleaningWait(uint16_t secDuration)
-{return modbus.uint16ToRegister(15, secDuration, bigEndian);}
+{return modbus.uint16ToRegister(holdingReg::uiCleanWait.at(), secDuration, bigEndian);}
 
 // Functions for the current system time in seconds from Jan 1, 1970
 // System time is in holding registers 16-21
 // (64-bit timestamp in TAI64N format - in this case, ignoring the nanoseconds)
 uint32_t scan::getSystemTime(void)
-{
-    uint32_t nanoseconds;
-    return modbus.TAI64NFromRegister(0x03, 16, nanoseconds);
-}
+{return TAI64NFromMap(holdingReg::tSystemTime);}
 bool scan::setSystemTime(uint32_t currentUnixTime)
-{return modbus.TAI64NToRegister(16, currentUnixTime, 0);}
+{return modbus.TAI64NToRegister(holdingReg::tSystemTime.at(), currentUnixTime, 0);}
 
 // Functions for the measurement interval in seconds (0 - as fast as possible)
 // Measurement interval is in holding register 22 (1 uint16 register)
 int scan::getMeasInterval(void)
-{return modbus.uint16FromRegister(0x03, 22);}
+{return uint16FromMap(holdingReg::uiMeasInterval);}
 bool scan::setMeasInterval(uint16_t secBetween)
-{return modbus.uint16ToRegister(22, secBetween, bigEndian);}
+{return modbus.uint16ToRegister(holdingReg::uiMeasInterval.at(), secBetween, bigEndian);}
 
 // Functions for the logging Mode (0 = on; 1 = off)
 // Logging Mode (0 = on; 1 = off) is in holding register 23 (1 uint16 register)
 int scan::getLoggingMode(void)
-{return modbus.uint16FromRegister(0x03, 23);}
+{return uint16FromMap(holdingReg::eLoggingMode);}
 bool scan::setLoggingMode(uint8_t mode)
 {
     byte byteToSend[2];
     byteToSend[0] = 0x00;
     byteToSend[1] = mode;
-    return modbus.setRegisters(23, 1, byteToSend);
+    return modbus.setRegisters(holdingReg::eLoggingMode.at(), 1, byteToSend);
 }
 String scan::parseLoggingMode(uint16_t code)
 {
@@ -749,14 +1062,14 @@ String scan::parseLoggingMode(uint16_t code)
 // (0 = no logging active)
 // Logging interval is in holding register 24 (1 uint16 register)
 int scan::getLoggingInterval(void)
-{return modbus.uint16FromRegister(0x03, 24);}
+{return uint16FromMap(holdingReg::uiLogInterval);}
 bool scan::setLoggingInterval(uint16_t interval)
-{return modbus.uint16ToRegister(24, interval, bigEndian);}
+{return modbus.uint16ToRegister(holdingReg::uiLogInterval.at(), interval, bigEndian);}
 
 // Available number of logged results in datalogger since last clearing
 // Available number of logged results is in holding register 25 (1 uint16 register)
 int scan::getNumLoggedResults(void)
-{return modbus.uint16FromRegister(0x03, 25);}
+{return uint16FromMap(holdingReg::uiNLogResultsTotal);}
 
 // "Index device status public + private & parameter results from logger
 // storage to Modbus registers.  If no stored results are available,
@@ -764,7 +1077,7 @@ int scan::getNumLoggedResults(void)
 // I'm really not sure what this means...
 // "Index device status" is in holding register 26 (1 uint16 register)
 int scan::getIndexLogResult(void)
-{return modbus.uint16FromRegister(0x03, 26);}
+{return uint16FromMap(holdingReg::uiIndexLogResult);}
 
 
 
@@ -777,70 +1090,46 @@ int scan::getIndexLogResult(void)
 // The next parameter begins 120 registers after that.
 // The spectro::lyzer supports up to 8 parameters, ana::gate supports 32.
 String scan::getParameterName(int parmNumber)
-{
-    int startingReg = 120*parmNumber;
-    return modbus.StringFromRegister(0x03, startingReg, 8);
-}
+{return StringFromMap(holdingReg::abPName, parmNumber);}
 
 // This returns a string with the measurement units.
 // This begins 4 registers after the parameter name
 String scan::getParameterUnits(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 4;
-    return modbus.StringFromRegister(0x03, startingReg, 8);
-}
+{return StringFromMap(holdingReg::abPUnit, parmNumber);}
 
 // This gets the upper limit of the parameter
 // This begins 8 registers after the parameter name
 float scan::getParameterUpperLimit(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 8;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::xPUpperLimit, parmNumber);}
 
 // This gets the lower limit of the parameter
 // This begins 10 registers after the parameter name
 float scan::getParameterLowerLimit(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 10;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::xPLowerLimit, parmNumber);}
+
+// The four local calibration coefficients begin 14 registers after the
+// parameter name, in the order offset, slope, x2, x3
 
 // This gets the offset of the local calibration
 float scan::getParameterCalibOffset(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 14;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::fCalibrCoeff, parmNumber, 0);}
 
 // This gets the slope of the local calibration
 float scan::getParameterCalibSlope(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 16;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::fCalibrCoeff, parmNumber, 1);}
 
 // This gets the x2 coefficient of the slope of the local calibration
 float scan::getParameterCalibX2(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 18;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::fCalibrCoeff, parmNumber, 2);}
 
 // This gets the x3 coefficient of the slope of the local calibration
 float scan::getParameterCalibX3(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 20;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::fCalibrCoeff, parmNumber, 3);}
 
 // This gets the measurement precision of the parameter
 // Totally a wag as to the location
 uint16_t scan::getParameterPrecision(int parmNumber)
-{
-    int startingReg = 120*parmNumber + 27;
-    return modbus.uint16FromRegister(0x03, startingReg, bigEndian);
-}
+{return uint16FromMap(holdingReg::uiPPrecision, parmNumber);}
 
 
 
@@ -852,172 +1141,113 @@ uint16_t scan::getParameterPrecision(int parmNumber)
 
 // This returns the index number of the reference in use.
 int16_t scan::getCurrentReferenceNumber(void)
-{return modbus.int16FromRegister(0x03, 1507, bigEndian);}
+{return int16FromMap(holdingReg::uiRefNuminUse);}
 
 // This returns a pretty string with the name of the reference currently in use
 String scan::getCurrentReferenceName(void)
-{return modbus.StringFromRegister(0x03, 1508, 8);}
+{return StringFromMap(holdingReg::uiRefNameinUse);}
 
 // This returns the index number of the reference in use.
 uint32_t scan::getCurrentReferenceTime(void)
-{
-    uint32_t nanoseconds;
-    return modbus.TAI64NFromRegister(0x03, 1512, nanoseconds);
-}
+{return TAI64NFromMap(holdingReg::tRefinUse);}
+
+// Each stored reference is a block of 536 holding registers, starting at 1519
 
 // This returns a pretty string with the Reference measured.
 String scan::getReferenceName(int refNumber)
-{
-    int startingReg = 1519 + 536*refNumber;
-    return modbus.StringFromRegister(0x03, startingReg, 8);
-}
+{return StringFromMap(holdingReg::cRefName, refNumber);}
 
 // This returns the amount of "dark noise" when the reference was taken
 float scan::getReferenceDarkNoise(int refNumber)
-{
-    int startingReg = 1523 + 536*refNumber;
-    return modbus.float32FromRegister(0x03, startingReg, bigEndian);
-}
+{return float32FromMap(holdingReg::fDarkNoise, refNumber);}
 
 // This returns the average "K" value when the reference was taken
 int16_t scan::getReferenceAvgK(int refNumber)
-{
-    int startingReg = 1525 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiAvgK, refNumber);}
 
 // This returns the average "M" value when the reference was taken
 int16_t scan::getReferenceAvgM(int refNumber)
-{
-    int startingReg = 1526 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiAvgM, refNumber);}
 
 // This returns the flash rate in Hz when the reference was taken
 int16_t scan::getReferenceFlashRate(int refNumber)
-{
-    int startingReg = 1527 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiFlash, refNumber);}
 
 // This returns the lamp voltage during the reference measurement
 int16_t scan::getReferenceLampVoltage(int refNumber)
-{
-    int startingReg = 1528 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiLampV, refNumber);}
 
 // This returns the detector type used to take the reference
 //  0 = UV, 1 = UV-Vis
 detectorType scan::getReferenceDetectorType(int refNumber)
-{
-    int startingReg = 1529 + 536*refNumber;
-    int detect;
-    detect = modbus.uint16FromRegister(0x03, startingReg, bigEndian);
-    return (detectorType)detect;
-}
+{return (detectorType)uint16FromMap(holdingReg::eDetectorType, refNumber);}
 
 // This returns the "Number of max repetitions" when the reference was taken
 // I have no clue what that means, but that's what this value is
 int16_t scan::getReferenceRepetitions(int refNumber)
-{
-    int startingReg = 1530 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiRefRepetitions, refNumber);}
 
 // This returns true if the Lp filter was on when the reference was taken, else false
 bool scan::getReferenceLpFilter(int refNumber)
-{
-    int startingReg = 1531 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::eLpfilter, refNumber);}
 
 // This returns the frequency lower limit in Hertz
 int16_t scan::getReferenceFUG(int refNumber)
-{
-    int startingReg = 1532 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::uiFUG, refNumber);}
 
 // This returns the reference type (but I don't know what the return means)
 int16_t scan::getReferenceType(int refNumber)
-{
-    int startingReg = 1533 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::eRefType, refNumber);}
 
 // This returns the reference offset in abs/m
 int16_t scan::getReferenceOffset(int refNumber)
-{
-    int startingReg = 1534 + 536*refNumber;
-    return modbus.int16FromRegister(0x03, startingReg, bigEndian);
-}
+{return int16FromMap(holdingReg::eRefOffset, refNumber);}
 
 // This returns the Unix timestamp when the reference was recorded
 uint32_t scan::getReferenceTime(int refNumber)
+{return TAI64NFromMap(holdingReg::tRefTime, refNumber);}
+
+// This gets all of the settings a reference was taken with at once
+// Everything from the name to the time is within 23 registers.
+bool scan::getReferenceInfo(int refNumber, referenceInfo &info)
 {
-    int startingReg = 1536 + 536*refNumber;
+    int firstReg = holdingReg::cRefName.at(refNumber);
+    int numRegs = holdingReg::tRefTime.at(refNumber) + holdingReg::tRefTime.length - firstReg;
+    if (!modbus.getRegisters(0x03, firstReg, numRegs)) return false;
+    scanFrame frame = lastFrame();
+    frame.charAt(0, info.name, holdingReg::cRefName.chars());
+    info.darkNoise = frame.float32At(holdingReg::fDarkNoise.at(refNumber) - firstReg);
+    info.avgK = frame.int16At(holdingReg::uiAvgK.at(refNumber) - firstReg);
+    info.avgM = frame.int16At(holdingReg::uiAvgM.at(refNumber) - firstReg);
+    info.flashRate = frame.int16At(holdingReg::uiFlash.at(refNumber) - firstReg);
+    info.lampVoltage = frame.int16At(holdingReg::uiLampV.at(refNumber) - firstReg);
+    info.detector = (detectorType)frame.uint16At(holdingReg::eDetectorType.at(refNumber) - firstReg);
+    info.repetitions = frame.int16At(holdingReg::uiRefRepetitions.at(refNumber) - firstReg);
+    info.lpFilter = frame.int16At(holdingReg::eLpfilter.at(refNumber) - firstReg);
+    info.FUG = frame.int16At(holdingReg::uiFUG.at(refNumber) - firstReg);
+    info.type = frame.int16At(holdingReg::eRefType.at(refNumber) - firstReg);
+    info.offset = frame.int16At(holdingReg::eRefOffset.at(refNumber) - firstReg);
     uint32_t nanoseconds;
-    return modbus.TAI64NFromRegister(0x03, startingReg, nanoseconds);
+    info.time = frame.TAI64NAt(holdingReg::tRefTime.at(refNumber) - firstReg, nanoseconds);
+    return true;
 }
 
 // This gets abssorbance values in Abs/m for the reference and puts them
 // into a previously initialized float array.  The array must have space
 // for 256 values!
-// void scan::getReferenceValues(float refArray[], int refNumber)
-// {
-//     int startingReg = 1542 + 536*refNumber;
-    byte regType = 0x03;
-//     int totalValues = 256;
-//
-//     // Get the register data in several batches
-//     int valuesRemaining;
-//     int numRegsThisCall;
-//     float pointVal;
-//     for (int currentValueBeingRead = 0; currentValueBeingRead < totalValues;)
-//     {
-//         valuesRemaining = totalValues - currentValueBeingRead;
-//         if (valuesRemaining < (MAX_REGS_PER_FRAME/2)) numRegsThisCall = valuesRemaining*2;
-//         else numRegsThisCall = MAX_REGS_PER_FRAME;
-//         modbus.getRegisters(regType, startingReg + currentValueBeingRead*2, numRegsThisCall);
-//         for (int valueInThisCall = 0; valueInThisCall < (numRegsThisCall/2); valueInThisCall++)
-//         {
-//             pointVal = modbus.float32FromFrame(bigEndian, (valueInThisCall*4 + 3));
-//             refArray[i+currentValueBeingRead] = pointVal;
-//             currentValueBeingRead++;
-//         }
-//     }
-// }
+bool scan::getReferenceValues(float refArray[], int refNumber)
+{return getReferenceData(refNumber, storeSpectralValue, refArray);}
+
+// This gets abssorbance values in Abs/m for the reference and hands them
+// one at a time to the callback function
+bool scan::getReferenceData(int refNumber, spectralCallback callback, void *context)
+{return streamFloatBlock(holdingReg::fRefValues, refNumber, callback, context, referenceWavelength);}
 
 // This prints the reference data as delimeter separated data.
 // By default, the delimeter is a TAB (\t, 0x09).
 // NB:  You can use this to print to a file on a SD card!
 void scan::printReferenceData(int refNumber, Stream *stream, const char *dlm)
-{
-    int startingReg = 1542 + 536*refNumber;
-    byte regType = 0x03;
-    int totalValues = 256;
-
-    // Get the register data in several batches
-    int valuesRemaining;
-    int numRegsThisCall;
-    float pointVal;
-    for (int currentValueBeingRead = 0; currentValueBeingRead < totalValues;)
-    {
-        valuesRemaining = totalValues - currentValueBeingRead;
-        if (valuesRemaining < (MAX_REGS_PER_FRAME/2)) numRegsThisCall = valuesRemaining*2;
-        else numRegsThisCall = MAX_REGS_PER_FRAME;
-        modbus.getRegisters(regType, startingReg + currentValueBeingRead*2, numRegsThisCall);
-        for (int valueInThisCall = 0; valueInThisCall < (numRegsThisCall/2); valueInThisCall++)
-        {
-            pointVal = modbus.float32FromFrame(bigEndian, (valueInThisCall*4 + 3));
-            if (valueInThisCall+currentValueBeingRead < totalValues+1) stream->print(pointVal, 4);
-            if (valueInThisCall+currentValueBeingRead < totalValues) stream->print(dlm);
-            currentValueBeingRead++;
-        }
-    }
-    stream->println();
-}
+{printFloatBlock(holdingReg::fRefValues, refNumber, stream, dlm);}
 void scan::printReferenceData(int refNumber, Stream &stream, const char *dlm)
 {printReferenceData(refNumber, &stream, dlm);}
 
@@ -1034,7 +1264,7 @@ void scan::printReferenceData(int refNumber, Stream &stream, const char *dlm)
 // The modbus version is in input register 0
 float scan::getModbusVersion(void)
 {
-    modbus.getRegisters(0x04, 0, 1);
+    modbus.getRegisters(0x04, inputReg::uiVersion.at(), 1);
     float mjv = modbus.byteFromFrame(3);
     float mnv = modbus.byteFromFrame(4);
     mnv = mnv/100;
@@ -1043,21 +1273,46 @@ float scan::getModbusVersion(void)
 }
 
 // This returns a byte with the model type
+// The model cannot change, so after one good read the value is cached
 uint16_t scan::getModelType(void)
-{return modbus.uint16FromRegister(0x04, 2);}
+{
+    if (_modelType == 0 && modbus.getRegisters(0x04, inputReg::eModel.at(), 1))
+        _modelType = modbus.uint16FromFrame(bigEndian, 3);
+    return _modelType;
+}
+
+// This returns the device family, detected from the model type
+// Anything other than an ana::gate is treated as a spectro::lyser
+scanModel scan::getScanModel(void)
+{
+#if defined(SCAN_SPECTROLYSER_ONLY)
+    return spectroLyser;
+#elif defined(SCAN_ANAGATE_ONLY)
+    return anaGate;
+#else
+    uint16_t model = getModelType();
+    if (model == 0) return modelUnknown;
+    else if (model == ANAGATE_MODEL_CODE) return anaGate;
+    else return spectroLyser;
+#endif
+}
+bool scan::isSpectroLyser(void)
+{return getScanModel() == spectroLyser;}
+bool scan::isAnaGate(void)
+{return getScanModel() == anaGate;}
 
 // This returns a pretty string with the model information
 String scan::getModel(void)
-{return modbus.StringFromRegister(0x04, 3, 20);}
+{return StringFromMap(inputReg::abModel);}
 
 // This gets the instrument serial number as a String
 String scan::getSerialNumber(void)
-{return modbus.StringFromRegister(0x04, 13, 8);}
+{return StringFromMap(inputReg::abSerialNumber);}
 
 // This gets the hardware version of the sensor
 float scan::getHWVersion(void)
 {
-    String _model = modbus.StringFromRegister(0x04, 17, 4);
+    String _model = StringFromMap(inputReg::abHWRelease);
     float mjv = _model.substring(0,2).toFloat();
     float mnv = (_model.substring(2,4).toFloat())/100;
     float version = mjv + mnv;
@@ -1067,7 +1322,7 @@ float scan::getHWVersion(void)
 // This gets the software version of the sensor
 float scan::getSWVersion(void)
 {
-    String _model = modbus.StringFromRegister(0x04, 19, 4);
+    String _model = StringFromMap(inputReg::abSWRelease);
     float mjv = _model.substring(0,2).toFloat();
     float mnv = (_model.substring(2,4).toFloat())/100;
     float version = mjv + mnv;
@@ -1077,16 +1332,16 @@ float scan::getSWVersion(void)
 // This gets the number of times the spec has been rebooted
 // (Device rebooter counter)
 int scan::getHWStarts(void)
-{return modbus.uint16FromRegister(0x04, 21);}
+{return uint16FromMap(inputReg::uiHWStarts);}
 
 // This gets the number of parameters the spectro::lyzer is set to measure
 int scan::getParameterCount(void)
-{return modbus.uint16FromRegister(0x04, 22);}
+{return uint16FromMap(inputReg::uiParameterCount);}
 
 // This gets the datatype of the parameters and parameter limits
 // This is a check for compatibility
 int scan::getParameterType(void)
-{return modbus.uint16FromRegister(0x04, 23);}
+{return uint16FromMap(inputReg::eParameterType);}
 
 // This returns the parameter type as a string
 String scan::parseParameterType(uint16_t code)
@@ -1104,13 +1359,100 @@ String scan::parseParameterType(uint16_t code)
 
 // This gets the scaling factor for all parameters which depend on eParameterType
 int scan::getParameterScale(void)
-{return modbus.uint16FromRegister(0x04, 24);}
+{return uint16FromMap(inputReg::uiParameterScale);}
 
 // This returns the spectral path length in mm
 // NB This is not documented - I'm guessing based on register values
 float scan::getPathLength(void)
 {
-    int path = modbus.uint16FromRegister(0x04, 520);
-    float pathmm = path/10;  // Convert to mm
+    int path = uint16FromMap(inputReg::uiPathLength);
+    float pathmm = path/10.0;  // Convert to mm
     return pathmm;
 }
+
+
+
+//----------------------------------------------------------------------------
+//                            PRIVATE FUNCTIONS
+//----------------------------------------------------------------------------
+
+// This prints all of the float values in block n of a register field as
+// delimeter separated data.  The number of values per modbus frame and the
+// first register of the block both come from the register map.
+void scan::printFloatBlock(const scanRegister &reg, int n, Stream *stream, const char *dlm)
+{
+    int totalValues = reg.count();
+    int startingReg = reg.at(n);
+
+    // Get the register data in several batches
+    float values[MAX_REGS_PER_FRAME/2];
+    int valuesRemaining;
+    int valuesThisCall;
+    for (int currentValueBeingRead = 0; currentValueBeingRead < totalValues;)
+    {
+        valuesRemaining = totalValues - currentValueBeingRead;
+        if (valuesRemaining < reg.valuesPerFrame()) valuesThisCall = valuesRemaining;
+        else valuesThisCall = reg.valuesPerFrame();
+        if (!modbus.getRegisters(reg.regType, startingReg + currentValueBeingRead*reg.width(),
+                                 valuesThisCall*reg.width())) break;
+        valuesThisCall = lastFrame().copyTo(values, valuesThisCall);
+        if (valuesThisCall == 0) break;
+        for (int valueInThisCall = 0; valueInThisCall < valuesThisCall; valueInThisCall++)
+        {
+            stream->print(values[valueInThisCall], 4);
+            if (currentValueBeingRead < totalValues-1) stream->print(dlm);
+            currentValueBeingRead++;
+        }
+    }
+    stream->println();
+}
+
+// This hands the float values in block n of a register field to a callback
+// function, starting at the given value.  Each value is decoded straight out
+// of the response frame, so nothing more than the modbus buffer is held in memory.
+bool scan::streamFloatBlock(const scanRegister &reg, int n, spectralCallback callback,
+                            void *context, float (*wavelengthOf)(int index),
+                            int firstValue, int numValues)
+{
+    int lastValue = reg.count();
+    if (numValues >= 0 && firstValue + numValues < lastValue) lastValue = firstValue + numValues;
+    int startingReg = reg.at(n);
+
+    // Get the register data in several batches
+    int valuesRemaining;
+    int valuesThisCall;
+    for (int currentValueBeingRead = firstValue; currentValueBeingRead < lastValue;)
+    {
+        valuesRemaining = lastValue - currentValueBeingRead;
+        if (valuesRemaining < reg.valuesPerFrame()) valuesThisCall = valuesRemaining;
+        else valuesThisCall = reg.valuesPerFrame();
+        if (!modbus.getRegisters(reg.regType, startingReg + currentValueBeingRead*reg.width(),
+                                 valuesThisCall*reg.width())) return false;
+        scanFrame frame = lastFrame();
+        if (!frame.contains(0, valuesThisCall*reg.width())) return false;
+        for (int valueInThisCall = 0; valueInThisCall < valuesThisCall; valueInThisCall++)
+        {
+            callback(currentValueBeingRead, wavelengthOf(currentValueBeingRead),
+                     frame.float32At(valueInThisCall*reg.width()), context);
+            currentValueBeingRead++;
+        }
+    }
+    return true;
+}
+
+// This makes sure the cached private configuration locations are valid
+// for the connected firmware, searching for them if they are not
+// After the first call, this does not need to talk to the device at all.
+bool scan::resolvePrivateConfig(void)
+{
+    if (!_privateConfigChecked)
+    {
+        // A finished search is remembered (even if it found nothing) until
+        // setPrivateConfigMap(); one the bus cut short is tried again on the
+        // next call
+        if (_privateConfig.swVersion != 0 && _privateConfig.swVersion == getSWVersion())
+            _privateConfigChecked = true;
+        else _privateConfigChecked = discoverPrivateConfig();
+    }
+    return _privateConfig.globalCalReg != 0;
+}
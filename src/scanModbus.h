@@ -12,6 +12,12 @@
 // Per modbus specs, this can be as high as 124, but my Arduino stumbles with that
 // many, so I've cut it down.
 
+#include "scanRegisterMap.h"  // The register addresses, generated from FullSpecModbusMap.xlsx
+#include "scanFrame.h"  // For decoding whole response frames
+
+#define PRIVATE_CONFIG_SEARCH_REGS 256  // How far past the private configuration
+// pointer to look for the start of the global calibration name
+
 
 //----------------------------------------------------------------------------
 //                        ENUMERATIONS FOR CONFIGURING DEVICE
@@ -41,6 +47,23 @@ typedef enum specParity
     odd
 } specParity;
 
+// This is a function in your sketch that (re)starts the serial port with
+// the given settings, ie, Serial1.begin(baud, SERIAL_8O1)
+// Only your sketch knows what serial port is used and how the board
+// expresses parity, so the library calls this rather than the port itself.
+typedef void (*scanSerialOpener)(uint32_t baud, specParity parity, byte stopBits);
+
+// How long to let the port and the device settle after a baud rate change
+// before checking that they can still talk (ms)
+#ifndef BAUD_SETTLE_TIME
+#define BAUD_SETTLE_TIME 100
+#endif
+
+// How many times to try to talk after a baud rate change before rolling back
+#ifndef BAUD_VERIFY_TRIES
+#define BAUD_VERIFY_TRIES 3
+#endif
+
 // The possible cleaning modes
 typedef enum cleaningMode
 {
@@ -62,6 +85,101 @@ typedef enum spectralSource
     other = 7  // I don't know what this is, but the modbus registers on the spec have 8 groups of fingerprints..
 } spectralSource;
 
+// This is like a spectralCallback, but for reading several spectral sources
+// at once, so it is also told which source each value is from.
+typedef void (*sweepCallback)(spectralSource source, int index, float wavelength,
+                              float value, void *context);
+
+class scanModbusTCP;  // For pipelined reads over Modbus TCP
+
+// The s::can device families, which differ in where some registers live
+// (ie, the global calibration is an input register on the ana::gate)
+// Build with SCAN_SPECTROLYSER_ONLY or SCAN_ANAGATE_ONLY defined (as a compiler
+// flag, so the library's own files see it too) to fix the model at compile
+// time and let the compiler drop the other model's code.
+#define ANAGATE_MODEL_CODE 0x0603  // The value of input register 2 for an ana::gate
+typedef enum scanModel
+{
+    modelUnknown = 0,
+    spectroLyser,
+    anaGate
+} scanModel;
+
+// The locations of fields within the private configuration, as found by
+// scan::discoverPrivateConfig().  These shift between firmware versions, so
+// they are tagged with the software version they were found on.  Save this
+// (ie, to EEPROM) and restore it with setPrivateConfigMap() to skip the search.
+typedef struct privateConfigMap
+{
+    float swVersion;  // Software version these were found on, 0 if never found
+    byte regType;  // The modbus command to read the private configuration
+    uint16_t globalCalReg;  // Start of the in-use global calibration name, 0 if not found
+    uint16_t nextGlobalCalReg;  // Start of the next stored global calibration name
+} privateConfigMap;
+
+// The largest number of parameters to keep in a snapshot
+// The spectro::lyser has room for 8 parameter setups in its holding registers.
+#ifndef MAX_PARAMETERS
+#define MAX_PARAMETERS 8
+#endif
+
+// All of the parameter results from a single measurement
+// Element 0 of each array is parameter 1.
+typedef struct parameterSnapshot
+{
+    uint32_t time;  // Measurement time as seconds from Jan 1, 1970
+    uint16_t deviceStatus;  // The device status bitmap
+    uint8_t count;  // The number of parameters in the snapshot
+    uint16_t status[MAX_PARAMETERS];  // The parameter status bitmaps
+    uint16_t specStatus[MAX_PARAMETERS];  // The sensor status bitmaps
+    float value[MAX_PARAMETERS];  // The calibrated values
+} parameterSnapshot;
+
+// This is a function that reads one frame of registers for
+// scan::readParameterSnapshot(), returning the whole response (slave ID,
+// function, byte count, data), or NULL if it couldn't be read.  The context
+// is whatever pointer was passed along with the function.
+typedef const byte *(*frameReader)(byte regType, uint16_t startRegister,
+                                   uint16_t numRegisters, void *context);
+
+// The wavelengths of the fingerprint values, in nm
+// There are 221 values from 200 to 750 nm, every 2.5 nm
+#define FIRST_WAVELENGTH 200.0
+#define WAVELENGTH_STEP 2.5
+// The number of fingerprint values, to size arrays of them with
+#define FINGERPRINT_VALUES (inputReg::fFingerprintData.count())
+
+// The wavelengths of the reference values, in nm
+// There are 256 values, evenly spaced from 186.3 to 732.7 nm
+#define REFERENCE_FIRST_WAVELENGTH 186.3
+#define REFERENCE_LAST_WAVELENGTH 732.7
+
+// A range of wavelengths to read from the fingerprint, in nm
+// Both ends are rounded to the nearest fingerprint value and included.
+typedef struct spectralWindow
+{
+    float startNm;
+    float endNm;
+} spectralWindow;
+
+// The most wavelength windows that can be read at once
+#ifndef MAX_SPECTRAL_WINDOWS
+#define MAX_SPECTRAL_WINDOWS 8
+#endif
+
+// Windows this many fingerprint values apart or closer are read in a single
+// request, since reading a few extra registers is quicker than starting a
+// new request.
+#ifndef SPECTRAL_WINDOW_GAP
+#define SPECTRAL_WINDOW_GAP 8
+#endif
+
+// This is a function in your sketch that is given spectral values one at a
+// time as they are decoded, rather than having to hold a whole spectrum in
+// memory.  The index counts from 0 at the first (200 nm) value, and the
+// context is whatever pointer was passed along with the function.
+typedef void (*spectralCallback)(int index, float wavelength, float value, void *context);
+
 // The possible spectral sources
 typedef enum detectorType
 {
@@ -69,6 +187,24 @@ typedef enum detectorType
     UVVis = 1
 } detectorType;
 
+// The settings a reference was taken with
+typedef struct referenceInfo
+{
+    char name[9];
+    float darkNoise;
+    int16_t avgK;
+    int16_t avgM;
+    int16_t flashRate;
+    int16_t lampVoltage;
+    detectorType detector;
+    int16_t repetitions;
+    bool lpFilter;
+    int16_t FUG;
+    int16_t type;
+    int16_t offset;
+    uint32_t time;  // When the reference was taken, as seconds from Jan 1, 1970
+} referenceInfo;
+
 
 //*****************************************************************************
 //*****************************************************************************
@@ -153,6 +289,18 @@ public:
     void printSpecStatus(uint16_t bitmask, Stream &stream);
     // This gets calibrated data value
     float getParameterValue(int parmNumber);
+    // This gets the time, device status, and the status and value of every
+    // parameter at once, reading as few modbus frames as possible (2 frames
+    // for 8 parameters, rather than 26 separate requests).
+    // Returns true if everything was read.
+    bool getParameterSnapshot(parameterSnapshot &snapshot);
+    // This does the same, but reads each frame with the given function, ie
+    // from a port and buffer of its own on another thread (see scanPoller)
+    static bool readParameterSnapshot(frameReader reader, void *context,
+                                      parameterSnapshot &snapshot);
+    // This gets the last measurement time and the device status in a single
+    // frame, for checking cheaply whether a new measurement has finished
+    bool getMeasurementState(uint32_t &parameterTime, uint16_t &deviceStatus);
 
     // Last measurement time as a 32-bit count of seconds from Jan 1, 1970
     uint32_t getFingerprintTime(spectralSource source=fingerprint);
@@ -160,18 +308,52 @@ public:
     detectorType getFingerprintDetectorType(spectralSource source=fingerprint);
     // This returns the spectral source type used for the fingerprint
     spectralSource getFingerprintSource(spectralSource source=fingerprint);
-    // This returns the spectral source type used for the fingerprint
+    // This returns the path length for the fingerprint, in tenths of a mm
     int getFingerprintPathLength(spectralSource source=fingerprint);
     // This returns the parameter status for the fingerprint
     // That is, pending me figuring out the right register for that data...
     uint16_t getFingerprintStatus(spectralSource source=fingerprint);
+    // This gets spectral values from the sensor and hands them one at a time
+    // to the callback function as each modbus frame arrives.  No more than one
+    // frame is ever held in memory, so this works on boards with 2kb of RAM.
+    // Returns true if every value was read.
+    bool getFingerprintData(spectralCallback callback, void *context=NULL,
+                            spectralSource source=fingerprint);
     // This gets spectral values from the sensor and puts them into a previously
     // initialized float array.  The array must have space for 221 values!
     // The actual return from the function is an integer which is a bit-mask
     // describing the fingerprint status (or, well, it would be if I could figure
-    // out which register that value lived in).
-    // NB:  This is too much for any real Arduino chip...
-    // int getFingerprintData(float fpArray[], spectralSource source=fingerprint);
+    // out which register that value lived in).  Returns -1 if the values
+    // couldn't all be read.
+    // NB:  This is too much for an AVR board; use the callback version there.
+    int getFingerprintData(float fpArray[], spectralSource source=fingerprint);
+    // This gets only the fingerprint values inside of the given wavelength
+    // windows, so narrow-band models don't have to wait for all 221 values.
+    // The callback is given the index and wavelength of each value as usual.
+    // Returns true if every value was read.
+    bool getFingerprintWindows(const spectralWindow windows[], int numWindows,
+                               spectralCallback callback, void *context=NULL,
+                               spectralSource source=fingerprint);
+    // This puts only the values inside of the windows into a previously
+    // initialized float array.  The array must have space for 221 values!
+    bool getFingerprintWindows(const spectralWindow windows[], int numWindows,
+                               float fpArray[], spectralSource source=fingerprint);
+    // This returns the wavelength in nm of the given fingerprint value
+    static float wavelength(int index){return FIRST_WAVELENGTH + WAVELENGTH_STEP*index;}
+    // This returns the index of the fingerprint value closest to a wavelength
+    static int wavelengthIndex(float nm);
+    // This gets the fingerprint data for every spectral source in the mask
+    // (bit n = source n) over Modbus TCP, with several requests waiting for
+    // replies at once.  The transport must be the one given to begin().
+    // The replies can come back in any order, so the values (even of one
+    // source) may arrive out of order; use the source and index given to
+    // the callback to put each one in place.  Returns true if every value
+    // was read.
+    bool getFingerprintSweep(scanModbusTCP &transport, sweepCallback callback,
+                             void *context=NULL, uint8_t sources=0xFF);
+    // This returns the wavelength in nm of the given reference value
+    static float referenceWavelength(int index)
+    {return REFERENCE_FIRST_WAVELENGTH + index*(REFERENCE_LAST_WAVELENGTH - REFERENCE_FIRST_WAVELENGTH)/255;}
     // This prints the fingerprint data as delimeter separated data.
     // By default, the delimeter is a TAB (\t, 0x09), as expected by the s::can/ana::xxx software.
     void printFingerprintData(Stream *stream, const char *dlm="    ",
@@ -205,6 +387,18 @@ public:
     bool setParity(specParity parity);
     String parseParity(uint16_t code);
 
+    // This moves the device to the fastest baud rate that it and the host
+    // both support (up to maxBaud), reopens the host port at that rate with
+    // the opener function, and checks that they can still talk.  If they
+    // can't, the host port goes back to the old rate; a device that can't
+    // be heard at either rate isn't sent anything more.  The parity and stop
+    // bits aren't changed, so each character stays the same length (10 bits
+    // for 8N1, 11 with a parity bit or a second stop bit).
+    // Returns true if the device ends up at the fastest rate (including if
+    // it already was).
+    bool negotiateFastestBaud(scanSerialOpener opener, uint32_t maxBaud = 38400,
+                              byte stopBits = 1);
+
     // Functions for the pointer to the private configuration register
     int getprivateConfigRegister(void);
     int getprivateConfigRegisterType(void);
@@ -213,6 +407,17 @@ public:
     // This reads the global calibration name from the private registers
     // NB This is NOT documented
     String getCurrentGlobalCal(void);
+    // This reads the name of the next global calibration stored on the device
+    String getNextGlobalCal(void);
+
+    // This looks for the global calibration names (at register 1081, or
+    // else after the private configuration pointer), reading full frames,
+    // and caches where they were found.
+    // This is done automatically the first time they are needed.
+    bool discoverPrivateConfig(void);
+    // These get and set the cached locations, so they can be persisted
+    privateConfigMap getPrivateConfigMap(void){return _privateConfig;}
+    void setPrivateConfigMap(const privateConfigMap &configMap);
 
     // Functions for the "s::canpoint" (ie, current installation site) of the device
     String getScanPoint(void);
@@ -363,10 +568,18 @@ public:
     // This returns the Unix timestamp when the reference was recorded
     uint32_t getReferenceTime(int refNumber);
 
+    // This gets all of the settings a reference was taken with at once,
+    // in a single modbus frame
+    bool getReferenceInfo(int refNumber, referenceInfo &info);
+
     // This gets abssorbance values in Abs/m for the reference and puts them
     // into a previously initialized float array.  The array must have space
-    // for 256 values! - This is too much for any real Arduino chip...
-    // void getReferenceValues(float refArray[], int refNumber);
+    // for 256 values! - This is too much for an AVR board...
+    bool getReferenceValues(float refArray[], int refNumber);
+
+    // This gets abssorbance values in Abs/m for the reference and hands them
+    // one at a time to the callback function, as above
+    bool getReferenceData(int refNumber, spectralCallback callback, void *context=NULL);
 
     // This prints the reference data as delimeter separated data.
     // By default, the delimeter is a TAB (\t, 0x09).
@@ -384,8 +597,14 @@ public:
     float getModbusVersion(void);
 
     // This returns a byte with the model type
+    // The model is read once and cached; later calls cost no modbus traffic
     uint16_t getModelType(void);
 
+    // This returns the device family, detected from the model type
+    scanModel getScanModel(void);
+    bool isSpectroLyser(void);
+    bool isAnaGate(void);
+
     // This returns a pretty string with the model information
     String getModel(void);
 
@@ -423,6 +642,10 @@ public:
 //                       PURELY DEBUGGING FUNCTIONS
 //----------------------------------------------------------------------------
 
+    // This returns a view of the last response frame received
+    // NB:  This is only valid until the next modbus command is sent!
+    scanFrame lastFrame(void){return scanFrame(modbus);}
+
     // This sets a stream for debugging information to go to;
     void setDebugStream(Stream *stream){modbus.setDebugStream(stream);}
 
@@ -437,6 +660,48 @@ public:
 
     modbusMaster modbus;
     byte _slaveID;
+    uint16_t _modelType;  // Cached model type, 0 until successfully read
+    privateConfigMap _privateConfig;  // Cached private configuration locations
+    bool _privateConfigChecked;  // True once _privateConfig is known to match the firmware
+
+private:
+    // These read a single value described by the register map, from block
+    // number n (ie, parameter n or spectral source n)
+    uint16_t uint16FromMap(const scanRegister &reg, int n = 0)
+    {return modbus.uint16FromRegister(reg.regType, reg.at(n), bigEndian);}
+    int16_t int16FromMap(const scanRegister &reg, int n = 0)
+    {return modbus.int16FromRegister(reg.regType, reg.at(n), bigEndian);}
+    float float32FromMap(const scanRegister &reg, int n = 0, int value = 0)
+    {return modbus.float32FromRegister(reg.regType, reg.at(n) + value*2, bigEndian);}
+    uint32_t TAI64NFromMap(const scanRegister &reg, int n = 0)
+    {
+        uint32_t nanoseconds;
+        return modbus.TAI64NFromRegister(reg.regType, reg.at(n), nanoseconds);
+    }
+    String StringFromMap(const scanRegister &reg, int n = 0)
+    {return modbus.StringFromRegister(reg.regType, reg.at(n), reg.chars());}
+
+    // This prints all of the float values in block n of a register field as
+    // delimeter separated data, reading as many values as fit in each frame
+    void printFloatBlock(const scanRegister &reg, int n, Stream *stream, const char *dlm);
+
+    // This hands the float values in block n of a register field to a
+    // callback function, one frame at a time, starting at the given value
+    bool streamFloatBlock(const scanRegister &reg, int n, spectralCallback callback,
+                          void *context, float (*wavelengthOf)(int index),
+                          int firstValue = 0, int numValues = -1);
+
+    // This makes sure the cached private configuration locations are valid
+    // for the connected firmware, searching for them if they are not
+    bool resolvePrivateConfig(void);
+
+    // This checks that the device answers, after a change of serial settings
+    bool verifyCommunication(void);
+
+    // This is the frame reader for getParameterSnapshot(), using this
+    // object's own modbus connection
+    static const byte *readOwnFrame(byte regType, uint16_t startRegister,
+                                    uint16_t numRegisters, void *context);
 };
 
 #endif
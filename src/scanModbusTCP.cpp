@@ -0,0 +1,238 @@
+/*
+ *scanModbusTCP.cpp
+*/
+
+#include "scanModbusTCP.h"
+#include "scanRTU.h"  // For the CRC and building requests
+
+// Where the RTU frame starts in an MBAP frame:  the RTU address is the unit ID
+#define RTU_START (MBAP_HEADER_LENGTH - 1)
+
+
+//----------------------------------------------------------------------------
+//                         MODBUS TCP TRANSPORT
+//----------------------------------------------------------------------------
+
+scanModbusTCP::scanModbusTCP(Client *client)
+{
+    _client = client;
+    _nextID = 1;
+    _pendingID = 0;
+    _requestCount = 0;
+    _txLength = 0;
+    _rxLength = 0;
+    _replyPosition = 0;
+    _replyEnd = 0;
+}
+scanModbusTCP::scanModbusTCP(Client &client) : scanModbusTCP(&client) {}
+
+// This connects to the device (or ana::gate controller)
+bool scanModbusTCP::connect(const char *host, uint16_t port)
+{
+    _txLength = 0;
+    _rxLength = 0;
+    _replyEnd = 0;
+    return _client->connect(host, port) == 1;
+}
+
+bool scanModbusTCP::connected(void) {return _client->connected();}
+
+void scanModbusTCP::stop(void) {_client->stop();}
+
+// This returns the length of an RTU request from its first bytes
+// Reads and single writes are always 8 bytes; multiple writes say how many
+// data bytes follow.
+int scanModbusTCP::rtuRequestLength(void)
+{
+    byte *rtu = _tx + RTU_START;
+    if (_txLength < 2) return 0;
+    if (rtu[1] <= 0x06) return 8;
+    if (rtu[1] == 0x0F || rtu[1] == 0x10)
+    {
+        if (_txLength < 7) return 0;
+        return 9 + rtu[6];
+    }
+    return 0;  // Something else; it will be sent on flush()
+}
+
+// This sends the RTU request in the transmit buffer as an MBAP frame
+// The CRC is left off; TCP has its own checks.
+bool scanModbusTCP::sendRequest(int rtuLength)
+{
+    uint16_t length = rtuLength - 2;  // Unit ID + PDU
+    _pendingID = _nextID++;
+    if (_nextID == 0) _nextID = 1;
+    _tx[0] = _pendingID >> 8;
+    _tx[1] = _pendingID & 0xFF;
+    _tx[2] = 0;  // Protocol ID is always 0 for modbus
+    _tx[3] = 0;
+    _tx[4] = length >> 8;
+    _tx[5] = length & 0xFF;
+    _requestCount++;
+    int frameLength = RTU_START + length;
+    return _client->write(_tx, frameLength) == (size_t)frameLength;
+}
+
+// This reads whatever has arrived of the next MBAP frame
+// It only ever reads up to the end of the current frame, so the next one
+// stays in the client's buffer.
+bool scanModbusTCP::receive(void)
+{
+    while (_client->available() > 0)
+    {
+        int wanted;
+        if (_rxLength < RTU_START) wanted = RTU_START - _rxLength;
+        else
+        {
+            int frameLength = RTU_START + (((uint16_t)_rx[4] << 8) | _rx[5]);
+            if (frameLength + 2 > SCAN_TCP_BUFFER_SIZE || _rx[2] != 0 || _rx[3] != 0)
+            {
+                // Not something we can make sense of, so start over
+                _client->stop();
+                _rxLength = 0;
+                return false;
+            }
+            wanted = frameLength - _rxLength;
+            if (wanted <= 0) return true;
+        }
+        int got = _client->read(_rx + _rxLength, wanted);
+        if (got <= 0) break;
+        _rxLength += got;
+    }
+    if (_rxLength < RTU_START) return false;
+    return _rxLength >= RTU_START + (((uint16_t)_rx[4] << 8) | _rx[5]);
+}
+
+// These are the Stream functions used by the modbus library
+// A reply is only handed back once all of it has arrived, with an RTU CRC
+// added to the end; replies to anything but the last request are dropped.
+int scanModbusTCP::available(void)
+{
+    if (_replyEnd == 0)
+    {
+        if (!receive()) return 0;
+        if (receivedID() != _pendingID)
+        {
+            _rxLength = 0;
+            return 0;
+        }
+        _replyEnd = scanRTU::appendCRC(_rx + RTU_START, _rxLength - RTU_START) + RTU_START;
+        _replyPosition = RTU_START;
+        _rxLength = 0;
+    }
+    return _replyEnd - _replyPosition;
+}
+
+int scanModbusTCP::read(void)
+{
+    if (available() <= 0) return -1;
+    int c = _rx[_replyPosition++];
+    if (_replyPosition >= _replyEnd) _replyEnd = 0;
+    return c;
+}
+
+int scanModbusTCP::peek(void)
+{
+    if (available() <= 0) return -1;
+    return _rx[_replyPosition];
+}
+
+// Writing a new request throws away anything left of the last reply
+// Each request is sent as soon as all of it has been written.
+size_t scanModbusTCP::write(const uint8_t *buffer, size_t size)
+{
+    _replyEnd = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (RTU_START + _txLength >= SCAN_TCP_BUFFER_SIZE) _txLength = 0;  // Too long
+        _tx[RTU_START + _txLength++] = buffer[i];
+        int length = rtuRequestLength();
+        if (length > 0 && _txLength >= length)
+        {
+            sendRequest(length);
+            _txLength = 0;
+        }
+    }
+    return size;
+}
+
+// This sends anything written that didn't look like a whole request yet
+void scanModbusTCP::flush(void)
+{
+    if (_txLength >= 4) sendRequest(_txLength);
+    _txLength = 0;
+    _client->flush();
+}
+
+// This sends a batch of reads, with up to maxOutstanding of them waiting
+// for replies at once
+// A new request goes out as soon as a reply comes back, so the connection
+// is never idle while there is more to read.
+bool scanModbusTCP::readPipelined(const scanTCPRead requests[], int count,
+                                  scanTCPCallback callback, void *context,
+                                  uint8_t maxOutstanding)
+{
+    if (maxOutstanding > SCAN_TCP_MAX_OUTSTANDING) maxOutstanding = SCAN_TCP_MAX_OUTSTANDING;
+    if (maxOutstanding < 1) maxOutstanding = 1;
+    uint16_t waitingID[SCAN_TCP_MAX_OUTSTANDING];
+    int waitingRequest[SCAN_TCP_MAX_OUTSTANDING];
+    int outstanding = 0;
+    int nextToSend = 0;
+    int done = 0;
+    _txLength = 0;
+    _replyEnd = 0;
+
+    while (done < count)
+    {
+        // Fill up the pipeline
+        while (outstanding < maxOutstanding && nextToSend < count)
+        {
+            const scanTCPRead &request = requests[nextToSend];
+            int length = scanRTU::buildReadRequest(_tx + RTU_START, request.unitID,
+                                                   request.regType, request.startRegister,
+                                                   request.numRegisters);
+            if (!sendRequest(length)) return false;
+            waitingID[outstanding] = _pendingID;
+            waitingRequest[outstanding] = nextToSend;
+            outstanding++;
+            nextToSend++;
+        }
+        _client->flush();
+
+        // Wait for any one of the replies
+        uint32_t start = millis();
+        while (!receive())
+        {
+            if (millis() - start > _timeout || !_client->connected()) return false;
+        }
+
+        int slot = 0;
+        while (slot < outstanding && waitingID[slot] != receivedID()) slot++;
+        if (slot == outstanding)
+        {
+            _rxLength = 0;  // A late reply to something else
+            continue;
+        }
+
+        // Check that it's a whole answer to the right question
+        const scanTCPRead &request = requests[waitingRequest[slot]];
+        scanFrame frame(_rx + RTU_START);
+        bool good = _rx[RTU_START] == request.unitID &&
+                    _rx[RTU_START + 1] == request.regType &&
+                    _rx[RTU_START + 2] == 2*request.numRegisters &&
+                    _rxLength >= RTU_START + 3 + 2*request.numRegisters;
+        if (!good)
+        {
+            _rxLength = 0;
+            return false;
+        }
+        callback(waitingRequest[slot], frame, context);
+        _rxLength = 0;
+
+        outstanding--;
+        waitingID[slot] = waitingID[outstanding];
+        waitingRequest[slot] = waitingRequest[outstanding];
+        done++;
+    }
+    return true;
+}
@@ -0,0 +1,114 @@
+/*
+ *scanModbusTCP.h
+*/
+
+#ifndef scanModbusTCP_h
+#define scanModbusTCP_h
+
+#include <Arduino.h>
+#include <Client.h>  // For the network connection
+#include "scanFrame.h"
+#include "scanRegisterMap.h"  // For MAX_REGS_PER_FRAME
+
+#define MODBUS_TCP_PORT 502
+#define MBAP_HEADER_LENGTH 7  // Transaction ID, protocol ID, length, unit ID
+
+// The most requests to have waiting for a reply at once
+#ifndef SCAN_TCP_MAX_OUTSTANDING
+#define SCAN_TCP_MAX_OUTSTANDING 4
+#endif
+
+// Room for a header and the largest request or reply, plus an RTU CRC
+#define SCAN_TCP_BUFFER_SIZE (MBAP_HEADER_LENGTH + 8 + 2*MAX_REGS_PER_FRAME + 2)
+
+// One read request in a pipelined batch
+typedef struct scanTCPRead
+{
+    byte unitID;  // The modbus address of the device
+    byte regType;  // The modbus read command (0x03 = holding, 0x04 = input)
+    uint16_t startRegister;
+    uint16_t numRegisters;
+} scanTCPRead;
+
+// This is a function in your sketch that is given each reply of a
+// pipelined batch as it arrives, with the number of the request it
+// answers.  The frame is only valid until the function returns.
+typedef void (*scanTCPCallback)(int request, const scanFrame &frame, void *context);
+
+
+//----------------------------------------------------------------------------
+//                         MODBUS TCP TRANSPORT
+//----------------------------------------------------------------------------
+// This lets the library talk Modbus TCP through any Arduino network Client
+// (EthernetClient, WiFiClient, ...).  It is a Stream, so it can be given to
+// scan::begin() in place of a serial port:  the RTU requests written to it
+// are sent as MBAP frames, and the MBAP replies are handed back as RTU
+// frames (with a CRC) so every existing function works unchanged.
+//
+// Unlike a serial line, TCP can carry several requests at once, so
+// readPipelined() sends a whole batch of reads with up to
+// SCAN_TCP_MAX_OUTSTANDING waiting for replies at a time, matching the
+// replies to the requests by their transaction ID.
+class scanModbusTCP : public Stream
+{
+
+public:
+    scanModbusTCP(Client *client);
+    scanModbusTCP(Client &client);
+
+    // This connects to the device (or ana::gate controller)
+    bool connect(const char *host, uint16_t port = MODBUS_TCP_PORT);
+    bool connected(void);
+    void stop(void);
+
+    // This sends a batch of reads, with up to maxOutstanding of them waiting
+    // for replies at once, and hands each reply to the callback as it
+    // arrives.  Replies may come back in any order.  Returns false on an
+    // exception reply, a timeout (the Stream timeout), or a lost connection.
+    bool readPipelined(const scanTCPRead requests[], int count,
+                       scanTCPCallback callback, void *context = NULL,
+                       uint8_t maxOutstanding = SCAN_TCP_MAX_OUTSTANDING);
+
+    // This returns the number of requests sent
+    uint32_t getRequestCount(void) {return _requestCount;}
+
+    // These are the Stream functions used by the modbus library
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush(void);
+
+private:
+    // This sends the RTU request in the transmit buffer as an MBAP frame
+    // The RTU request starts at _tx + 6, so the header goes in front of it
+    // and the unit ID is the RTU address.
+    bool sendRequest(int rtuLength);
+
+    // This reads whatever has arrived of the next MBAP frame
+    // Returns true once there is a whole frame in the receive buffer.
+    bool receive(void);
+
+    // This returns the transaction ID of the frame in the receive buffer
+    uint16_t receivedID(void) {return ((uint16_t)_rx[0] << 8) | _rx[1];}
+
+    // This returns the length of an RTU request from its first bytes, or 0
+    // if that can't be known yet
+    int rtuRequestLength(void);
+
+    Client *_client;
+    uint16_t _nextID;
+    uint16_t _pendingID;
+    uint32_t _requestCount;
+
+    byte _tx[SCAN_TCP_BUFFER_SIZE];
+    int _txLength;  // The number of RTU bytes written so far
+    byte _rx[SCAN_TCP_BUFFER_SIZE];
+    int _rxLength;  // The number of MBAP bytes received so far
+    int _replyPosition;  // The next RTU byte of a finished reply to read
+    int _replyEnd;  // The end of a finished reply (0 if there isn't one)
+};
+
+#endif
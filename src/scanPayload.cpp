@@ -0,0 +1,218 @@
+/*
+ *scanPayload.cpp
+*/
+
+#include "scanPayload.h"
+
+// Values this many steps or more from the lower limit are sent as floats
+#define PAYLOAD_MAX_STEPS 1073741824.0  // 2^30
+
+// The codes for values that aren't sent as a number of steps
+#define PAYLOAD_NAN 0
+#define PAYLOAD_RAW_FLOAT 1
+#define PAYLOAD_FIRST_STEP 2
+
+
+//----------------------------------------------------------------------------
+//                  COMPACT BINARY PAYLOADS FOR SENDING ON
+//----------------------------------------------------------------------------
+
+// Until told otherwise, every value is kept to 3 decimal places (the same
+// as the ana::pro rows) above 0
+scanPayload::scanPayload(void)
+{
+    for (int i = 0; i < MAX_PARAMETERS; i++)
+    {
+        _scales[i].precision = 3;
+        _scales[i].lowerLimit = 0;
+    }
+    _fullTime = 0;
+    _fullTimeNumber = 0;
+    _sinceFullTime = PAYLOAD_FULL_TIME_INTERVAL;
+}
+
+// This gets the precision and lower limit of every parameter
+bool scanPayload::begin(scan &spectro)
+{
+    int parmCount = spectro.getParameterCount();
+    if (parmCount < 0) return false;
+    if (parmCount > MAX_PARAMETERS) parmCount = MAX_PARAMETERS;
+    for (int i = 1; i <= parmCount; i++)
+        setScale(i, spectro.getParameterPrecision(i), spectro.getParameterLowerLimit(i));
+    reset();
+    return true;
+}
+
+void scanPayload::setScale(int parmNumber, uint8_t precision, float lowerLimit)
+{
+    if (parmNumber < 1 || parmNumber > MAX_PARAMETERS) return;
+    if (precision > PAYLOAD_MAX_PRECISION) precision = PAYLOAD_MAX_PRECISION;
+    if (isnan(lowerLimit) || isinf(lowerLimit)) lowerLimit = 0;
+    _scales[parmNumber - 1].precision = precision;
+    _scales[parmNumber - 1].lowerLimit = lowerLimit;
+}
+
+float scanPayload::stepsPerUnit(int parm)
+{
+    float steps = 1;
+    for (int i = 0; i < _scales[parm].precision; i++) steps *= 10;
+    return steps;
+}
+
+// This writes an unsigned LEB128 varint; returns its length (1-5 bytes)
+int scanPayload::putVarint(byte *buffer, uint32_t value)
+{
+    int length = 0;
+    while (value >= 0x80)
+    {
+        buffer[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buffer[length++] = value;
+    return length;
+}
+
+// This reads an unsigned LEB128 varint; returns its length, or 0 if it runs
+// off the end of the buffer
+int scanPayload::getVarint(const byte *buffer, int length, uint32_t &value)
+{
+    value = 0;
+    for (int i = 0; i < length && i < 5; i++)
+    {
+        value |= (uint32_t)(buffer[i] & 0x7F) << (7*i);
+        if (!(buffer[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+
+// This packs a snapshot into the buffer
+int scanPayloadEncoder::encode(const parameterSnapshot &snapshot, byte *buffer, int size)
+{
+    // Work out the longest this could be before writing anything
+    int count = snapshot.count;
+    if (count > MAX_PARAMETERS) count = MAX_PARAMETERS;
+    if (size < 1 + 1 + 5 + 3 + 1 + count*(3 + 3 + 5)) return 0;
+
+    byte flags = PAYLOAD_VERSION << 5;
+    bool fullTime = _sinceFullTime >= PAYLOAD_FULL_TIME_INTERVAL || _fullTime == 0;
+    if (fullTime) flags |= PAYLOAD_FULL_TIME;
+    for (int i = 0; i < count; i++)
+    {
+        if (snapshot.status[i] != 0) flags |= PAYLOAD_STATUS;
+        if (snapshot.specStatus[i] != 0) flags |= PAYLOAD_SPEC_STATUS;
+    }
+
+    if (fullTime)
+    {
+        _fullTime = snapshot.time;
+        _fullTimeNumber++;
+    }
+
+    int length = 0;
+    buffer[length++] = flags;
+    buffer[length++] = _fullTimeNumber;
+    if (fullTime) length += putVarint(buffer + length, snapshot.time);
+    else length += putVarint(buffer + length, zigzag((int32_t)(snapshot.time - _fullTime)));
+    length += putVarint(buffer + length, snapshot.deviceStatus);
+    buffer[length++] = count;
+    if (flags & PAYLOAD_STATUS)
+        for (int i = 0; i < count; i++) length += putVarint(buffer + length, snapshot.status[i]);
+    if (flags & PAYLOAD_SPEC_STATUS)
+        for (int i = 0; i < count; i++) length += putVarint(buffer + length, snapshot.specStatus[i]);
+
+    for (int i = 0; i < count; i++)
+    {
+        float value = snapshot.value[i];
+        float steps = (value - _scales[i].lowerLimit)*stepsPerUnit(i);
+        if (isnan(value)) buffer[length++] = PAYLOAD_NAN;
+        else if (steps > -PAYLOAD_MAX_STEPS && steps < PAYLOAD_MAX_STEPS)
+        {
+            int32_t rounded = lround(steps);
+            length += putVarint(buffer + length, zigzag(rounded) + PAYLOAD_FIRST_STEP);
+        }
+        else
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, 4);
+            buffer[length++] = PAYLOAD_RAW_FLOAT;
+            for (int b = 0; b < 4; b++) buffer[length++] = bits >> (8*b);
+        }
+    }
+
+    _sinceFullTime = fullTime ? 1 : _sinceFullTime + 1;
+    return length;
+}
+
+
+// This unpacks a payload into a snapshot
+bool scanPayloadDecoder::decode(const byte *buffer, int length, parameterSnapshot &snapshot)
+{
+    if (length < 2 || (buffer[0] >> 5) != PAYLOAD_VERSION) return false;
+    byte flags = buffer[0];
+    byte timeNumber = buffer[1];
+    int position = 2;
+    int n;
+    uint32_t number;
+
+    if ((n = getVarint(buffer + position, length - position, number)) == 0) return false;
+    position += n;
+    if (flags & PAYLOAD_FULL_TIME) snapshot.time = number;
+    // We don't know what it's a change from
+    else if (_fullTime == 0 || timeNumber != _fullTimeNumber) return false;
+    else snapshot.time = _fullTime + unzigzag(number);
+
+    if ((n = getVarint(buffer + position, length - position, number)) == 0) return false;
+    position += n;
+    snapshot.deviceStatus = number;
+
+    if (position >= length || buffer[position] > MAX_PARAMETERS) return false;
+    snapshot.count = buffer[position++];
+
+    for (int i = 0; i < snapshot.count; i++)
+    {
+        snapshot.status[i] = 0;
+        snapshot.specStatus[i] = 0;
+    }
+    if (flags & PAYLOAD_STATUS)
+        for (int i = 0; i < snapshot.count; i++)
+        {
+            if ((n = getVarint(buffer + position, length - position, number)) == 0) return false;
+            position += n;
+            snapshot.status[i] = number;
+        }
+    if (flags & PAYLOAD_SPEC_STATUS)
+        for (int i = 0; i < snapshot.count; i++)
+        {
+            if ((n = getVarint(buffer + position, length - position, number)) == 0) return false;
+            position += n;
+            snapshot.specStatus[i] = number;
+        }
+
+    for (int i = 0; i < snapshot.count; i++)
+    {
+        if ((n = getVarint(buffer + position, length - position, number)) == 0) return false;
+        position += n;
+        if (number == PAYLOAD_NAN) snapshot.value[i] = NAN;
+        else if (number == PAYLOAD_RAW_FLOAT)
+        {
+            if (position + 4 > length) return false;
+            uint32_t bits = 0;
+            for (int b = 0; b < 4; b++) bits |= (uint32_t)buffer[position++] << (8*b);
+            memcpy(&snapshot.value[i], &bits, 4);
+        }
+        else
+        {
+            int32_t steps = unzigzag(number - PAYLOAD_FIRST_STEP);
+            snapshot.value[i] = _scales[i].lowerLimit + steps/stepsPerUnit(i);
+        }
+    }
+
+    if (position != length) return false;
+    if (flags & PAYLOAD_FULL_TIME)
+    {
+        _fullTime = snapshot.time;
+        _fullTimeNumber = timeNumber;
+    }
+    return true;
+}
@@ -0,0 +1,124 @@
+/*
+ *scanPayload.h
+*/
+
+#ifndef scanPayload_h
+#define scanPayload_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For the parameter snapshot
+
+#define PAYLOAD_VERSION 2
+
+// The longest payload:  flags, timestamp number, time, device status, and
+// count, then the status, sensor status, and value of every parameter
+#define PAYLOAD_MAX_LENGTH (1 + 1 + 5 + 3 + 1 + MAX_PARAMETERS*(3 + 3 + 5))
+
+// How often to send the whole timestamp instead of the change since the
+// last whole one; the changes get longer as they grow
+#ifndef PAYLOAD_FULL_TIME_INTERVAL
+#define PAYLOAD_FULL_TIME_INTERVAL 24
+#endif
+
+// The most decimal places a value is kept to
+#define PAYLOAD_MAX_PRECISION 6
+
+// The bits of the flags byte; the top 3 bits are the version
+#define PAYLOAD_FULL_TIME 0x01  // The time is the whole timestamp
+#define PAYLOAD_STATUS 0x02  // The parameter status bitmaps are included
+#define PAYLOAD_SPEC_STATUS 0x04  // The sensor status bitmaps are included
+
+// How each parameter's value is packed:  as a whole number of steps of
+// 10^-precision above the lower limit
+typedef struct payloadScale
+{
+    uint8_t precision;  // Decimal places
+    float lowerLimit;
+} payloadScale;
+
+
+//----------------------------------------------------------------------------
+//                  COMPACT BINARY PAYLOADS FOR SENDING ON
+//----------------------------------------------------------------------------
+// A payload packs a parameter snapshot into about 10-25 bytes (11-15 for
+// three parameters with no status bits set), instead of the 100+ of an
+// ana::pro text row:
+//    flags (1 byte)
+//    timestamp number (1 byte):  counts up by 1 with each whole timestamp
+//    time:  the whole timestamp, or the signed change since the whole
+//        timestamp with the same number
+//    device status
+//    number of parameters (1 byte)
+//    parameter status bitmaps (only if any isn't 0)
+//    sensor status bitmaps (only if any isn't 0)
+//    parameter values
+// Numbers are LEB128 varints (7 bits per byte, low bits first, high bit set
+// on all but the last byte); signed ones are zigzag coded first (0, -1, 1,
+// -2, ... become 0, 1, 2, 3, ...).  Each value is rounded to the parameter's
+// precision and sent as the zigzag coded number of steps above the lower
+// limit, plus 2.  A 0 means the value was NaN, and a 1 means the value
+// didn't fit and the float itself follows, low byte first.
+//
+// Because every change in time is from a whole timestamp rather than from
+// the payload before, a lost payload doesn't throw off the ones after it;
+// if the whole timestamp itself is lost, the timestamp number tells the
+// decoder so, and the payloads up to the next one are refused rather than
+// given the wrong time.
+//
+// The encoder and decoder must be given the same scales, either from the
+// device with begin() or with setScale().
+class scanPayload
+{
+
+public:
+    scanPayload(void);
+
+    // This gets the precision and lower limit of every parameter
+    bool begin(scan &spectro);
+
+    // This sets how one parameter (numbered from 1) is packed
+    void setScale(int parmNumber, uint8_t precision, float lowerLimit);
+
+    // This makes the next payload carry the whole timestamp, ie, after the
+    // last one failed to send or on starting up
+    void reset(void) {_sinceFullTime = PAYLOAD_FULL_TIME_INTERVAL;}
+
+protected:
+    static int putVarint(byte *buffer, uint32_t value);
+    static int getVarint(const byte *buffer, int length, uint32_t &value);
+    static uint32_t zigzag(int32_t value) {return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);}
+    static int32_t unzigzag(uint32_t value) {return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);}
+
+    // This returns 10^precision
+    float stepsPerUnit(int parm);
+
+    payloadScale _scales[MAX_PARAMETERS];
+    uint32_t _fullTime;  // The last whole timestamp
+    uint8_t _fullTimeNumber;  // And its number
+    uint8_t _sinceFullTime;  // The number of payloads since the last whole timestamp
+};
+
+
+// This packs snapshots on the logger
+class scanPayloadEncoder : public scanPayload
+{
+
+public:
+    // This packs a snapshot into the buffer
+    // Returns the length of the payload, or 0 if the buffer is too small.
+    int encode(const parameterSnapshot &snapshot, byte *buffer, int size);
+};
+
+
+// This unpacks them again wherever they're received
+class scanPayloadDecoder : public scanPayload
+{
+
+public:
+    // This unpacks a payload into a snapshot
+    // Returns false if the payload is damaged, is from another version, or
+    // only has the change in time and its whole timestamp wasn't received.
+    bool decode(const byte *buffer, int length, parameterSnapshot &snapshot);
+};
+
+#endif
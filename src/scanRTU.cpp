@@ -0,0 +1,67 @@
+/*
+ *scanRTU.cpp
+*/
+
+#include "scanRTU.h"
+
+
+//----------------------------------------------------------------------------
+//                  HELPERS FOR BUILDING AND CHECKING RAW RTU FRAMES
+//----------------------------------------------------------------------------
+
+// This calculates the modbus CRC16 of a frame
+// The polynomial is 0xA001 (0x8005 reflected) and the seed is 0xFFFF
+uint16_t scanRTU::crc16(const byte *frame, int length, uint16_t crc)
+{
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= frame[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (crc & 0x0001) crc = (crc >> 1) ^ 0xA001;
+            else crc >>= 1;
+        }
+    }
+    return crc;
+}
+
+// This checks that the last two bytes of a frame are its correct CRC
+bool scanRTU::checkCRC(const byte *frame, int length)
+{
+    if (length < 3) return false;
+    uint16_t crc = crc16(frame, length - 2);
+    return frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8);
+}
+
+// This appends the CRC to a frame
+int scanRTU::appendCRC(byte *frame, int length)
+{
+    uint16_t crc = crc16(frame, length);
+    frame[length] = crc & 0xFF;
+    frame[length + 1] = crc >> 8;
+    return length + 2;
+}
+
+// This builds a request to read registers
+int scanRTU::buildReadRequest(byte *frame, byte slaveID, byte regType,
+                              uint16_t startRegister, uint16_t numRegisters)
+{
+    frame[0] = slaveID;
+    frame[1] = regType;
+    frame[2] = startRegister >> 8;
+    frame[3] = startRegister & 0xFF;
+    frame[4] = numRegisters >> 8;
+    frame[5] = numRegisters & 0xFF;
+    return appendCRC(frame, 6);
+}
+
+// This returns the time in microseconds to send one 11-bit character
+uint32_t scanRTU::charTimeMicros(uint32_t baud)
+{return (11000000UL + baud - 1)/baud;}
+
+// This returns the silent interval that marks the end of an RTU frame
+uint32_t scanRTU::frameGapMicros(uint32_t baud)
+{
+    if (baud > 19200) return 1750;
+    return (charTimeMicros(baud)*7 + 1)/2;
+}
@@ -0,0 +1,48 @@
+/*
+ *scanRTU.h
+*/
+
+#ifndef scanRTU_h
+#define scanRTU_h
+
+#include <Arduino.h>
+
+
+//----------------------------------------------------------------------------
+//                  HELPERS FOR BUILDING AND CHECKING RAW RTU FRAMES
+//----------------------------------------------------------------------------
+// These are for the few places that talk to the bus without going through
+// modbusMaster (ie, searching for a device or watching someone else's traffic)
+class scanRTU
+{
+
+public:
+
+    // This calculates the modbus CRC16 of a frame
+    // The CRC is sent low byte first.  To work out the CRC of something in
+    // pieces, pass the CRC of the pieces so far as the starting value.
+    static uint16_t crc16(const byte *frame, int length, uint16_t crc = 0xFFFF);
+
+    // This checks that the last two bytes of a frame are its correct CRC
+    static bool checkCRC(const byte *frame, int length);
+
+    // This appends the CRC to a frame, which must have room for two more bytes
+    // Returns the new length of the frame
+    static int appendCRC(byte *frame, int length);
+
+    // This builds a request to read registers, including the CRC, into
+    // a buffer of at least 8 bytes.  Returns the length of the request.
+    static int buildReadRequest(byte *frame, byte slaveID, byte regType,
+                                uint16_t startRegister, uint16_t numRegisters);
+
+    // This returns the time in microseconds to send one character at the
+    // given baud rate (11 bits, ie, start + 8 data + parity/stop + stop)
+    static uint32_t charTimeMicros(uint32_t baud);
+
+    // This returns the silent interval that marks the end of an RTU frame
+    // Per the modbus spec, this is 3.5 characters, but never less than
+    // 1750 microseconds above 19200 baud.
+    static uint32_t frameGapMicros(uint32_t baud);
+};
+
+#endif
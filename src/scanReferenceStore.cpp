@@ -0,0 +1,126 @@
+/*
+ *scanReferenceStore.cpp
+*/
+
+#include "scanReferenceStore.h"
+
+
+//----------------------------------------------------------------------------
+//         FUNCTIONS TO KEEP AND COMPARE COPIES OF THE STORED REFERENCES
+//----------------------------------------------------------------------------
+
+scanReferenceStore::scanReferenceStore(scan *scanMB)
+{
+    _scanMB = scanMB;
+    _active = -1;
+    _downloaded = false;
+    _updates = 0;
+    for (int i = 0; i < MAX_STORED_REFERENCES; i++)
+    {
+        _refNumbers[i] = -1;
+        _updatedAt[i] = 0;
+    }
+}
+
+// This makes sure the stored copy of a reference is current
+bool scanReferenceStore::update(int refNumber)
+{
+    _downloaded = false;
+    referenceInfo info;
+    if (!_scanMB->getReferenceInfo(refNumber, info)) return false;
+
+    // If there's a copy with the same time, it's still good
+    int slot = findSlot(refNumber);
+    if (slot >= 0 && _info[slot].time == info.time)
+    {
+        _info[slot] = info;
+        _updatedAt[slot] = ++_updates;
+        return true;
+    }
+
+    // Otherwise, find somewhere to put it: an empty slot if there is one,
+    // else the copy that was updated longest ago
+    if (slot < 0)
+    {
+        slot = 0;
+        for (int i = 0; i < MAX_STORED_REFERENCES; i++)
+        {
+            if (_refNumbers[i] < 0) {slot = i; break;}
+            if (_updatedAt[i] < _updatedAt[slot]) slot = i;
+        }
+    }
+
+    // Download the values
+    _refNumbers[slot] = -1;
+    if (!_scanMB->getReferenceValues(_values[slot], refNumber)) return false;
+    _refNumbers[slot] = refNumber;
+    _info[slot] = info;
+    _updatedAt[slot] = ++_updates;
+    _downloaded = true;
+    return true;
+}
+
+// This finds which reference is in use and makes sure it is current
+bool scanReferenceStore::updateActive(void)
+{
+    int16_t active = _scanMB->getCurrentReferenceNumber();
+    if (active < 0) return false;
+    _active = active;
+    return update(_active);
+}
+
+// This returns the stored settings of a reference
+const referenceInfo *scanReferenceStore::getInfo(int refNumber)
+{
+    int slot = findSlot(refNumber);
+    if (slot < 0) return NULL;
+    return &_info[slot];
+}
+
+// This returns the stored values of a reference
+const float *scanReferenceStore::getValues(int refNumber)
+{
+    int slot = findSlot(refNumber);
+    if (slot < 0) return NULL;
+    return _values[slot];
+}
+
+// This compares two stored references
+bool scanReferenceStore::compare(int refNumber1, int refNumber2, float &rmsDifference,
+                                 float &maxDeviation)
+{
+    int slot1 = findSlot(refNumber1);
+    int slot2 = findSlot(refNumber2);
+    if (slot1 < 0 || slot2 < 0) return false;
+    difference(_values[slot1], _values[slot2], REFERENCE_VALUES, rmsDifference, maxDeviation);
+    return true;
+}
+
+// This calculates the RMS difference and largest absolute difference
+// Values that are NAN in either spectrum are left out.
+void scanReferenceStore::difference(const float *spectrum1, const float *spectrum2, int numValues,
+                                    float &rmsDifference, float &maxDeviation)
+{
+    float sumSquares = 0;
+    int counted = 0;
+    maxDeviation = 0;
+    for (int i = 0; i < numValues; i++)
+    {
+        float diff = spectrum1[i] - spectrum2[i];
+        if (isnan(diff)) continue;
+        sumSquares += diff*diff;
+        if (fabs(diff) > maxDeviation) maxDeviation = fabs(diff);
+        counted++;
+    }
+    if (counted > 0) rmsDifference = sqrt(sumSquares/counted);
+    else rmsDifference = NAN;
+}
+
+// This returns where a reference is stored, or -1
+int scanReferenceStore::findSlot(int refNumber)
+{
+    if (refNumber < 0) return -1;
+    for (int i = 0; i < MAX_STORED_REFERENCES; i++)
+        if (_refNumbers[i] == refNumber) return i;
+    return -1;
+}
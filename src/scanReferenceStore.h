@@ -0,0 +1,82 @@
+/*
+ *scanReferenceStore.h
+*/
+
+#ifndef scanReferenceStore_h
+#define scanReferenceStore_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For modbus communication
+
+// The largest number of references to keep copies of
+// Each one takes REFERENCE_VALUES (256) floats, 1kb, of RAM!
+#ifndef MAX_STORED_REFERENCES
+#define MAX_STORED_REFERENCES 2
+#endif
+// The number of values in a reference
+#define REFERENCE_VALUES (holdingReg::fRefValues.count())
+
+
+//----------------------------------------------------------------------------
+//         FUNCTIONS TO KEEP AND COMPARE COPIES OF THE STORED REFERENCES
+//----------------------------------------------------------------------------
+// This keeps copies of references taken by the spectro::lyser, so they can be
+// compared with each other to catch lamp or dark noise drift.  Each reference
+// is 512 registers, so it is only downloaded again when the time it was
+// taken changes; checking that time costs one modbus frame.
+class scanReferenceStore
+{
+
+public:
+
+    scanReferenceStore(scan *scanMB);
+
+    // This makes sure the stored copy of a reference is current,
+    // downloading it if it's new or has been re-taken.  If there's no free
+    // space, the copy that was updated longest ago is replaced.
+    // Returns true if the stored copy is current.
+    bool update(int refNumber);
+
+    // This finds which reference is in use and makes sure it is current
+    bool updateActive(void);
+
+    // This returns the reference found in use by updateActive(), or -1
+    int getActiveReference(void){return _active;}
+
+    // This is true if the last update had to download the whole reference
+    bool lastUpdateDownloaded(void){return _downloaded;}
+
+    // These return the stored settings and values of a reference, or NULL
+    // if that reference isn't stored
+    const referenceInfo *getInfo(int refNumber);
+    const float *getValues(int refNumber);
+
+    // This compares two stored references, giving the RMS difference and
+    // the largest absolute difference between them in Abs/m.
+    // Returns false if either isn't stored.
+    bool compare(int refNumber1, int refNumber2, float &rmsDifference, float &maxDeviation);
+
+    // This compares a stored reference with the one in use
+    bool compareToActive(int refNumber, float &rmsDifference, float &maxDeviation)
+    {return compare(_active, refNumber, rmsDifference, maxDeviation);}
+
+    // This calculates the RMS difference and largest absolute difference
+    // between two spectra
+    static void difference(const float *spectrum1, const float *spectrum2, int numValues,
+                           float &rmsDifference, float &maxDeviation);
+
+private:
+    // This returns where a reference is stored, or -1
+    int findSlot(int refNumber);
+
+    scan *_scanMB;
+    int _active;
+    bool _downloaded;
+    uint32_t _updates;  // Counts updates, to find the oldest copy
+    int _refNumbers[MAX_STORED_REFERENCES];  // -1 if the slot is empty
+    uint32_t _updatedAt[MAX_STORED_REFERENCES];
+    referenceInfo _info[MAX_STORED_REFERENCES];
+    float _values[MAX_STORED_REFERENCES][REFERENCE_VALUES];
+};
+
+#endif
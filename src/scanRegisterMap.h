@@ -0,0 +1,234 @@
+/*
+ *scanRegisterMap.h
+ *
+ * GENERATED FILE - do not edit by hand!
+ * This was written by utils/genRegisterMap/genRegisterMap.py from
+ * FullSpecModbusMap.xlsx.  Make any changes there and re-run the generator.
+ *
+ * Each register (or block of registers) is described by the modbus command
+ * used to read it, the address of the first register for block number 0,
+ * the number of registers between repeated blocks (ie, between parameters
+ * or fingerprint sources), the total number of registers, and the data type.
+ * Everything is constexpr, so the addresses and the number of frames needed
+ * for a bulk read are worked out by the compiler.
+*/
+
+#ifndef scanRegisterMap_h
+#define scanRegisterMap_h
+
+#include <Arduino.h>
+
+#ifndef MAX_REGS_PER_FRAME
+#define MAX_REGS_PER_FRAME 60  // The largest number of registers to call at once
+#endif
+
+// The data types in the modbus map
+typedef enum regDataType
+{
+    regUnknown = 0,
+    regUint16,
+    regInt16,
+    regEnum,
+    regBitmask,
+    regPointer,
+    regFloat32,
+    regTAI64N,
+    regChar
+} regDataType;
+
+// The description of a single register or repeated block of registers
+struct scanRegister
+{
+    byte regType;  // The modbus read command (0x03 = holding, 0x04 = input)
+    uint16_t address;  // The first register for block number 0
+    uint16_t stride;  // The registers between repeated blocks (0 if not repeated)
+    uint16_t length;  // The total number of registers in the field
+    regDataType type;  // The data type of each value in the field
+
+    // The first register of block number n
+    constexpr uint16_t at(int n = 0) const {return address + stride*n;}
+    // The number of registers taken by each value
+    constexpr uint16_t width(void) const
+    {return type == regFloat32 ? 2 : (type == regTAI64N ? 6 : (type == regChar ? length : 1));}
+    // The number of values in the field
+    constexpr uint16_t count(void) const {return length/width();}
+    // The number of characters in a char field
+    constexpr uint16_t chars(void) const {return length*2;}
+    // The number of whole values that fit in a single modbus frame
+    constexpr uint16_t valuesPerFrame(void) const {return MAX_REGS_PER_FRAME/width();}
+    // The number of modbus frames needed to read the whole field
+    constexpr uint16_t frames(void) const
+    {return (count() + valuesPerFrame() - 1)/valuesPerFrame();}
+    // The byte location of block n in a response frame that started at firstReg
+    // (3 bytes of Modbus header + (2 bytes/register x (register - start register))
+    constexpr int byteInFrame(uint16_t firstReg, int n = 0) const
+    {return 3 + 2*(at(n) - firstReg);}
+};
+
+
+//----------------------------------------------------------------------------
+//  HOLDING REGISTERS (read with 0x03)
+//----------------------------------------------------------------------------
+namespace holdingReg
+{
+    // Serial mode: Modbus address of device TCP mode: Portnumber of device
+    constexpr scanRegister uiAddress = {0x03, 0, 0, 1, regUint16};
+    // Shows the mode of the device 0 ... Modbus RTU 1 ... Modbus serial ASC...
+    constexpr scanRegister eCommMode = {0x03, 1, 0, 1, regEnum};
+    // Serial mode: baudrate 0 ... 9600 baud 1 ... 19200 baud 2 ... 38400 ba...
+    constexpr scanRegister eBaudrate = {0x03, 2, 0, 1, regEnum};
+    // Serial mode: parity 0 ... no parity 1 ... even parity 2 ... odd parit...
+    constexpr scanRegister eParity = {0x03, 3, 0, 1, regEnum};
+    // General changes on all settings (e.g. reset all settings to default)
+    constexpr scanRegister eChangeSettings = {0x03, 4, 0, 1, regEnum};
+    // Pointer to startaddress of device configuration private
+    constexpr scanRegister pDeviceConfigPrivate = {0x03, 5, 0, 1, regPointer};
+    // Installation location (s::canpoint) of the device, filled with spaces
+    constexpr scanRegister abDeviceLocation = {0x03, 6, 0, 6, regChar};
+    // Cleaning mode configuration: 0 ... no cleaning supported, manual OFF...
+    constexpr scanRegister eCleanMode = {0x03, 12, 0, 1, regEnum};
+    // Cleaning interval 0 ... automatic disabled
+    constexpr scanRegister uiCleanInterval = {0x03, 13, 0, 1, regUint16};
+    // Cleaning duration in seconds
+    constexpr scanRegister uiCleanDuration = {0x03, 14, 0, 1, regUint16};
+    // Waiting time between end of cleaning and start of measurement
+    constexpr scanRegister uiCleanWait = {0x03, 15, 0, 1, regUint16};
+    // Current system time
+    constexpr scanRegister tSystemTime = {0x03, 16, 0, 6, regTAI64N};
+    // Measurement interval in sec. 0 ... as fast as possible
+    constexpr scanRegister uiMeasInterval = {0x03, 22, 0, 1, regUint16};
+    // Spec logging mode 0 … logging mode 1 … online mode
+    constexpr scanRegister eLoggingMode = {0x03, 23, 0, 1, regUnknown};
+    // Logging interval for data logger in minutes 0 ... no datalogger active
+    constexpr scanRegister uiLogInterval = {0x03, 24, 0, 1, regUint16};
+    // Available number of logged results in datalogger (since last clearing)
+    constexpr scanRegister uiNLogResultsTotal = {0x03, 25, 0, 1, regUint16};
+    // Index device status public+ private & parameter results from logger s...
+    constexpr scanRegister uiIndexLogResult = {0x03, 26, 0, 1, regUint16};
+    // Name of parameter 1 (filled with spaces)
+    constexpr scanRegister abPName = {0x03, 0, 120, 4, regChar};
+    // Unit of parameter 1 (filled with spaces)
+    constexpr scanRegister abPUnit = {0x03, 4, 120, 4, regChar};
+    // Upper measuring range of parameter 1
+    constexpr scanRegister xPUpperLimit = {0x03, 8, 120, 2, regFloat32};
+    // Lower measuring range of parameter 1
+    constexpr scanRegister xPLowerLimit = {0x03, 10, 120, 2, regFloat32};
+    // Calibration coefficients 1-4 Offset (x0), slope (x1), x2, and x3 of l...
+    constexpr scanRegister fCalibrCoeff = {0x03, 14, 120, 8, regFloat32};
+    // Name of in-use global calibration
+    constexpr scanRegister cGlobalCal0 = {0x03, 1081, 0, 6, regChar};
+    // Name of next global calibration in storage
+    constexpr scanRegister cGlobalCalList1 = {0x03, 1089, 0, 6, regChar};
+    // Text list of remaining global calibrations in storage
+    constexpr scanRegister cGlobalCalList = {0x03, 1098, 0, 72, regChar};
+    // Number of values recorded for each reference??
+    constexpr scanRegister uiValuesinRef = {0x03, 1488, 0, 1, regInt16};
+    // Number of reference in use (0-6)
+    constexpr scanRegister uiRefNuminUse = {0x03, 1507, 0, 1, regInt16};
+    // Name of reference in use
+    constexpr scanRegister uiRefNameinUse = {0x03, 1508, 0, 4, regChar};
+    // Time reference in use recorded
+    constexpr scanRegister tRefinUse = {0x03, 1512, 0, 6, regTAI64N};
+    // Name of reference 0
+    constexpr scanRegister cRefName = {0x03, 1519, 536, 4, regChar};
+    // Dark noise at reference 0 measurement
+    constexpr scanRegister fDarkNoise = {0x03, 1523, 536, 2, regFloat32};
+    // Average K at reference 0 measurement
+    constexpr scanRegister uiAvgK = {0x03, 1525, 536, 1, regInt16};
+    // Average M at reference 0 measurement
+    constexpr scanRegister uiAvgM = {0x03, 1526, 536, 1, regInt16};
+    // Flash Rate [Hz] during reference 0 measurement
+    constexpr scanRegister uiFlash = {0x03, 1527, 536, 1, regInt16};
+    // Lamp voltage during reference 0 measurement
+    constexpr scanRegister uiLampV = {0x03, 1528, 536, 1, regInt16};
+    // Detector Type 0 … Vis 1 … UV-Vis
+    constexpr scanRegister eDetectorType = {0x03, 1529, 536, 1, regEnum};
+    // Lp Filter 0 … off 1 … on
+    constexpr scanRegister eLpfilter = {0x03, 1531, 536, 1, regEnum};
+    // Frequency lower limit [Hz]
+    constexpr scanRegister uiFUG = {0x03, 1532, 536, 1, regInt16};
+    // Reference type (enum values unknown)
+    constexpr scanRegister eRefType = {0x03, 1533, 536, 1, regEnum};
+    // Reference 0 Offset [abs/m]
+    constexpr scanRegister eRefOffset = {0x03, 1534, 536, 1, regInt16};
+    // Time of reference 0
+    constexpr scanRegister tRefTime = {0x03, 1536, 536, 6, regTAI64N};
+    // Raw Absorbances of Reference 0 (186.3-732.7)
+    constexpr scanRegister fRefValues = {0x03, 1542, 536, 512, regFloat32};
+    // Measurement precision of parameter n - totally a WAG
+    constexpr scanRegister uiPPrecision = {0x03, 27, 120, 1, regUint16};
+    // The "Number of max repetitions" of reference n
+    constexpr scanRegister uiRefRepetitions = {0x03, 1530, 536, 1, regInt16};
+}
+
+
+//----------------------------------------------------------------------------
+//  INPUT REGISTERS (read with 0x04)
+//----------------------------------------------------------------------------
+namespace inputReg
+{
+    // Version of Modbus mapping protocol. For all changes in public registe...
+    constexpr scanRegister uiVersion = {0x04, 0, 0, 1, regUint16};
+    // Vendor code 0x0000 … unknown 0x96C3 … s::can
+    constexpr scanRegister eVendor = {0x04, 1, 0, 1, regEnum};
+    // Device model 0x0000 - unknown 0x0101 - spectro::lyzer 0x0603 - con::s...
+    constexpr scanRegister eModel = {0x04, 2, 0, 1, regEnum};
+    // Description of device model, filled with spaces (or 0's)
+    constexpr scanRegister abModel = {0x04, 3, 0, 10, regChar};
+    // Serial number, filled with spaces (or 0's)
+    constexpr scanRegister abSerialNumber = {0x04, 13, 0, 4, regChar};
+    // Hardware release: 0xAABB AA ... Major version BB ... Minor version
+    constexpr scanRegister abHWRelease = {0x04, 17, 0, 2, regChar};
+    // Software release: 0xAABB AA ... Major version BB ... Minor version
+    constexpr scanRegister abSWRelease = {0x04, 19, 0, 2, regChar};
+    // Device rebooter counter
+    constexpr scanRegister uiHWStarts = {0x04, 21, 0, 1, regUint16};
+    // Number of Parameters
+    constexpr scanRegister uiParameterCount = {0x04, 22, 0, 1, regUint16};
+    // Data type of Parameter and Parameter limits (check for compatibility)
+    constexpr scanRegister eParameterType = {0x04, 23, 0, 1, regEnum};
+    // Parameter scale factor. Used for all Parameter values which depend on...
+    constexpr scanRegister uiParameterScale = {0x04, 24, 0, 1, regUint16};
+    // Time when the Parameter results have been updated. Timestamp of logge...
+    constexpr scanRegister tSampleTime = {0x04, 104, 0, 6, regTAI64N};
+    // Device Status ... See bitmask map
+    constexpr scanRegister bmDeviceStatus = {0x04, 120, 0, 1, regBitmask};
+    // Parameter 1 status ... See bitmask map
+    constexpr scanRegister bmPStatus = {0x04, 120, 8, 1, regBitmask};
+    // Parameter 1 private status
+    constexpr scanRegister bmPPrivStatus = {0x04, 121, 8, 1, regBitmask};
+    // Parameter 1 result
+    constexpr scanRegister xPValue = {0x04, 122, 8, 2, regFloat32};
+    // Parameter 1 result private
+    constexpr scanRegister xPPrivValue = {0x04, 124, 8, 2, regFloat32};
+    constexpr scanRegister tFingerprintTime = {0x04, 512, 512, 6, regTAI64N};
+    // Fingerprint Detector Type 0 … Vis 1 … UV-Vis
+    constexpr scanRegister eDetectorType = {0x04, 518, 512, 1, regEnum};
+    // Spectral Source 0 … Fingerprint [Abs/m] 1 … Turbidity compensated fin...
+    constexpr scanRegister eSpectralSource = {0x04, 519, 512, 1, regEnum};
+    // Spectral Path Length
+    constexpr scanRegister uiPathLength = {0x04, 520, 512, 1, regInt16};
+    // "Raw" fingerprint [Abs/m]
+    constexpr scanRegister fFingerprintData = {0x04, 522, 512, 442, regFloat32};
+    // A total and complete WAG as to the location of the fingerprint status
+    constexpr scanRegister uiFPStatus = {0x04, 521, 512, 1, regBitmask};
+}
+
+
+//----------------------------------------------------------------------------
+//  MODEL SPECIFIC REGISTERS
+//----------------------------------------------------------------------------
+// These differ between a spectro::lyzer and ana::gate.  The structs can be
+// used as a template parameter to pick the map at compile time.
+struct spectroLyserMap
+{
+    // The global calibration name, from the private configuration
+    static constexpr scanRegister globalCal(void) {return {0x03, 1081, 0, 6, regChar};}
+};
+struct anaGateMap
+{
+    // The global calibration name, as listed by ana::gate
+    static constexpr scanRegister globalCal(void) {return {0x04, 964, 0, 6, regChar};}
+};
+
+#endif
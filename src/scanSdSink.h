@@ -0,0 +1,287 @@
+/*
+ *scanSdSink.h
+ *
+ *This is all in the header (rather than a .cpp file) so that sketches that
+ *don't use an SD card don't need the SdFat library to compile.
+*/
+
+#ifndef scanSdSink_h
+#define scanSdSink_h
+
+#include <Arduino.h>
+#include <SdFat.h>  // To communicate with the SD card
+#include <TimeLib.h>  // For the file timestamps
+
+#define SD_SINK_SECTOR_SIZE 512
+
+// How much space to set aside (in one contiguous run of clusters) for each
+// file; start a new file once it's nearly used up
+#ifndef SD_SINK_FILE_SIZE
+#define SD_SINK_FILE_SIZE 2000000L
+#endif
+
+// How much room to leave at the end of a file for the row being written
+#ifndef SD_SINK_HEADROOM
+#define SD_SINK_HEADROOM 8192L
+#endif
+
+// The default time between writing out the partly filled sector (ms)
+#ifndef SD_SINK_SYNC_INTERVAL
+#define SD_SINK_SYNC_INTERVAL 60000L
+#endif
+
+
+//----------------------------------------------------------------------------
+//                        BUFFERED SD CARD TEXT FILES
+//----------------------------------------------------------------------------
+// This keeps a text file open and collects everything printed to it into a
+// sector-sized buffer, so the card only ever sees whole, aligned sectors.
+//
+// Each new file is made as one contiguous run of clusters, and then erased,
+// so writing it never touches the FAT and every unwritten sector reads back
+// as all 0x00 or all 0xFF (which never appear in text).  After a power loss,
+// opening the file again finds where the text ends with a binary search of
+// its sectors and carries on from there.  Closing the file cuts it to the
+// length of the text; trimUnclosed() does the same, at start-up, for files
+// that were never closed.
+//
+//    scanSdSink parSink(sd);
+//    parSink.open("2024-01-01_00-00-00.par", currentTime);
+//    spectroPr.printParameterDataRow(parSink);
+//    parSink.syncIfDue();
+class scanSdSink : public Stream
+{
+
+public:
+    scanSdSink(SdFat *sd)
+    {
+        _sd = sd;
+        _allocated = 0;
+        _sectorStart = 0;
+        _fill = 0;
+        _syncInterval = SD_SINK_SYNC_INTERVAL;
+        _lastSync = 0;
+    }
+    scanSdSink(SdFat &sd) : scanSdSink(&sd) {}
+
+    // This sets how long to wait (ms) between writing out the partly filled
+    // sector; 0 writes it every time syncIfDue() is called
+    void setSyncInterval(uint32_t ms) {_syncInterval = ms;}
+
+    // This opens a file, setting its timestamps if a time is given
+    // A new file has SD_SINK_FILE_SIZE bytes set aside for it; a file that
+    // already exists is carried on from the end of its text.
+    bool open(const char *name, time_t now = 0)
+    {
+        close();
+        if (_sd->exists(name))
+        {
+            if (!_file.open(name, O_RDWR)) return false;
+            _allocated = _file.fileSize();
+            findEnd();
+        }
+        else
+        {
+            if (!_file.createContiguous(name, SD_SINK_FILE_SIZE)) return false;
+            _allocated = _file.fileSize();
+            if (!erase()) return false;
+            _sectorStart = 0;
+            _fill = 0;
+            if (now > 0) setTimestamp(T_CREATE | T_WRITE | T_ACCESS, now);
+        }
+        _lastSync = millis();
+        return true;
+    }
+
+    // This writes out what's in the buffer and cuts the file to the length
+    // of the text, so it reads normally on a computer
+    void close(void)
+    {
+        if (!_file.isOpen()) return;
+        writeBuffer();
+        _file.truncate(size());
+        _file.close();
+        _allocated = 0;
+        _sectorStart = 0;
+        _fill = 0;
+    }
+
+    bool isOpen(void) {return _file.isOpen();}
+
+    // This finds the files in the card's root directory that were never
+    // closed (ie, because the power was lost), which are still exactly
+    // SD_SINK_FILE_SIZE with an unwritten last sector, and cuts each one to
+    // the length of its text.  Call it once at start-up, before this sink
+    // opens anything.  Returns the number of files cut.
+    int trimUnclosed(void)
+    {
+        close();
+        File root;
+        if (!root.open("/")) return 0;
+        int trimmed = 0;
+        // Everything is looked at read only, since directories and read-only
+        // files can't be opened for writing; only the files to cut are
+        // opened again, by their place in the directory, to write
+        while (_file.openNext(&root, O_RDONLY))
+        {
+            _allocated = _file.fileSize();
+            bool unclosed = !_file.isDir() && _allocated == (uint32_t)SD_SINK_FILE_SIZE &&
+                            !sectorWritten((_allocated - 1)/SD_SINK_SECTOR_SIZE);
+            uint16_t index = _file.dirIndex();
+            _file.close();
+            if (unclosed && _file.open(&root, index, O_RDWR))
+            {
+                findEnd();
+                if (_file.truncate(size())) trimmed++;
+                _file.close();
+            }
+        }
+        root.close();
+        _allocated = 0;
+        _sectorStart = 0;
+        _fill = 0;
+        return trimmed;
+    }
+
+    // This returns true once the space set aside for the file is nearly used
+    bool full(void) {return size() + SD_SINK_HEADROOM >= _allocated;}
+
+    // This returns the length of the text in the file
+    uint32_t size(void) {return _sectorStart + _fill;}
+
+    // This writes out the partly filled sector so that it will survive a
+    // power loss, and updates the modification time if one is given
+    bool sync(time_t now = 0)
+    {
+        if (!_file.isOpen()) return false;
+        bool success = writeBuffer();
+        if (now > 0) setTimestamp(T_WRITE | T_ACCESS, now);
+        success &= _file.sync();
+        _lastSync = millis();
+        return success;
+    }
+
+    // This syncs if the sync interval has passed since the last one
+    bool syncIfDue(time_t now = 0)
+    {
+        if (millis() - _lastSync < _syncInterval) return true;
+        return sync(now);
+    }
+
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        if (!_file.isOpen()) return 0;
+        size_t written = 0;
+        while (written < size)
+        {
+            size_t n = min(size - written, (size_t)(SD_SINK_SECTOR_SIZE - _fill));
+            memcpy(_buffer + _fill, buffer + written, n);
+            _fill += n;
+            written += n;
+            if (_fill == SD_SINK_SECTOR_SIZE)
+            {
+                // The sector stays in the buffer, so the next write or sync
+                // tries it again
+                if (!writeBuffer())
+                {
+                    setWriteError();
+                    return written;
+                }
+                _sectorStart += SD_SINK_SECTOR_SIZE;
+                _fill = 0;
+            }
+        }
+        return written;
+    }
+    using Print::write;
+
+    // There's nothing to read
+    int available(void) {return 0;}
+    int read(void) {return -1;}
+    int peek(void) {return -1;}
+    void flush(void) {sync();}
+
+private:
+    // This writes the buffer over its sector of the file
+    // A full sector is written straight to the card.
+    bool writeBuffer(void)
+    {
+        if (_fill == 0) return true;
+        if (!_file.seekSet(_sectorStart)) return false;
+        return (size_t)_file.write(_buffer, _fill) == _fill;
+    }
+
+    // This erases the clusters set aside for a new file
+    // If the card can't erase them, they're written over with zeros instead.
+    bool erase(void)
+    {
+        uint32_t firstBlock, lastBlock;
+        if (_file.contiguousRange(&firstBlock, &lastBlock)
+            && _sd->card()->erase(firstBlock, lastBlock)) return true;
+        memset(_buffer, 0, SD_SINK_SECTOR_SIZE);
+        _file.seekSet(0);
+        for (uint32_t position = 0; position < _allocated; position += SD_SINK_SECTOR_SIZE)
+        {
+            // Not past the end, which would make the file bigger
+            size_t n = min(_allocated - position, (uint32_t)SD_SINK_SECTOR_SIZE);
+            if ((size_t)_file.write(_buffer, n) != n) return false;
+        }
+        return _file.sync();
+    }
+
+    // This returns true if a sector of the file has been written
+    bool sectorWritten(uint32_t sector)
+    {
+        if (!_file.seekSet(sector*SD_SINK_SECTOR_SIZE)) return false;
+        int c = _file.read();
+        return c > 0x00 && c < 0xFF;
+    }
+
+    // This finds the end of the text in the file and loads its last, partly
+    // filled sector into the buffer
+    void findEnd(void)
+    {
+        // Every sector before `written` has text; none from `unwritten` on do
+        uint32_t written = 0;
+        uint32_t unwritten = (_allocated + SD_SINK_SECTOR_SIZE - 1)/SD_SINK_SECTOR_SIZE;
+        while (written < unwritten)
+        {
+            uint32_t middle = (written + unwritten)/2;
+            if (sectorWritten(middle)) written = middle + 1;
+            else unwritten = middle;
+        }
+        _sectorStart = 0;
+        _fill = 0;
+        if (written == 0) return;
+
+        _sectorStart = (written - 1)*SD_SINK_SECTOR_SIZE;
+        _file.seekSet(_sectorStart);
+        int got = _file.read(_buffer, SD_SINK_SECTOR_SIZE);
+        if (got < 0) got = 0;
+        while (got > 0 && (_buffer[got - 1] == 0x00 || _buffer[got - 1] == 0xFF)) got--;
+        _fill = got;
+        if (_fill == SD_SINK_SECTOR_SIZE)
+        {
+            _sectorStart += SD_SINK_SECTOR_SIZE;
+            _fill = 0;
+        }
+    }
+
+    void setTimestamp(uint8_t flags, time_t time)
+    {
+        _file.timestamp(flags, year(time), month(time), day(time),
+                        hour(time), minute(time), second(time));
+    }
+
+    SdFat *_sd;
+    File _file;
+    uint32_t _allocated;  // The size of the file, including unwritten space
+    uint32_t _sectorStart;  // Where the buffer goes in the file
+    size_t _fill;  // How much of the buffer is used
+    uint32_t _syncInterval;
+    uint32_t _lastSync;
+    uint8_t _buffer[SD_SINK_SECTOR_SIZE];
+};
+
+#endif
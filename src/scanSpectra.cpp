@@ -0,0 +1,51 @@
+/*
+ *scanSpectra.cpp
+*/
+
+#include "scanSpectra.h"
+
+
+//----------------------------------------------------------------------------
+//            FUNCTIONS TO CALCULATE DERIVED SPECTRA ON THE ARDUINO
+//----------------------------------------------------------------------------
+
+// This calculates the first derivative of a spectrum
+// The interior points are a single loop with no branches so that it can be
+// vectorized when compiled for a bigger processor.
+void scanSpectra::derivative(const float *absorbance, float *deriv, int numValues,
+                             float step)
+{
+    if (numValues < 2)
+    {
+        if (numValues == 1) deriv[0] = 0;
+        return;
+    }
+    float halfInvStep = 0.5/step;
+    for (int i = 1; i < numValues - 1; i++)
+        deriv[i] = (absorbance[i + 1] - absorbance[i - 1])*halfInvStep;
+    deriv[0] = (absorbance[1] - absorbance[0])/step;
+    deriv[numValues - 1] = (absorbance[numValues - 1] - absorbance[numValues - 2])/step;
+}
+
+// This calculates the percent transmission through the given path length
+// %T = 100 * 10^(-A*L), with A in Abs/m and L in m
+// 10^x is computed as e^(x*ln(10)), which is cheaper on an AVR.
+void scanSpectra::percentTransmission(const float *absorbance, float *percentT, int numValues,
+                               float pathLength_mm)
+{
+    float scale = -pathLength_mm*0.001*2.302585093;  // -L[m] * ln(10)
+    for (int i = 0; i < numValues; i++)
+        percentT[i] = 100.0*exp(absorbance[i]*scale);
+}
+
+// This returns the largest absolute difference between two spectra
+float scanSpectra::maxDifference(const float *spectrum1, const float *spectrum2, int numValues)
+{
+    float maxDiff = 0;
+    for (int i = 0; i < numValues; i++)
+    {
+        float diff = fabs(spectrum1[i] - spectrum2[i]);
+        if (diff > maxDiff) maxDiff = diff;
+    }
+    return maxDiff;
+}
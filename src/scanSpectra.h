@@ -0,0 +1,56 @@
+/*
+ *scanSpectra.h
+*/
+
+#ifndef scanSpectra_h
+#define scanSpectra_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For the wavelength grid
+
+
+//----------------------------------------------------------------------------
+//            FUNCTIONS TO CALCULATE DERIVED SPECTRA ON THE ARDUINO
+//----------------------------------------------------------------------------
+// The spectro::lyser offers several spectral sources that are calculated
+// from the raw fingerprint or the turbidity-compensated fingerprint.  Each
+// costs another 8 modbus frames to read, so these recreate them from the two
+// that can't be calculated locally:
+//    derivFP         = derivative(fingerprint)
+//    transmission    = percentTransmission(fingerprint, getPathLength())
+//    transmission10  = percentTransmission10(fingerprint)
+//    derivcompFP     = derivative(compensFP)
+// NB:  s::can doesn't document how the spectro::lyser calculates these, so
+// use maxDifference() against the spectro::lyser's own values before relying
+// on them.
+// All arrays are the same length (221 values for a fingerprint), and the
+// output array must not be the same as the input.
+class scanSpectra
+{
+
+public:
+
+    // This calculates the first derivative of a spectrum using central
+    // differences (one-sided at the two ends).  By default it is the change
+    // per value (2.5 nm), in Abs/m like the spectro::lyser's derivFP; give
+    // step = WAVELENGTH_STEP to get it in Abs/m/nm instead.
+    static void derivative(const float *absorbance, float *deriv, int numValues,
+                           float step = 1);
+
+    // This calculates the percent transmission through the given path
+    // length (mm) from absorbances in Abs/m
+    // NB getFingerprintPathLength() returns the register as is, in tenths of
+    // a mm, so divide it by 10 (or use getPathLength()).
+    static void percentTransmission(const float *absorbance, float *percentT, int numValues,
+                                    float pathLength_mm);
+
+    // This calculates the percent transmission per 10cm from absorbances in Abs/m
+    static void percentTransmission10(const float *absorbance, float *percentT, int numValues)
+    {percentTransmission(absorbance, percentT, numValues, 100.0);}
+
+    // This returns the largest absolute difference between two spectra, to
+    // compare a locally calculated spectrum with the one from the device
+    static float maxDifference(const float *spectrum1, const float *spectrum2, int numValues);
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ *scanSpectralModel.cpp
+*/
+
+#include "scanSpectralModel.h"
+
+#define SPECTRAL_MODEL_TIMEOUT 1000  // How long to wait for the next character (ms)
+
+
+//----------------------------------------------------------------------------
+//           FUNCTIONS TO ESTIMATE PARAMETERS FROM SPECTRA LOCALLY
+//----------------------------------------------------------------------------
+
+// This reads models from a stream, replacing any already loaded
+int scanSpectralModel::begin(Stream *stream)
+{
+    _count = 0;
+    _hasMean = false;
+    char token[24];
+    char name[SPECTRAL_MODEL_NAME_LENGTH + 1];
+    float intercept;
+    int ending = 0;
+    while (ending >= 0)
+    {
+        // Read the name
+        ending = readToken(stream, token, sizeof(token));
+        if (token[0] == '\0' && ending != ',' && ending != '\t') continue;  // Blank line
+        if (token[0] == '#')
+        {
+            // Skip the rest of the comment line
+            while (ending >= 0 && ending != '\n') ending = readToken(stream, token, sizeof(token));
+            continue;
+        }
+        bool isMean = strcmp(token, "mean") == 0;
+        strncpy(name, token, SPECTRAL_MODEL_NAME_LENGTH);
+        name[SPECTRAL_MODEL_NAME_LENGTH] = '\0';
+
+        // Read the intercept, unless this is the mean
+        intercept = 0;
+        if (!isMean && ending != '\n' && ending >= 0)
+        {
+            ending = readToken(stream, token, sizeof(token));
+            intercept = atof(token);
+        }
+
+        // Read the coefficients, straight into their final place
+        float *values;
+        if (isMean) values = _mean;
+        else if (_count < MAX_SPECTRAL_MODELS) values = _coeffs[_count];
+        else values = NULL;  // No room, so just read past it
+        int numValues = 0;
+        while (ending != '\n' && ending >= 0)
+        {
+            ending = readToken(stream, token, sizeof(token));
+            if (token[0] == '\0') continue;
+            if (numValues < FINGERPRINT_VALUES && values != NULL) values[numValues] = atof(token);
+            numValues++;
+        }
+
+        // Only keep complete lines
+        if (numValues != FINGERPRINT_VALUES || values == NULL) continue;
+        if (isMean) _hasMean = true;
+        else addModel(name, intercept, _coeffs[_count], _hasMean ? _mean : NULL);
+    }
+    return _count;
+}
+int scanSpectralModel::begin(Stream &stream)
+{return begin(&stream);}
+
+
+// This adds one model
+// If the mean is given, the model is re-written as intercept - b.mean + b.x
+// so evaluating it is a single dot product.
+bool scanSpectralModel::addModel(const char *name, float intercept, const float *coeffs,
+                                 const float *mean)
+{
+    if (_count >= MAX_SPECTRAL_MODELS) return false;
+    strncpy(_names[_count], name, SPECTRAL_MODEL_NAME_LENGTH);
+    _names[_count][SPECTRAL_MODEL_NAME_LENGTH] = '\0';
+    if (coeffs != _coeffs[_count])
+        memcpy(_coeffs[_count], coeffs, sizeof(_coeffs[_count]));
+    if (mean != NULL) intercept -= dot(_coeffs[_count], mean, FINGERPRINT_VALUES);
+    _intercepts[_count] = intercept;
+    _count++;
+    return true;
+}
+
+
+// This evaluates one model against a fingerprint
+float scanSpectralModel::estimate(int model, const float *spectrum)
+{return _intercepts[model] + dot(_coeffs[model], spectrum, FINGERPRINT_VALUES);}
+
+// This evaluates every model against a fingerprint
+void scanSpectralModel::evaluate(const float *spectrum, float *results)
+{
+    for (int model = 0; model < _count; model++)
+        results[model] = estimate(model, spectrum);
+}
+
+// This evaluates every model against a batch of fingerprints
+// Each spectrum is used by every model before moving on to the next one,
+// so only one spectrum and the coefficients need to stay in cache.
+void scanSpectralModel::evaluate(const float *spectra, int numSpectra, float *results)
+{
+    for (int i = 0; i < numSpectra; i++)
+        evaluate(spectra + i*FINGERPRINT_VALUES, results + i*_count);
+}
+
+// This evaluates every model and adds the results to a snapshot
+int scanSpectralModel::evaluate(const float *spectrum, parameterSnapshot &snapshot)
+{
+    int added = 0;
+    for (int model = 0; model < _count && snapshot.count < MAX_PARAMETERS; model++)
+    {
+        snapshot.status[snapshot.count] = 0;
+        snapshot.specStatus[snapshot.count] = 0;
+        snapshot.value[snapshot.count] = estimate(model, spectrum);
+        snapshot.count++;
+        added++;
+    }
+    return added;
+}
+
+
+// This starts evaluating the models against a streamed spectrum
+void scanSpectralModel::startSpectrum(void)
+{
+    for (int model = 0; model < _count; model++) _results[model] = _intercepts[model];
+}
+
+// This adds one streamed spectral value to each model
+void scanSpectralModel::addValue(int index, float, float value, void *context)
+{
+    scanSpectralModel *models = (scanSpectralModel*)context;
+    if (index < 0 || index >= FINGERPRINT_VALUES) return;
+    for (int model = 0; model < models->_count; model++)
+        models->_results[model] += models->_coeffs[model][index]*value;
+}
+
+
+// This returns the dot product of two arrays
+float scanSpectralModel::dot(const float *a, const float *b, int numValues)
+{
+    float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    int i = 0;
+    for (; i + 3 < numValues; i += 4)
+    {
+        sum0 += a[i]*b[i];
+        sum1 += a[i + 1]*b[i + 1];
+        sum2 += a[i + 2]*b[i + 2];
+        sum3 += a[i + 3]*b[i + 3];
+    }
+    for (; i < numValues; i++) sum0 += a[i]*b[i];
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+
+// This reads the next comma, tab, or line separated value from a stream
+// Spaces and carriage returns are skipped.
+int scanSpectralModel::readToken(Stream *stream, char *token, int maxLength)
+{
+    int length = 0;
+    int c;
+    token[0] = '\0';
+    while (true)
+    {
+        uint32_t start = millis();
+        do
+        {
+            c = stream->read();
+            if (c >= 0) break;
+        } while (millis() - start < SPECTRAL_MODEL_TIMEOUT);
+        if (c < 0 || c == ',' || c == '\t' || c == '\n') break;
+        if (c == ' ' || c == '\r') continue;
+        if (length < maxLength - 1) token[length++] = c;
+        token[length] = '\0';
+    }
+    return c;
+}
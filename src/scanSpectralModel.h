@@ -0,0 +1,102 @@
+/*
+ *scanSpectralModel.h
+*/
+
+#ifndef scanSpectralModel_h
+#define scanSpectralModel_h
+
+#include <Arduino.h>
+#include "scanModbus.h"  // For the spectrum size and parameter snapshots
+
+// The largest number of models to hold at once
+// Each one takes 221 floats (884 bytes) of RAM!
+#ifndef MAX_SPECTRAL_MODELS
+#define MAX_SPECTRAL_MODELS 4
+#endif
+#define SPECTRAL_MODEL_NAME_LENGTH 12  // The longest model name kept
+
+
+//----------------------------------------------------------------------------
+//           FUNCTIONS TO ESTIMATE PARAMETERS FROM SPECTRA LOCALLY
+//----------------------------------------------------------------------------
+// This estimates parameters from a fingerprint with linear models of the form
+//    estimate = intercept + sum(b[i]*(fingerprint[i] - mean[i]))
+// This covers multiple linear regression and PLS (whose loadings and
+// weights collapse into a single vector of b-coefficients), and, with an
+// intercept of 0, the scores of a PCA component.  The mean spectrum is
+// optional and is folded into the intercept when the model is loaded.
+//
+// The models can be read from a file on an SD card (or any other stream)
+// with one model per line, values separated by commas or tabs:
+//    name, intercept, b0, b1, ... b220
+// A line whose name is "mean" gives the mean spectrum for all of the models
+// after it.  Lines starting with "#" are ignored.
+class scanSpectralModel
+{
+
+public:
+
+    scanSpectralModel(void){_count = 0; _hasMean = false;}
+
+    // This reads models from a stream, replacing any already loaded
+    // Returns the number of models loaded.
+    int begin(Stream *stream);
+    int begin(Stream &stream);
+
+    // This adds one model; the mean may be NULL
+    bool addModel(const char *name, float intercept, const float *coeffs,
+                  const float *mean = NULL);
+
+    // This returns the number of models loaded
+    int getModelCount(void){return _count;}
+
+    // This returns the name of a model (counting from 0)
+    const char *getModelName(int model){return _names[model];}
+
+    // This estimates the result of one model (counting from 0) for a fingerprint
+    float estimate(int model, const float *spectrum);
+
+    // This evaluates every model against a fingerprint, putting one result
+    // per model into the results array
+    void evaluate(const float *spectrum, float *results);
+
+    // This evaluates every model against a batch of fingerprints stored one
+    // after another.  The results are stored one spectrum after another, so
+    // the results array must hold numSpectra*getModelCount() values.
+    void evaluate(const float *spectra, int numSpectra, float *results);
+
+    // This evaluates every model and adds the results to the end of a
+    // snapshot of the spectro::lyser's own parameters, so they can be
+    // logged and sent together.  Returns the number of results added,
+    // which will be less than the number of models if MAX_PARAMETERS is
+    // too small to fit them all.
+    int evaluate(const float *spectrum, parameterSnapshot &snapshot);
+
+    // These evaluate every model as spectral values are streamed from the
+    // spectro::lyser, so no spectrum needs to be kept.  ie:
+    //    model.startSpectrum();
+    //    spectro.getFingerprintData(scanSpectralModel::addValue, &model);
+    //    float estimate = model.getResult(0);
+    void startSpectrum(void);
+    static void addValue(int index, float wavelength, float value, void *context);
+    float getResult(int model){return _results[model];}
+
+    // This returns the dot product of two arrays
+    // It is unrolled by 4, with separate sums to keep the FPU pipeline full.
+    static float dot(const float *a, const float *b, int numValues);
+
+private:
+    // This reads the next comma, tab, or line separated value from a stream
+    // Returns the character that ended it, or -1 at the end of the stream.
+    static int readToken(Stream *stream, char *token, int maxLength);
+
+    int _count;
+    char _names[MAX_SPECTRAL_MODELS][SPECTRAL_MODEL_NAME_LENGTH + 1];
+    float _intercepts[MAX_SPECTRAL_MODELS];
+    float _coeffs[MAX_SPECTRAL_MODELS][FINGERPRINT_VALUES];
+    float _results[MAX_SPECTRAL_MODELS];
+    float _mean[FINGERPRINT_VALUES];  // Space to read a mean spectrum into
+    bool _hasMean;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ *scanTrace.cpp
+*/
+
+#include "scanTrace.h"
+
+
+//----------------------------------------------------------------------------
+//                              RECORDING
+//----------------------------------------------------------------------------
+
+scanRecorder::scanRecorder(Stream *stream, Print *trace)
+{
+    _stream = stream;
+    _trace = trace;
+    _lastRecordTime = 0;
+    _records = 0;
+    _requestLength = 0;
+    _requestTime = 0;
+    _inResponse = false;
+    _responseLength = 0;
+    _responseTime = 0;
+}
+scanRecorder::scanRecorder(Stream &stream, Print &trace) : scanRecorder(&stream, &trace) {}
+
+// This writes the trace header:  "SCNT", the version, and 3 spare bytes
+void scanRecorder::begin(void)
+{
+    _trace->write((const uint8_t *)SCAN_TRACE_MAGIC, 4);
+    _trace->write((uint8_t)SCAN_TRACE_VERSION);
+    for (int i = 5; i < SCAN_TRACE_HEADER_LENGTH; i++) _trace->write((uint8_t)0);
+    _requestLength = 0;
+    _inResponse = false;
+    _responseLength = 0;
+    _records = 0;
+    _lastRecordTime = micros();
+}
+
+void scanRecorder::finish(void) {writeRecords();}
+
+// The response is timed from when its first byte is seen waiting
+int scanRecorder::available(void)
+{
+    int waiting = _stream->available();
+    if (waiting > 0) startResponse();
+    return waiting;
+}
+
+// Nothing is written here, however long the response; only a response too
+// big for the buffer is written out in pieces
+int scanRecorder::read(void)
+{
+    int c = _stream->read();
+    if (c < 0) return c;
+    if (_responseLength == SCAN_TRACE_BUFFER_SIZE) writeRecords();
+    startResponse();
+    _response[_responseLength++] = c;
+    return c;
+}
+
+// A request after a response (or a full buffer) is the direction change
+// that writes out the last exchange
+size_t scanRecorder::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (_inResponse || _requestLength == SCAN_TRACE_BUFFER_SIZE) writeRecords();
+        if (_requestLength == 0) _requestTime = micros();
+        _request[_requestLength++] = buffer[i];
+    }
+    return _stream->write(buffer, size);
+}
+
+void scanRecorder::flush(void) {_stream->flush();}
+
+void scanRecorder::startResponse(void)
+{
+    if (_inResponse) return;
+    _inResponse = true;
+    _responseTime = micros();
+}
+
+void scanRecorder::writeRecords(void)
+{
+    if (_requestLength > 0)
+        writeRecord(SCAN_TRACE_REQUEST, _requestTime, _request, _requestLength);
+    if (_responseLength > 0)
+        writeRecord(SCAN_TRACE_RESPONSE, _responseTime, _response, _responseLength);
+    _requestLength = 0;
+    _inResponse = false;
+    _responseLength = 0;
+}
+
+void scanRecorder::writeRecord(byte type, uint32_t recordTime, const byte *data, int length)
+{
+    _trace->write(type);
+    writeVarint(recordTime - _lastRecordTime);
+    writeVarint(length);
+    _trace->write(data, length);
+    _lastRecordTime = recordTime;
+    _records++;
+}
+
+void scanRecorder::writeVarint(uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        _trace->write((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    _trace->write((uint8_t)value);
+}
+
+
+//----------------------------------------------------------------------------
+//                              REPLAYING
+//----------------------------------------------------------------------------
+
+scanReplayer::scanReplayer(Stream *trace, float timeScale)
+{
+    _trace = trace;
+    _timeScale = timeScale;
+    _requests = 0;
+    _mismatches = 0;
+    _recordType = 0;
+    _recordDelay = 0;
+    _length = 0;
+    _inRequest = false;
+    _requestStart = 0;
+    _written = 0;
+    _matched = true;
+    _responseDue = 0;
+    _responsePosition = 0;
+    _responseLength = 0;
+}
+scanReplayer::scanReplayer(Stream &trace, float timeScale) : scanReplayer(&trace, timeScale) {}
+
+// This checks the magic bytes and version at the start of the trace
+bool scanReplayer::begin(void)
+{
+    byte header[SCAN_TRACE_HEADER_LENGTH];
+    if (_trace->readBytes(header, SCAN_TRACE_HEADER_LENGTH) != SCAN_TRACE_HEADER_LENGTH) return false;
+    if (memcmp(header, SCAN_TRACE_MAGIC, 4) != 0) return false;
+    if (header[4] != SCAN_TRACE_VERSION) return false;
+    _requests = 0;
+    _mismatches = 0;
+    _recordType = 0;
+    _inRequest = false;
+    _responsePosition = 0;
+    _responseLength = 0;
+    return true;
+}
+
+bool scanReplayer::finished(void)
+{
+    return _trace->available() == 0 && _recordType != SCAN_TRACE_REQUEST
+           && _responsePosition >= _responseLength;
+}
+
+// The response only becomes available once its recorded delay is up
+int scanReplayer::available(void)
+{
+    if (_responsePosition >= _responseLength) return 0;
+    if ((int32_t)(micros() - _responseDue) < 0) return 0;
+    return _responseLength - _responsePosition;
+}
+
+int scanReplayer::read(void)
+{
+    if (available() == 0) return -1;
+    return _buffer[_responsePosition++];
+}
+
+int scanReplayer::peek(void)
+{
+    if (available() == 0) return -1;
+    return _buffer[_responsePosition];
+}
+
+// Each byte is checked against the recorded request; once as many bytes as
+// were recorded have been written, the recorded response is lined up
+size_t scanReplayer::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (!_inRequest) startRequest();
+        if (_recordType != SCAN_TRACE_REQUEST) continue;  // Past the end of the trace
+        if (_written >= _length || buffer[i] != _buffer[_written]) _matched = false;
+        _written++;
+        if (_written == _length) answerRequest();
+    }
+    return size;
+}
+
+void scanReplayer::flush(void)
+{
+    if (_inRequest) answerRequest();
+}
+
+void scanReplayer::startRequest(void)
+{
+    _responsePosition = 0;  // Anything not read of the last response is gone
+    _responseLength = 0;
+    while (_recordType != SCAN_TRACE_REQUEST && readRecord()) {}
+    if (_recordType != SCAN_TRACE_REQUEST) _mismatches++;  // Nothing left to answer it
+    _inRequest = true;
+    _requestStart = micros();
+    _written = 0;
+    _matched = true;
+}
+
+void scanReplayer::answerRequest(void)
+{
+    _inRequest = false;
+    if (_recordType != SCAN_TRACE_REQUEST) return;
+    _requests++;
+    if (!_matched || _written != _length) _mismatches++;
+    _recordType = 0;
+
+    // If the device didn't answer this request, neither will we
+    if (!readRecord() || _recordType != SCAN_TRACE_RESPONSE) return;
+    _responseDue = _requestStart + (uint32_t)(_recordDelay*_timeScale);
+    _responsePosition = 0;
+    _responseLength = _length;
+}
+
+bool scanReplayer::readRecord(void)
+{
+    byte type;
+    uint32_t length;
+    _recordType = 0;
+    if (_trace->available() == 0) return false;  // Don't wait out the timeout
+    if (_trace->readBytes(&type, 1) != 1) return false;
+    if (!readVarint(_recordDelay) || !readVarint(length)) return false;
+    if (length > SCAN_TRACE_BUFFER_SIZE) return false;  // Not a trace we can read
+    if (_trace->readBytes(_buffer, length) != length) return false;
+    _recordType = type;
+    _length = length;
+    return true;
+}
+
+bool scanReplayer::readVarint(uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 32; shift += 7)
+    {
+        byte c;
+        if (_trace->readBytes(&c, 1) != 1) return false;
+        value |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,174 @@
+/*
+ *scanTrace.h
+*/
+
+#ifndef scanTrace_h
+#define scanTrace_h
+
+#include <Arduino.h>
+#include "scanRegisterMap.h"
+
+// The largest request or response that can be recorded or replayed whole;
+// this fits the largest RTU frame the library sends or asks for
+#ifndef SCAN_TRACE_BUFFER_SIZE
+#define SCAN_TRACE_BUFFER_SIZE (8 + 2*MAX_REGS_PER_FRAME + 2)
+#endif
+
+// The trace file starts with "SCNT" and a version number
+#define SCAN_TRACE_MAGIC "SCNT"
+#define SCAN_TRACE_VERSION 1
+#define SCAN_TRACE_HEADER_LENGTH 8
+
+// The kinds of records in a trace
+#define SCAN_TRACE_REQUEST 0x01
+#define SCAN_TRACE_RESPONSE 0x02
+
+
+//----------------------------------------------------------------------------
+//                    RECORDING AND REPLAYING BUS SESSIONS
+//----------------------------------------------------------------------------
+// A trace is a header followed by one record per request or response:
+//    type (1 byte) | microseconds since the last record | length | bytes
+// The time and length are unsigned LEB128 varints (7 bits per byte, low
+// bits first, high bit set on all but the last byte), so most records have
+// only 3 or 4 bytes of overhead.
+
+
+// This sits between the library and the real serial port (or TCP
+// transport) and writes every request and response that passes through it,
+// with its timing, to a file or any other Print.  Each request and its
+// response are held in memory and written together when the next request
+// starts, so the time spent writing them falls between exchanges rather
+// than inside a response (where a slow SD card write could overflow the
+// serial receive buffer on a small board).
+//    scanRecorder recorder(Serial1, traceFile);
+//    spectro.begin(0x04, recorder);
+class scanRecorder : public Stream
+{
+
+public:
+    scanRecorder(Stream *stream, Print *trace);
+    scanRecorder(Stream &stream, Print &trace);
+
+    // This writes the trace header; call it once before anything else
+    void begin(void);
+
+    // This writes out the request and response being held (if any)
+    // Call it before closing the trace file.
+    void finish(void);
+
+    // This returns the number of records written
+    uint32_t getRecordCount(void) {return _records;}
+
+    int available(void);
+    int read(void);
+    int peek(void) {return _stream->peek();}
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush(void);
+
+private:
+    // This starts timing the response, if it hasn't been started already
+    void startResponse(void);
+
+    // This writes the request and response being held to the trace
+    void writeRecords(void);
+
+    // This writes one record to the trace
+    void writeRecord(byte type, uint32_t recordTime, const byte *data, int length);
+
+    // This writes an unsigned LEB128 varint to the trace
+    void writeVarint(uint32_t value);
+
+    Stream *_stream;
+    Print *_trace;
+    uint32_t _lastRecordTime;
+    uint32_t _records;
+    // The request being held, and when it started (in microseconds)
+    byte _request[SCAN_TRACE_BUFFER_SIZE];
+    int _requestLength;
+    uint32_t _requestTime;
+    // The response being collected
+    bool _inResponse;
+    byte _response[SCAN_TRACE_BUFFER_SIZE];
+    int _responseLength;
+    uint32_t _responseTime;
+};
+
+
+// This plays back a trace as if it were the real device:  each request the
+// library sends is answered with the next response in the trace, after the
+// recorded delay multiplied by the time scale (0 = no delay at all).
+// Requests that don't match the recording are counted but still answered,
+// so the traffic is always the same from run to run.
+class scanReplayer : public Stream
+{
+
+public:
+    scanReplayer(Stream *trace, float timeScale = 1.0);
+    scanReplayer(Stream &trace, float timeScale = 1.0);
+
+    // This checks the trace header; returns false if it isn't a trace
+    bool begin(void);
+
+    // This sets how much to stretch (>1) or shrink (<1) the recorded delays
+    void setTimeScale(float timeScale) {_timeScale = timeScale;}
+
+    // This returns the number of requests answered
+    uint32_t getRequestCount(void) {return _requests;}
+
+    // This returns the number of requests that didn't match the recording
+    uint32_t getMismatchCount(void) {return _mismatches;}
+
+    // This returns true once every record in the trace has been used
+    bool finished(void);
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) {return write(&c, 1);}
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    // This ends the request being written, even if it's shorter than the
+    // recorded one
+    void flush(void);
+
+private:
+    // This reads the next record from the trace into the buffer
+    // Returns false at the end of the trace.
+    bool readRecord(void);
+
+    // This reads an unsigned LEB128 varint from the trace
+    bool readVarint(uint32_t &value);
+
+    // This finds the next recorded request, skipping any unread response
+    void startRequest(void);
+
+    // This ends the request being written and lines up the recorded response
+    void answerRequest(void);
+
+    Stream *_trace;
+    float _timeScale;
+    uint32_t _requests;
+    uint32_t _mismatches;
+
+    // The record in the buffer
+    byte _recordType;  // 0 if there isn't one
+    uint32_t _recordDelay;  // Microseconds since the record before it
+    byte _buffer[SCAN_TRACE_BUFFER_SIZE];
+    int _length;
+
+    // The request being written
+    bool _inRequest;
+    uint32_t _requestStart;  // In microseconds
+    int _written;
+    bool _matched;
+
+    // The response being served
+    uint32_t _responseDue;  // In microseconds
+    int _responsePosition;
+    int _responseLength;
+};
+
+#endif
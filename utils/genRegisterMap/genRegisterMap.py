@@ -0,0 +1,355 @@
+#!/usr/bin/env python
+"""
+genRegisterMap.py
+
+This reads the best-guess modbus map in FullSpecModbusMap.xlsx and writes out
+src/scanRegisterMap.h, a header of constexpr register descriptions (table,
+address, stride, length and data type) that the scan class uses instead of
+hand-typed register numbers.
+
+Usage (from the root of the library):
+    python utils/genRegisterMap/genRegisterMap.py [FullSpecModbusMap.xlsx] [src/scanRegisterMap.h]
+
+Only the python standard library is needed; the xlsx file is read directly.
+
+How repeated blocks are found:
+  - Rows in a section whose heading has a number in it (ie, "Parameter 3
+    Description" or "Reference 2") belong to block number 3 or 2.  The stride
+    is the spacing between the starts of those sections.
+  - Rows without a numbered heading whose tag name repeats (ie, each of the 8
+    fingerprint sections has a "tFingerprintTime") are numbered in order.
+  - Digits are dropped from the tag names of repeated blocks, so "abP1Name"
+    becomes "abPName" and "cRefName0" becomes "cRefName".
+
+Some registers the library reads are not named in the spreadsheet (or are
+guesses that don't match it exactly).  Those are listed in EXTRA_REGISTERS
+below so that they end up in the same header.
+"""
+
+import re
+import sys
+import zipfile
+import xml.etree.ElementTree as ET
+
+NS = {'m': 'http://schemas.openxmlformats.org/spreadsheetml/2006/main'}
+
+# Sheet number, read command, and namespace for the generated constants
+SHEETS = [
+    (1, 0x03, 'holdingReg'),
+    (2, 0x04, 'inputReg'),
+]
+
+# Tags that are placeholders in the spreadsheet rather than real fields
+SKIP_TAGS = ('', '???', 'unknown', 'reserved', 'illegal registers')
+
+# The spreadsheet type column -> (regDataType, registers per value)
+TYPES = [
+    (r'^unit16$|^uint16$', 'regUint16', 1),
+    (r'^int16$', 'regInt16', 1),
+    (r'^enum$', 'regEnum', 1),
+    (r'^bitmask$', 'regBitmask', 1),
+    (r'^pointer$', 'regPointer', 1),
+    (r'^float32$', 'regFloat32', 2),
+    (r'^timestamp', 'regTAI64N', 6),
+    (r'^char', 'regChar', 0),  # 0 = the whole field is one value
+]
+
+# Registers used by the library that the spreadsheet doesn't name.
+# (namespace, name, read command, address of block 0, stride, length, type, comment)
+EXTRA_REGISTERS = [
+    ('holdingReg', 'uiPPrecision', 0x03, 27, 120, 1, 'regUint16',
+     'Measurement precision of parameter n - totally a WAG'),
+    ('holdingReg', 'uiRefRepetitions', 0x03, 1530, 536, 1, 'regInt16',
+     'The "Number of max repetitions" of reference n'),
+    ('inputReg', 'uiFPStatus', 0x04, 521, 512, 1, 'regBitmask',
+     'A total and complete WAG as to the location of the fingerprint status'),
+]
+
+# Registers that are in different places depending on the model
+# (struct, name, read command, address, length, type, comment)
+MODEL_REGISTERS = [
+    ('spectroLyserMap', 'globalCal', 0x03, 1081, 6, 'regChar',
+     'The global calibration name, from the private configuration'),
+    ('anaGateMap', 'globalCal', 0x04, 964, 6, 'regChar',
+     'The global calibration name, as listed by ana::gate'),
+]
+
+
+def read_sheets(path):
+    """Returns {sheet number: [[cell text, ...], ...]} for the sheets above"""
+    z = zipfile.ZipFile(path)
+    strings = []
+    root = ET.fromstring(z.read('xl/sharedStrings.xml'))
+    for si in root.findall('m:si', NS):
+        strings.append(''.join(t.text or '' for t in si.iter('{%s}t' % NS['m'])))
+    sheets = {}
+    for number, _, _ in SHEETS:
+        rows = []
+        root = ET.fromstring(z.read('xl/worksheets/sheet%d.xml' % number))
+        for row in root.iter('{%s}row' % NS['m']):
+            cells = {}
+            for c in row.findall('m:c', NS):
+                col = re.match(r'[A-Z]+', c.get('r')).group(0)
+                v = c.find('m:v', NS)
+                if v is None:
+                    text = ''
+                elif c.get('t') == 's':
+                    text = strings[int(v.text)]
+                else:
+                    text = v.text
+                cells[col] = text.strip()
+            rows.append([cells.get(col, '') for col in 'ABCDEFGHI'])
+        sheets[number] = rows
+    return sheets
+
+
+def parse_type(text, length):
+    for pattern, name, width in TYPES:
+        if re.search(pattern, text.strip().lower()):
+            return name, (width or length)
+    return 'regUnknown', length
+
+
+def collect(rows, regType):
+    """Returns a list of field occurrences from one sheet"""
+    fields = []
+    section = ''
+    for group, tag, reg, dtype, length, _, desc, _, _ in rows:
+        if group:
+            section = group
+        try:
+            address = int(reg, 16)
+            length = int(float(length))
+        except ValueError:
+            continue
+        if tag.lower() in SKIP_TAGS:
+            continue
+        sectionNumber = re.search(r'\d+', section)
+        fields.append({
+            'tag': tag,
+            'section': re.sub(r'\s*\d+\s*', ' n ', section).strip(),
+            'index': int(sectionNumber.group(0)) if sectionNumber else None,
+            'address': address,
+            'length': length,
+            'type': parse_type(dtype, length),
+            'desc': ' '.join(desc.split()),
+            'regType': regType,
+        })
+    return fields
+
+
+def section_strides(rows):
+    """The spacing between numbered sections, ie, 120 for 'Parameter n Description'"""
+    starts = {}
+    section = ''
+    for group, _, reg, _, _, _, _, _, _ in rows:
+        if group:
+            section = group
+            try:
+                address = int(reg, 16)
+            except ValueError:
+                continue
+            number = re.search(r'\d+', section)
+            if number:
+                key = re.sub(r'\s*\d+\s*', ' n ', section).strip()
+                starts.setdefault(key, {})[int(number.group(0))] = address
+    strides = {}
+    for key, byIndex in starts.items():
+        indices = sorted(byIndex)
+        if len(indices) > 1:
+            strides[key] = ((byIndex[indices[1]] - byIndex[indices[0]])
+                            // (indices[1] - indices[0]))
+    return strides
+
+
+def build(fields, strides):
+    """Merges repeated occurrences into single strided register descriptions"""
+    byName = {}
+    order = []
+    counts = {}
+    for f in fields:
+        counts[f['tag']] = counts.get(f['tag'], 0) + 1
+    for f in fields:
+        stride = strides.get(f['section'], 0) if f['index'] is not None else 0
+        if stride:
+            name = re.sub(r'\d+', '', f['tag']) or f['tag']
+            index = f['index']
+        elif counts[f['tag']] > 1:
+            name = f['tag']
+            index = None  # numbered in order below
+        else:
+            name = f['tag']
+            index = 0
+        if name not in byName:
+            byName[name] = []
+            order.append(name)
+        byName[name].append((index, stride, f))
+
+    registers = []
+    for name in order:
+        occurrences = byName[name]
+        first = occurrences[0][2]
+        if occurrences[0][0] is None:
+            # Repeated tag outside of a numbered section, number in order
+            occurrences = [(i, 0, o[2]) for i, o in enumerate(occurrences)]
+            stride = (occurrences[1][2]['address'] - occurrences[0][2]['address'])
+        else:
+            stride = occurrences[0][1]
+        index = occurrences[0][0]
+        base = first['address'] - stride * index
+        for i, _, o in occurrences:
+            if o['address'] != base + stride * i:
+                sys.stderr.write('Inconsistent address for %s block %d (%d != %d)\n'
+                                 % (name, i, o['address'], base + stride * i))
+        registers.append({
+            'name': name,
+            'regType': first['regType'],
+            'address': base,
+            'stride': stride,
+            'length': first['length'],
+            'type': first['type'][0],
+            'desc': first['desc'],
+        })
+    return registers
+
+
+def c_comment(text, width=72):
+    text = text.replace('*/', '* /')
+    return text if len(text) <= width else text[:width - 3].rstrip() + '...'
+
+
+def write_header(path, spreadsheet, byNamespace, models):
+    out = []
+    w = out.append
+    w('/*')
+    w(' *scanRegisterMap.h')
+    w(' *')
+    w(' * GENERATED FILE - do not edit by hand!')
+    w(' * This was written by utils/genRegisterMap/genRegisterMap.py from')
+    w(' * %s.  Make any changes there and re-run the generator.' % spreadsheet)
+    w(' *')
+    w(' * Each register (or block of registers) is described by the modbus command')
+    w(' * used to read it, the address of the first register for block number 0,')
+    w(' * the number of registers between repeated blocks (ie, between parameters')
+    w(' * or fingerprint sources), the total number of registers, and the data type.')
+    w(' * Everything is constexpr, so the addresses and the number of frames needed')
+    w(' * for a bulk read are worked out by the compiler.')
+    w('*/')
+    w('')
+    w('#ifndef scanRegisterMap_h')
+    w('#define scanRegisterMap_h')
+    w('')
+    w('#include <Arduino.h>')
+    w('')
+    w('#ifndef MAX_REGS_PER_FRAME')
+    w('#define MAX_REGS_PER_FRAME 60  // The largest number of registers to call at once')
+    w('#endif')
+    w('')
+    w('// The data types in the modbus map')
+    w('typedef enum regDataType')
+    w('{')
+    w('    regUnknown = 0,')
+    w('    regUint16,')
+    w('    regInt16,')
+    w('    regEnum,')
+    w('    regBitmask,')
+    w('    regPointer,')
+    w('    regFloat32,')
+    w('    regTAI64N,')
+    w('    regChar')
+    w('} regDataType;')
+    w('')
+    w('// The description of a single register or repeated block of registers')
+    w('struct scanRegister')
+    w('{')
+    w('    byte regType;  // The modbus read command (0x03 = holding, 0x04 = input)')
+    w('    uint16_t address;  // The first register for block number 0')
+    w('    uint16_t stride;  // The registers between repeated blocks (0 if not repeated)')
+    w('    uint16_t length;  // The total number of registers in the field')
+    w('    regDataType type;  // The data type of each value in the field')
+    w('')
+    w('    // The first register of block number n')
+    w('    constexpr uint16_t at(int n = 0) const {return address + stride*n;}')
+    w('    // The number of registers taken by each value')
+    w('    constexpr uint16_t width(void) const')
+    w('    {return type == regFloat32 ? 2 : (type == regTAI64N ? 6 : (type == regChar ? length : 1));}')
+    w('    // The number of values in the field')
+    w('    constexpr uint16_t count(void) const {return length/width();}')
+    w('    // The number of characters in a char field')
+    w('    constexpr uint16_t chars(void) const {return length*2;}')
+    w('    // The number of whole values that fit in a single modbus frame')
+    w('    constexpr uint16_t valuesPerFrame(void) const {return MAX_REGS_PER_FRAME/width();}')
+    w('    // The number of modbus frames needed to read the whole field')
+    w('    constexpr uint16_t frames(void) const')
+    w('    {return (count() + valuesPerFrame() - 1)/valuesPerFrame();}')
+    w('    // The byte location of block n in a response frame that started at firstReg')
+    w('    // (3 bytes of Modbus header + (2 bytes/register x (register - start register))')
+    w('    constexpr int byteInFrame(uint16_t firstReg, int n = 0) const')
+    w('    {return 3 + 2*(at(n) - firstReg);}')
+    w('};')
+    for namespace, registers in byNamespace:
+        w('')
+        w('')
+        w('//----------------------------------------------------------------------------')
+        w('//  %s' % ('HOLDING REGISTERS (read with 0x03)' if namespace == 'holdingReg'
+                     else 'INPUT REGISTERS (read with 0x04)'))
+        w('//----------------------------------------------------------------------------')
+        w('namespace %s' % namespace)
+        w('{')
+        for r in registers:
+            if r['desc']:
+                w('    // %s' % c_comment(r['desc']))
+            w('    constexpr scanRegister %s = {0x%02X, %d, %d, %d, %s};'
+              % (r['name'], r['regType'], r['address'], r['stride'],
+                 r['length'], r['type']))
+        w('}')
+    w('')
+    w('')
+    w('//----------------------------------------------------------------------------')
+    w('//  MODEL SPECIFIC REGISTERS')
+    w('//----------------------------------------------------------------------------')
+    w('// These differ between a spectro::lyzer and ana::gate.  The structs can be')
+    w('// used as a template parameter to pick the map at compile time.')
+    for struct, entries in models:
+        w('struct %s' % struct)
+        w('{')
+        for name, regType, address, length, dtype, desc in entries:
+            w('    // %s' % c_comment(desc))
+            w('    static constexpr scanRegister %s(void) {return {0x%02X, %d, 0, %d, %s};}'
+              % (name, regType, address, length, dtype))
+        w('};')
+    w('')
+    w('#endif')
+    w('')
+    with open(path, 'w') as f:
+        f.write('\n'.join(out))
+
+
+def main():
+    spreadsheet = sys.argv[1] if len(sys.argv) > 1 else 'FullSpecModbusMap.xlsx'
+    header = sys.argv[2] if len(sys.argv) > 2 else 'src/scanRegisterMap.h'
+    sheets = read_sheets(spreadsheet)
+
+    byNamespace = []
+    for number, regType, namespace in SHEETS:
+        rows = sheets[number]
+        registers = build(collect(rows, regType), section_strides(rows))
+        names = set(r['name'] for r in registers)
+        for ns, name, rt, address, stride, length, dtype, desc in EXTRA_REGISTERS:
+            if ns == namespace and name not in names:
+                registers.append({'name': name, 'regType': rt, 'address': address,
+                                  'stride': stride, 'length': length,
+                                  'type': dtype, 'desc': desc})
+        byNamespace.append((namespace, registers))
+
+    models = []
+    for struct, name, regType, address, length, dtype, desc in MODEL_REGISTERS:
+        if not models or models[-1][0] != struct:
+            models.append((struct, []))
+        models[-1][1].append((name, regType, address, length, dtype, desc))
+
+    write_header(header, spreadsheet.split('/')[-1], byNamespace, models)
+
+
+if __name__ == '__main__':
+    main()